@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <iostream>
+#include <thread>
+
+#include "accelerator.hpp"
+#include "classifier.hpp"
+#include "trace.hpp"
+#include "cpu_conv.hpp"
+
+using namespace std;
+
+Accelerator::Accelerator()
+	: keep_weights(false), weights0_version(0), bias_version(0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+const char *ip_command_name(int command)
+{
+	switch(command)
+	{
+	case IP_COMMAND_LOAD_BIAS:		return "write_ip:LOAD_BIAS";
+	case IP_COMMAND_LOAD_WEIGHTS0:		return "write_ip:LOAD_WEIGHTS0";
+	case IP_COMMAND_LOAD_CONV0_INPUT:	return "write_ip:LOAD_CONV0_INPUT";
+	case IP_COMMAND_START_CONV0:		return "write_ip:START_CONV0";
+	case IP_COMMAND_LOAD_WEIGHTS1:		return "write_ip:LOAD_WEIGHTS1";
+	case IP_COMMAND_LOAD_CONV1_INPUT:	return "write_ip:LOAD_CONV1_INPUT";
+	case IP_COMMAND_START_CONV1:		return "write_ip:START_CONV1";
+	case IP_COMMAND_LOAD_WEIGHTS2:		return "write_ip:LOAD_WEIGHTS2";
+	case IP_COMMAND_LOAD_CONV2_INPUT:	return "write_ip:LOAD_CONV2_INPUT";
+	case IP_COMMAND_START_CONV2:		return "write_ip:START_CONV2";
+	case IP_COMMAND_RESET:			return "write_ip:RESET";
+	case IP_COMMAND_READ_CONV0_OUTPUT:	return "write_ip:READ_CONV0_OUTPUT";
+	case IP_COMMAND_READ_CONV1_OUTPUT:	return "write_ip:READ_CONV1_OUTPUT";
+	case IP_COMMAND_READ_CONV2_OUTPUT:	return "write_ip:READ_CONV2_OUTPUT";
+	default:				return "write_ip:UNKNOWN";
+	}
+}
+
+/* ------------------------ */
+/* ---Device accelerator--- */
+/* ------------------------ */
+
+DeviceAccelerator::DeviceAccelerator(const string &dma_path, const string &ip_path)
+	: dma_path(dma_path), ip_path(ip_path)
+{
+	fd = open(dma_path.c_str(), O_RDWR | O_NDELAY);
+	stats.syscalls++;
+	if(fd < 0)
+	{
+		cout << "[app] Cannot open " << dma_path << " for write" << endl;
+	}
+
+	ip_fd = open(ip_path.c_str(), O_WRONLY | O_CLOEXEC);
+	stats.syscalls++;
+	if(ip_fd < 0)
+	{
+		cout << "[app] Could not open " << ip_path << endl;
+	}
+}
+
+DeviceAccelerator::~DeviceAccelerator()
+{
+	if(fd >= 0) close(fd);
+	if(ip_fd >= 0) close(ip_fd);
+}
+
+/* Copies len 16-bit words into the DMA buffer through a temporary mapping of /dev/dma */
+bool DeviceAccelerator::upload(const uint16_t *data, int len)
+{
+	int *p;
+	TraceSpan span("dma_upload", len*2);
+
+	p = (int*)mmap(0, len*2, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	stats.syscalls++;
+	if(p == MAP_FAILED)
+	{
+		cout << "[app] MAP FAILED" << endl;
+		return false;
+	}
+	memcpy(p, data, len*2);
+	munmap(p, len*2);
+	stats.syscalls++;
+
+	stats.bytes_to_device += len*2;
+	return true;
+}
+
+bool DeviceAccelerator::command(int command)
+{
+	// cout << "[app] Inside write_ip for " << hex << command << endl;
+
+	char line[16];
+	int len = snprintf(line, sizeof(line), "%d\n", command);
+
+	// The driver runs the command inside write(), so the span covers the whole command
+	TraceSpan span(ip_command_name(command), command);
+
+	ssize_t written = write(ip_fd, line, len);
+	stats.syscalls++;
+	stats.commands++;
+	if(written != len)
+	{
+		cout << "[app] Cannot write " << ip_path << endl;
+		return false;
+	}
+	return true;
+}
+
+/* Unpacks len 16-bit Q3.12 results from the DMA buffer into floats (two results per 32-bit word) */
+bool DeviceAccelerator::readback(float *image, int len)
+{
+	int *p;
+	TraceSpan span("dma_readback", len*2);
+
+	p = (int *)mmap(0, len*2, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	stats.syscalls++;
+	if(p == MAP_FAILED)
+	{
+		cout << "[app] MAP FAILED" << endl;
+		return false;
+	}
+
+	unpack_output(p, image, len);
+
+	munmap(p, len*2);
+	stats.syscalls++;
+
+	stats.bytes_from_device += len*2;
+	return true;
+}
+
+/* ------------------------ */
+/* ---Simulated accelerator- */
+/* ------------------------ */
+
+SimAccelerator::SimAccelerator()
+	: dma_buffer(DMA_BUFFER_WORDS, 0), dma_len(0), slice(0)
+{
+}
+
+void SimAccelerator::start_conv(int layer)
+{
+	static const int output_len[3] = { CONV0_OUTPUT_LEN, CONV1_OUTPUT_LEN, CONV2_OUTPUT_LEN };
+
+	output.assign(output_len[layer], 0);
+}
+
+bool SimAccelerator::upload(const uint16_t *data, int len)
+{
+	TraceSpan span("dma_upload", len*2);
+
+	if(len > DMA_BUFFER_WORDS) return false;
+
+	memcpy(&dma_buffer[0], data, len*2);
+	dma_len = len;
+	stats.bytes_to_device += len*2;
+	return true;
+}
+
+bool SimAccelerator::command(int command)
+{
+	TraceSpan span(ip_command_name(command), command);
+
+	stats.commands++;
+
+	switch(command)
+	{
+	case IP_COMMAND_LOAD_BIAS:
+		bias.assign(dma_buffer.begin(), dma_buffer.begin() + dma_len);
+		break;
+
+	case IP_COMMAND_LOAD_WEIGHTS0:
+	case IP_COMMAND_LOAD_WEIGHTS1:
+	case IP_COMMAND_LOAD_WEIGHTS2:
+		weights.assign(dma_buffer.begin(), dma_buffer.begin() + dma_len);
+		break;
+
+	case IP_COMMAND_LOAD_CONV0_INPUT:
+	case IP_COMMAND_LOAD_CONV1_INPUT:
+	case IP_COMMAND_LOAD_CONV2_INPUT:
+		input.assign(dma_buffer.begin(), dma_buffer.begin() + dma_len);
+		slice = 0;
+		break;
+
+	case IP_COMMAND_START_CONV0:
+		start_conv(0);
+		slice++;
+		break;
+
+	case IP_COMMAND_START_CONV1:
+		start_conv(1);
+		slice++;
+		break;
+
+	case IP_COMMAND_START_CONV2:
+		start_conv(2);
+		slice++;
+		break;
+
+	case IP_COMMAND_READ_CONV0_OUTPUT:
+	case IP_COMMAND_READ_CONV1_OUTPUT:
+	case IP_COMMAND_READ_CONV2_OUTPUT:
+		copy(output.begin(), output.end(), dma_buffer.begin());
+		break;
+
+	case IP_COMMAND_RESET:
+		// Like the IP, RESET keeps the loaded bias
+		break;
+
+	default:
+		return false;
+	}
+	return true;
+}
+
+bool SimAccelerator::readback(float *image, int len)
+{
+	TraceSpan span("dma_readback", len*2);
+
+	if(len > DMA_BUFFER_WORDS) return false;
+
+	unpack_output((const int *)&dma_buffer[0], image, len);
+	stats.bytes_from_device += len*2;
+	return true;
+}
+
+/* ------------------------ */
+/* ----CPU accelerator----- */
+/* ------------------------ */
+
+CpuAccelerator::CpuAccelerator(int threads)
+	: threads(threads < 1 ? 1 : threads)
+{
+}
+
+void CpuAccelerator::start_conv(int layer)
+{
+	static const int padded_size[3] = { CONV1_PADDED_PICTURE_SIZE, CONV2_PADDED_PICTURE_SIZE, CONV3_PADDED_PICTURE_SIZE };
+	static const int num_of_channels[3] = { CONV1_NUM_CHANNELS, CONV2_NUM_CHANNELS, CONV3_NUM_CHANNELS };
+	static const int bias_offset[3] = { CPU_CONV0_BIAS_OFFSET, CPU_CONV1_BIAS_OFFSET, CPU_CONV2_BIAS_OFFSET };
+
+	TraceSpan span("cpu_conv", layer);
+
+	int size = padded_size[layer] - 2;
+	int plane = size * size;
+	int num_of_filters = layer == 0 ? CONV1_NUM_FILTERS : CPU_CONV_SLICE_FILTERS;
+	int first_filter = layer == 0 ? 0 : slice * CPU_CONV_SLICE_FILTERS;
+
+	// The output collects the filters of all slices and the input is the same for all of them
+	if(slice == 0)
+	{
+		SimAccelerator::start_conv(layer);
+		picture.resize(padded_size[layer] * padded_size[layer] * num_of_channels[layer]);
+		cpu_conv_unformat(&input[0], padded_size[layer], num_of_channels[layer], &picture[0]);
+	}
+
+	const int16_t *w = (const int16_t *)&weights[0];
+	const int16_t *b = (const int16_t *)&bias[bias_offset[layer] + first_filter];
+	uint16_t *out = &output[first_filter * plane];
+	int filter_len = weights.size() / num_of_filters;
+
+	/* Filters are split evenly, the calling thread takes the first share */
+	vector<thread> workers;
+	int share = (num_of_filters + threads - 1) / threads;
+
+	for(int first = share; first < num_of_filters; first += share)
+	{
+		int count = min(share, num_of_filters - first);
+		workers.push_back(thread(cpu_conv, &picture[0], padded_size[layer], num_of_channels[layer],
+					 w + first * filter_len, b + first, count, out + first * plane));
+	}
+	cpu_conv(&picture[0], padded_size[layer], num_of_channels[layer], w, b, min(share, num_of_filters), out);
+
+	for(size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+/* ------------------------ */
+/* ---Oracle accelerator--- */
+/* ------------------------ */
+
+OracleAccelerator::OracleAccelerator(Accelerator *device, Accelerator *reference)
+	: readbacks(0), mismatched_readbacks(0), mismatched_words(0), device(device), reference(reference), last_command(0)
+{
+}
+
+OracleAccelerator::~OracleAccelerator()
+{
+	delete device;
+	delete reference;
+}
+
+bool OracleAccelerator::upload(const uint16_t *data, int len)
+{
+	bool ok = device->upload(data, len) && reference->upload(data, len);
+
+	stats = device->stats;
+	return ok;
+}
+
+bool OracleAccelerator::command(int command)
+{
+	bool ok = device->command(command) && reference->command(command);
+
+	last_command = command;
+	stats = device->stats;
+	return ok;
+}
+
+bool OracleAccelerator::readback(float *image, int len)
+{
+	reference_image.resize(len);
+	if(!device->readback(image, len) || !reference->readback(&reference_image[0], len)) return false;
+
+	stats = device->stats;
+	readbacks++;
+
+	int mismatches = 0;
+	int first_mismatch = -1;
+	for(int i = 0; i < len; i++)
+	{
+		if(image[i] != reference_image[i])
+		{
+			if(mismatches == 0) first_mismatch = i;
+			mismatches++;
+		}
+	}
+
+	if(mismatches != 0)
+	{
+		cout << "[app] " << ip_command_name(last_command) << ": " << mismatches << " of " << len << " words differ from "
+		     << reference->name() << ", first at " << first_mismatch << " (" << image[first_mismatch] << " vs "
+		     << reference_image[first_mismatch] << ")" << endl;
+		mismatched_readbacks++;
+		mismatched_words += mismatches;
+	}
+	return true;
+}
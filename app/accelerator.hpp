@@ -0,0 +1,175 @@
+#ifndef ACCELERATOR_HPP
+#define ACCELERATOR_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <mutex>
+
+#define IP_COMMAND_LOAD_BIAS			0x0001
+#define IP_COMMAND_LOAD_WEIGHTS0		0x0002
+#define IP_COMMAND_LOAD_CONV0_INPUT		0x0004
+#define IP_COMMAND_START_CONV0			0x0008
+#define IP_COMMAND_LOAD_WEIGHTS1		0x0010
+#define IP_COMMAND_LOAD_CONV1_INPUT		0x0020
+#define IP_COMMAND_START_CONV1			0x0040
+#define IP_COMMAND_LOAD_WEIGHTS2		0x0080
+#define IP_COMMAND_LOAD_CONV2_INPUT		0x0100
+#define IP_COMMAND_START_CONV2			0x0200
+#define IP_COMMAND_RESET			0x0400
+#define IP_COMMAND_READ_CONV0_OUTPUT		0x0800
+#define IP_COMMAND_READ_CONV1_OUTPUT		0x1000
+#define IP_COMMAND_READ_CONV2_OUTPUT		0x2000
+
+// Largest transfer of the flow (CONV0 output, 32x32x32 words)
+#define DMA_BUFFER_WORDS			32768
+
+/* ------------------------ */
+/* ------Accelerators------ */
+/* ------------------------ */
+
+struct AcceleratorStats
+{
+	uint64_t bytes_to_device;
+	uint64_t bytes_from_device;
+	uint64_t commands;
+	uint64_t syscalls;
+};
+
+/*
+ * One CNN IP together with its DMA buffer. The classification flow only talks
+ * to the IP through these three calls, so it runs unchanged on the real
+ * device and on the simulation.
+ */
+class Accelerator
+{
+public:
+	Accelerator();
+	virtual ~Accelerator() {}
+
+	// Copies len 16-bit words into the DMA buffer
+	virtual bool upload(const uint16_t *data, int len) = 0;
+	// Issues one IP_COMMAND_* and waits for the IP to finish it
+	virtual bool command(int command) = 0;
+	// Unpacks len 16-bit Q3.12 results from the DMA buffer into floats
+	virtual bool readback(float *image, int len) = 0;
+
+	virtual const char *name() const = 0;
+
+	AcceleratorStats stats;
+
+	// Held for a whole layer (RESET ... READ_CONVn_OUTPUT) when several threads share the IP
+	std::mutex lock;
+
+	/*
+	 * Version of the model whose CONV0 weights are known to sit in the IP
+	 * from the previous image, 0 if none, see classify_batch(). Only trusted
+	 * if keep_weights is enabled.
+	 */
+	bool keep_weights;
+	uint32_t weights0_version;
+	// Version of the model whose biases the IP holds, 0 if none
+	uint32_t bias_version;
+};
+
+/* Real IP behind /dev/dma (mmap) and /dev/cnn-ip (text commands) */
+class DeviceAccelerator : public Accelerator
+{
+public:
+	DeviceAccelerator(const std::string &dma_path = "/dev/dma", const std::string &ip_path = "/dev/cnn-ip");
+	~DeviceAccelerator();
+
+	bool is_open() const { return fd >= 0 && ip_fd >= 0; }
+
+	bool upload(const uint16_t *data, int len);
+	bool command(int command);
+	bool readback(float *image, int len);
+	const char *name() const { return "device"; }
+
+private:
+	std::string dma_path;
+	std::string ip_path;
+	int fd;
+	// Opened once, every command is a single write()
+	int ip_fd;
+};
+
+/*
+ * Host-only stand-in for the IP. It keeps a DMA buffer and the IP's memories
+ * and follows the command protocol, but the convolutions produce zeros, so it
+ * measures everything except the IP compute time.
+ */
+class SimAccelerator : public Accelerator
+{
+public:
+	SimAccelerator();
+
+	bool upload(const uint16_t *data, int len);
+	bool command(int command);
+	bool readback(float *image, int len);
+	const char *name() const { return "sim"; }
+
+protected:
+	// START_CONVn for layer 0..2; slice counts the starts since the input was loaded
+	virtual void start_conv(int layer);
+
+	std::vector<uint16_t> dma_buffer;
+	int dma_len;
+
+	std::vector<uint16_t> bias;
+	std::vector<uint16_t> weights;
+	std::vector<uint16_t> input;
+	std::vector<uint16_t> output;
+	int slice;
+};
+
+/*
+ * SimAccelerator that really computes the convolutions (see cpu_conv.hpp),
+ * with the filters of each START split over threads. Its outputs are meant to
+ * be bit-identical to the IP's.
+ */
+class CpuAccelerator : public SimAccelerator
+{
+public:
+	CpuAccelerator(int threads = 1);
+
+	const char *name() const { return "cpu"; }
+
+protected:
+	void start_conv(int layer);
+
+private:
+	int threads;
+	std::vector<int16_t> picture;
+};
+
+/*
+ * Runs every call on the device and on a reference and compares what is read
+ * back. The device results are the ones handed on, so the flow behaves as if
+ * the device was used alone. Owns both accelerators.
+ */
+class OracleAccelerator : public Accelerator
+{
+public:
+	OracleAccelerator(Accelerator *device, Accelerator *reference);
+	~OracleAccelerator();
+
+	bool upload(const uint16_t *data, int len);
+	bool command(int command);
+	bool readback(float *image, int len);
+	const char *name() const { return "oracle"; }
+
+	uint64_t readbacks;
+	uint64_t mismatched_readbacks;
+	uint64_t mismatched_words;
+
+private:
+	Accelerator *device;
+	Accelerator *reference;
+	int last_command;
+	std::vector<float> reference_image;
+};
+
+const char *ip_command_name(int command);
+
+#endif
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <new>
+
+#include "alloc_count.hpp"
+
+/*
+ * The replaceable global operator new counts per thread, so the counter
+ * costs one thread-local increment and needs no locking. Array and nothrow
+ * forms end up here too.
+ */
+
+static thread_local uint64_t new_calls = 0;
+
+uint64_t thread_new_calls()
+{
+	return new_calls;
+}
+
+/*
+ * malloc and friends are interposed the same way: the executable's
+ * definitions win over libc's, count, and forward to glibc's own entry
+ * points. The counter is static TLS in the executable, so touching it never
+ * allocates, even on a thread's first call.
+ */
+
+extern "C"
+{
+void *__libc_malloc(size_t bytes);
+void *__libc_calloc(size_t count, size_t bytes);
+void *__libc_realloc(void *p, size_t bytes);
+void *__libc_memalign(size_t alignment, size_t bytes);
+void __libc_free(void *p);
+}
+
+static thread_local uint64_t malloc_calls = 0;
+
+uint64_t thread_malloc_calls()
+{
+	return malloc_calls;
+}
+
+extern "C" void *malloc(size_t bytes)
+{
+	malloc_calls++;
+	return __libc_malloc(bytes);
+}
+
+extern "C" void *calloc(size_t count, size_t bytes)
+{
+	malloc_calls++;
+	return __libc_calloc(count, bytes);
+}
+
+extern "C" void *realloc(void *p, size_t bytes)
+{
+	malloc_calls++;
+	return __libc_realloc(p, bytes);
+}
+
+extern "C" void *memalign(size_t alignment, size_t bytes)
+{
+	malloc_calls++;
+	return __libc_memalign(alignment, bytes);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t bytes)
+{
+	return memalign(alignment, bytes);
+}
+
+extern "C" int posix_memalign(void **out, size_t alignment, size_t bytes)
+{
+	if(alignment % sizeof(void *) || (alignment & (alignment - 1))) return EINVAL;
+
+	void *p = memalign(alignment, bytes);
+	if(p == NULL) return ENOMEM;
+	*out = p;
+	return 0;
+}
+
+extern "C" void free(void *p)
+{
+	__libc_free(p);
+}
+
+void *operator new(size_t bytes)
+{
+	new_calls++;
+
+	void *p = malloc(bytes ? bytes : 1);
+	if(p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t bytes)
+{
+	return operator new(bytes);
+}
+
+void *operator new(size_t bytes, const std::nothrow_t &) noexcept
+{
+	new_calls++;
+	return malloc(bytes ? bytes : 1);
+}
+
+void *operator new[](size_t bytes, const std::nothrow_t &) noexcept
+{
+	return operator new(bytes, std::nothrow);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
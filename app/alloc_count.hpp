@@ -0,0 +1,22 @@
+#ifndef ALLOC_COUNT_HPP
+#define ALLOC_COUNT_HPP
+
+#include <stdint.h>
+
+/*
+ * Calls to the global operator new (all of its forms) made by the calling
+ * thread since it started. Sampled before and after a classification, it
+ * shows whether the flow still allocates through new. Only binaries that
+ * link alloc_count.cpp have it, because that file replaces operator new.
+ */
+uint64_t thread_new_calls();
+
+/*
+ * Calls to malloc, calloc, realloc and the aligned allocators made by the
+ * calling thread since it started, including the ones operator new makes.
+ * This also catches allocations inside libc (stdio buffers, for one) that
+ * thread_new_calls() cannot see. Same linking rule as above.
+ */
+uint64_t thread_malloc_calls();
+
+#endif
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+
+#include "arena.hpp"
+
+Arena::Arena(size_t capacity)
+	: block(NULL), size(0), used(0), peak(0)
+{
+	reserve(capacity);
+}
+
+Arena::~Arena()
+{
+	free(block);
+}
+
+bool Arena::reserve(size_t capacity)
+{
+	capacity = round_up(capacity);
+	if(capacity <= size) return true;
+	if(used != 0) return false;
+
+	char *grown = NULL;
+	if(posix_memalign((void **)&grown, ARENA_ALIGNMENT, capacity) != 0) return false;
+
+	free(block);
+	block = grown;
+	size = capacity;
+	return true;
+}
+
+void *Arena::allocate(size_t bytes)
+{
+	bytes = round_up(bytes);
+	if(bytes > size - used) return NULL;
+
+	void *p = block + used;
+	used += bytes;
+	if(used > peak) peak = used;
+
+	return p;
+}
@@ -0,0 +1,58 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* ------------------------ */
+/* ----------Arena--------- */
+/* ------------------------ */
+
+/*
+ * Bump allocator for the buffers of one classification. Allocations are
+ * carved off a single block in order and never freed one by one; reset()
+ * hands the whole block back in O(1). The block is sized once for the
+ * largest batch seen, so in steady state a classification touches the heap
+ * zero times.
+ */
+
+// Every allocation starts on its own cache line
+#define ARENA_ALIGNMENT		64
+
+class Arena
+{
+public:
+	explicit Arena(size_t capacity = 0);
+	~Arena();
+
+	// Grows the block to at least capacity bytes; only allowed while nothing is allocated
+	bool reserve(size_t capacity);
+
+	// NULL if the block is exhausted
+	void *allocate(size_t bytes);
+
+	template<typename T>
+	T *allocate(size_t count)
+	{
+		return (T *)allocate(count * sizeof(T));
+	}
+
+	void reset() { used = 0; }
+
+	size_t capacity() const { return size; }
+	size_t in_use() const { return used; }
+	size_t high_water() const { return peak; }
+
+	static size_t round_up(size_t bytes) { return (bytes + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1); }
+
+private:
+	Arena(const Arena &);
+	Arena &operator=(const Arena &);
+
+	char *block;
+	size_t size;
+	size_t used;
+	size_t peak;
+};
+
+#endif
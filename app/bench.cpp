@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "classifier.hpp"
+#include "accelerator.hpp"
+#include "trace.hpp"
+#include "inference.hpp"
+#include "result_cache.hpp"
+#include "alloc_count.hpp"
+
+#ifndef GIT_REV
+#define GIT_REV "unknown"
+#endif
+
+using namespace std;
+using namespace chrono;
+
+/*
+ * End-to-end benchmark of the classification flow. Prints one JSON object,
+ * so runs from different commits can be compared directly.
+ */
+
+struct BenchConfig
+{
+	int images;
+	int warmup;
+	int batch;
+	int threads;
+	bool simulated;
+	bool cpu;
+	bool keep_weights;
+	bool async;
+	bool arena;
+	int cache_entries;
+	const char *pictures_path;
+	const char *output_path;
+};
+
+struct Worker
+{
+	Network *net;
+	Accelerator *acc;
+	vector<double> latency_us;
+	// Kept across calls, so its vectors are only allocated once
+	vector<vector1D> scores;
+	// operator new and malloc calls inside classify_batch() during the measured run
+	uint64_t new_calls;
+	uint64_t malloc_calls;
+};
+
+static vector<vector<int> > pictures;
+
+static double timeval_seconds(const timeval &t)
+{
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+static double percentile(const vector<double> &sorted, double p)
+{
+	if(sorted.empty()) return 0;
+
+	size_t rank = (size_t)(p * sorted.size());
+	if(rank >= sorted.size()) rank = sorted.size() - 1;
+	return sorted[rank];
+}
+
+static AcceleratorStats sum_stats(const vector<Accelerator *> &accs)
+{
+	AcceleratorStats sum = {0, 0, 0, 0};
+
+	for(size_t i = 0; i < accs.size(); i++)
+	{
+		sum.bytes_to_device += accs[i]->stats.bytes_to_device;
+		sum.bytes_from_device += accs[i]->stats.bytes_from_device;
+		sum.commands += accs[i]->stats.commands;
+		sum.syscalls += accs[i]->stats.syscalls;
+	}
+	return sum;
+}
+
+/* Classifies pictures [first, first + count) in batches, returns false on the first failed batch */
+static bool run_batches(Worker &worker, const BenchConfig &config, atomic<int> &next, int end, bool record)
+{
+	vector<const vector<int> *> batch;
+
+	while(true)
+	{
+		int first = next.fetch_add(config.batch);
+		if(first >= end) return true;
+
+		int last = min(first + config.batch, end);
+
+		batch.clear();
+		for(int i = first; i < last; i++) batch.push_back(&pictures[i % pictures.size()]);
+
+		uint64_t new_calls = thread_new_calls();
+		uint64_t malloc_calls = thread_malloc_calls();
+		steady_clock::time_point start = steady_clock::now();
+		if(!classify_batch(*worker.acc, *worker.net, batch, worker.scores)) return false;
+		double us = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0;
+		new_calls = thread_new_calls() - new_calls;
+		malloc_calls = thread_malloc_calls() - malloc_calls;
+
+		// Every picture of a batch completes when the batch does
+		if(record)
+		{
+			for(int i = first; i < last; i++) worker.latency_us.push_back(us);
+			worker.new_calls += new_calls;
+			worker.malloc_calls += malloc_calls;
+		}
+	}
+}
+
+/* All measured pictures in flight at once; the latency includes the time spent queued */
+static bool run_async(vector<Worker> &workers, const BenchConfig &config)
+{
+	InferenceEngine engine(config.batch);
+	vector<future<InferenceResult> > results;
+	bool ok = true;
+
+	engine.set_cache(workers[0].net->cache);
+	for(size_t t = 0; t < workers.size(); t++) engine.add_engine(workers[t].acc);
+	if(config.arena) engine.enable_arena();
+	if(!engine.start()) return false;
+
+	for(int i = config.warmup; i < config.warmup + config.images; i++)
+	{
+		results.push_back(engine.submit(pictures[i % pictures.size()]));
+	}
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		InferenceResult result = results[i].get();
+
+		ok = ok && result.ok;
+		workers[0].latency_us.push_back(result.latency_ns / 1000.0);
+	}
+	return ok;
+}
+
+static void usage(const char *name)
+{
+	cout << "Usage: " << name << " [-n images] [-w warmup] [-b batch] [-j threads] [-s | -c] [-r] [-a] [-A] [-C cache_entries] [-p pictures] [-o report.json]" << endl;
+	cout << "  -n  measured images (default 100)" << endl;
+	cout << "  -w  warmup images, not measured (default 10)" << endl;
+	cout << "  -b  images per layer-major batch (default 1)" << endl;
+	cout << "  -j  worker threads (default 1)" << endl;
+	cout << "  -s  use the simulated IP instead of /dev/dma and /dev/cnn-ip" << endl;
+	cout << "  -c  run the convolutions on the CPU reference instead of the IP" << endl;
+	cout << "  -r  keep CONV0 weights in the IP between pictures of a batch" << endl;
+	cout << "  -a  submit all images at once through the asynchronous InferenceEngine" << endl;
+	cout << "  -A  keep the intermediates of a batch in a per-thread arena" << endl;
+	cout << "  -C  cache the results of up to this many distinct pictures" << endl;
+	cout << "  -p  pictures file (default ../../../CNN_sysC_cpp/slike.txt)" << endl;
+	cout << "  -o  write the JSON report to a file instead of stdout" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	BenchConfig config = { 100, 10, 1, 1, false, false, false, false, false, 0, "../../../CNN_sysC_cpp/slike.txt", NULL };
+	vector<Worker> workers;
+	vector<Accelerator *> accs;
+	vector<thread> threads;
+	atomic<int> next(0);
+	atomic<bool> failed(false);
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:w:b:j:scraAC:p:o:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'n': config.images = atoi(optarg); break;
+		case 'w': config.warmup = atoi(optarg); break;
+		case 'b': config.batch = atoi(optarg); break;
+		case 'j': config.threads = atoi(optarg); break;
+		case 's': config.simulated = true; break;
+		case 'c': config.cpu = true; break;
+		case 'r': config.keep_weights = true; break;
+		case 'a': config.async = true; break;
+		case 'A': config.arena = true; break;
+		case 'C': config.cache_entries = atoi(optarg); break;
+		case 'p': config.pictures_path = optarg; break;
+		case 'o': config.output_path = optarg; break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if(config.images < 1 || config.warmup < 0 || config.batch < 1 || config.threads < 1 || (config.simulated && config.cpu) || config.cache_entries < 0)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	// Only the end-to-end numbers are of interest here
+	trace_enable(false);
+
+	extract_data();
+
+	if(load_pictures(config.pictures_path, 0, config.images + config.warmup, pictures) == 0)
+	{
+		cerr << "[bench] No pictures in " << config.pictures_path << endl;
+		return -1;
+	}
+
+	/* One network per thread; one simulated IP or CPU backend per thread, or the single device shared by all */
+	bool per_thread = config.simulated || config.cpu;
+	if(!per_thread)
+	{
+		DeviceAccelerator *device = new DeviceAccelerator();
+		if(!device->is_open()) return -1;
+		accs.push_back(device);
+	}
+
+	ResultCache *cache = config.cache_entries > 0 ? new ResultCache(config.cache_entries) : NULL;
+
+	workers.resize(config.threads);
+	for(int t = 0; t < config.threads; t++)
+	{
+		if(config.simulated) accs.push_back(new SimAccelerator());
+		if(config.cpu) accs.push_back(new CpuAccelerator());
+
+		workers[t].net = create_network();
+		workers[t].net->cache = cache;
+		workers[t].acc = accs[per_thread ? t : 0];
+		workers[t].new_calls = 0;
+		workers[t].malloc_calls = 0;
+		workers[t].latency_us.reserve(config.images);
+
+		if(config.arena && !enable_arena(workers[t].net)) return -1;
+	}
+
+	for(size_t i = 0; i < accs.size(); i++)
+	{
+		accs[i]->keep_weights = config.keep_weights;
+		if(!load_bias(*accs[i]))
+		{
+			cerr << "[bench] Loading biases failed" << endl;
+			return -1;
+		}
+	}
+
+	/* Warmup */
+	if(config.warmup > 0 && !run_batches(workers[0], config, next, config.warmup, false))
+	{
+		cerr << "[bench] Warmup failed" << endl;
+		return -1;
+	}
+
+	/* Measured run */
+	AcceleratorStats stats_start = sum_stats(accs);
+	uint64_t hits_start = cache ? cache->hits() : 0, misses_start = cache ? cache->misses() : 0;
+	rusage usage_start, usage_end;
+	getrusage(RUSAGE_SELF, &usage_start);
+	steady_clock::time_point start = steady_clock::now();
+
+	if(config.async)
+	{
+		if(!run_async(workers, config)) failed = true;
+	}
+	else
+	{
+		next = config.warmup;
+		for(int t = 0; t < config.threads; t++)
+		{
+			threads.push_back(thread([&, t]() {
+				if(!run_batches(workers[t], config, next, config.warmup + config.images, true)) failed = true;
+			}));
+		}
+		for(size_t t = 0; t < threads.size(); t++) threads[t].join();
+	}
+
+	double wall = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+	getrusage(RUSAGE_SELF, &usage_end);
+	AcceleratorStats stats_end = sum_stats(accs);
+	uint64_t hits = cache ? cache->hits() - hits_start : 0, misses = cache ? cache->misses() - misses_start : 0;
+
+	if(failed)
+	{
+		cerr << "[bench] Classification failed" << endl;
+		return -1;
+	}
+
+	/* Report */
+	vector<double> latency;
+	for(int t = 0; t < config.threads; t++)
+		latency.insert(latency.end(), workers[t].latency_us.begin(), workers[t].latency_us.end());
+	sort(latency.begin(), latency.end());
+
+	double mean = 0;
+	for(size_t i = 0; i < latency.size(); i++) mean += latency[i];
+	mean /= latency.size();
+
+	double user = timeval_seconds(usage_end.ru_utime) - timeval_seconds(usage_start.ru_utime);
+	double sys = timeval_seconds(usage_end.ru_stime) - timeval_seconds(usage_start.ru_stime);
+	double n = config.images;
+
+	FILE *out = config.output_path ? fopen(config.output_path, "w") : stdout;
+	if(out == NULL)
+	{
+		cerr << "[bench] Cannot open " << config.output_path << endl;
+		return -1;
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"commit\": \"%s\",\n", GIT_REV);
+	fprintf(out, "  \"backend\": \"%s\",\n", accs[0]->name());
+	fprintf(out, "  \"images\": %d,\n", config.images);
+	fprintf(out, "  \"warmup\": %d,\n", config.warmup);
+	fprintf(out, "  \"batch\": %d,\n", config.batch);
+	fprintf(out, "  \"threads\": %d,\n", config.threads);
+	fprintf(out, "  \"keep_weights\": %s,\n", config.keep_weights ? "true" : "false");
+	fprintf(out, "  \"async\": %s,\n", config.async ? "true" : "false");
+	fprintf(out, "  \"arena\": %s,\n", config.arena ? "true" : "false");
+	fprintf(out, "  \"wall_s\": %.6f,\n", wall);
+	fprintf(out, "  \"images_per_sec\": %.3f,\n", n / wall);
+	fprintf(out, "  \"latency_us\": { \"mean\": %.1f, \"p50\": %.1f, \"p95\": %.1f, \"p99\": %.1f, \"max\": %.1f },\n",
+		mean, percentile(latency, 0.50), percentile(latency, 0.95), percentile(latency, 0.99), latency.back());
+	fprintf(out, "  \"dma_bytes_per_image\": { \"to_device\": %.1f, \"from_device\": %.1f },\n",
+		(stats_end.bytes_to_device - stats_start.bytes_to_device) / n,
+		(stats_end.bytes_from_device - stats_start.bytes_from_device) / n);
+	fprintf(out, "  \"ip_commands_per_image\": %.2f,\n", (stats_end.commands - stats_start.commands) / n);
+	if(cache != NULL)
+	{
+		fprintf(out, "  \"cache\": { \"capacity\": %d, \"hit_rate\": %.4f, \"bytes\": %zu },\n",
+			config.cache_entries, hits + misses ? (double)hits / (hits + misses) : 0.0, cache->bytes());
+	}
+	fprintf(out, "  \"syscalls_per_image\": %.2f,\n", (stats_end.syscalls - stats_start.syscalls) / n);
+	if(!config.async)
+	{
+		uint64_t new_calls = 0, malloc_calls = 0;
+		for(int t = 0; t < config.threads; t++)
+		{
+			new_calls += workers[t].new_calls;
+			malloc_calls += workers[t].malloc_calls;
+		}
+		fprintf(out, "  \"new_calls_per_image\": %.2f,\n", new_calls / n);
+		fprintf(out, "  \"malloc_calls_per_image\": %.2f,\n", malloc_calls / n);
+	}
+	fprintf(out, "  \"cpu\": { \"user_s\": %.3f, \"sys_s\": %.3f, \"utilization\": %.3f, \"cores\": %u }\n",
+		user, sys, (user + sys) / wall, thread::hardware_concurrency());
+	fprintf(out, "}\n");
+
+	if(out != stdout) fclose(out);
+
+	for(int t = 0; t < config.threads; t++) destroy_network(workers[t].net);
+	for(size_t i = 0; i < accs.size(); i++) delete accs[i];
+	delete cache;
+
+	return 0;
+}
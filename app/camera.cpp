@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+#include "classifier.hpp"
+#include "frame_ring.hpp"
+
+using namespace std;
+using namespace chrono;
+
+// How long the drain waits for the consumer to take another frame before giving up on it
+#define DRAIN_TIMEOUT_MS	2000
+
+/*
+ * Stand-in for the capture process: replays pictures of slike.txt into a
+ * frame ring at a fixed rate. The ring's path is printed first, pass it to
+ * app -L to classify the frames live.
+ */
+
+static void usage(const char *name)
+{
+	cout << "Usage: " << name << " [-n frames] [-r fps] [-s slots] [-p block|newest|oldest] [-d delay_ms]" << endl;
+	cout << "  -n  frames to send (default 1000)" << endl;
+	cout << "  -r  frames per second, 0 for as fast as possible (default 100)" << endl;
+	cout << "  -s  ring slots, a power of two (default 16)" << endl;
+	cout << "  -p  full ring policy: wait, drop the new frame or drop the oldest (default oldest)" << endl;
+	cout << "  -d  time to attach the consumer before the first frame (default 2000 ms)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = 1000;
+	int fps = 100;
+	int slots = 16;
+	int delay_ms = 2000;
+	FrameRingPolicy policy = FRAME_RING_DROP_OLDEST;
+	vector<vector<int> > pictures;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:r:s:p:d:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'n': frames = atoi(optarg); break;
+		case 'r': fps = atoi(optarg); break;
+		case 's': slots = atoi(optarg); break;
+		case 'd': delay_ms = atoi(optarg); break;
+		case 'p':
+			if(!strcmp(optarg, "block")) policy = FRAME_RING_BLOCK;
+			else if(!strcmp(optarg, "newest")) policy = FRAME_RING_DROP_NEWEST;
+			else if(!strcmp(optarg, "oldest")) policy = FRAME_RING_DROP_OLDEST;
+			else
+			{
+				usage(argv[0]);
+				return -1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if(frames < 1 || fps < 0)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	if(load_pictures("../../../CNN_sysC_cpp/slike.txt", 0, min(frames, 1000), pictures) == 0) return -1;
+
+	FrameRing *ring = FrameRing::create(slots);
+	if(ring == NULL) return -1;
+
+	cout << "/proc/" << getpid() << "/fd/" << ring->fd() << endl;
+	this_thread::sleep_for(milliseconds(delay_ms));
+
+	vector<uint8_t> pixels(FRAME_BYTES);
+	int sent = 0;
+	steady_clock::time_point start = steady_clock::now();
+
+	for(int i = 0; i < frames; i++)
+	{
+		if(fps > 0) this_thread::sleep_until(start + microseconds((int64_t)i * 1000000 / fps));
+
+		const vector<int> &picture = pictures[i % pictures.size()];
+		for(int j = 0; j < FRAME_BYTES; j++) pixels[j] = picture[j];
+
+		if(ring->push(&pixels[0], i, policy)) sent++;
+	}
+
+	// Let the consumer drain the ring before the producer side goes away, as long as it keeps taking frames
+	ring->close();
+
+	uint64_t queued = ring->queued();
+	steady_clock::time_point progress = steady_clock::now();
+
+	while(queued > 0)
+	{
+		this_thread::sleep_for(milliseconds(10));
+
+		uint64_t now_queued = ring->queued();
+		if(now_queued < queued) progress = steady_clock::now();
+		else if(steady_clock::now() - progress > milliseconds(DRAIN_TIMEOUT_MS))
+		{
+			cout << "[camera] Consumer took no frame for " << DRAIN_TIMEOUT_MS << " ms, " << now_queued << " frames left in the ring" << endl;
+			break;
+		}
+		queued = now_queued;
+	}
+
+	cout << "[camera] Sent " << sent << " of " << frames << " frames, " << ring->dropped() << " dropped" << endl;
+	delete ring;
+
+	return 0;
+}
@@ -0,0 +1,747 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include "classifier.hpp"
+#include "trace.hpp"
+#include "result_cache.hpp"
+#include "host_layers.hpp"
+#include "arena.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+// Largest unpadded CONVn input and maxpool output, in values
+#define HOST_SCRATCH_LEN	max(IMAGE_LEN, max(CONV2_PICTURE_SIZE*CONV2_PICTURE_SIZE*CONV2_NUM_CHANNELS, CONV3_PICTURE_SIZE*CONV3_PICTURE_SIZE*CONV3_NUM_CHANNELS))
+// Largest formatted CONVn input, in 16-bit words
+#define HOST_INPUT_LEN		max(CONV0_INPUT_LEN, max(CONV1_INPUT_LEN, CONV2_INPUT_LEN))
+// Largest READ_CONVn_OUTPUT, in values
+#define HOST_OUTPUT_LEN		max(CONV0_OUTPUT_LEN, max(CONV1_OUTPUT_LEN, CONV2_OUTPUT_LEN))
+
+vector<int> labels;
+
+/* ------------------------ */
+/* -----Network set-up----- */
+/* ------------------------ */
+
+Network *create_network()
+{
+	Network *net = new Network;
+
+	net->maxpool[0] = new MaxPoolLayer(2);
+	net->maxpool[1] = new MaxPoolLayer(2);
+	net->maxpool[2] = new MaxPoolLayer(2);
+	net->cache = NULL;
+	net->arena = NULL;
+
+	return net;
+}
+
+void destroy_network(Network *net)
+{
+	for(int i = 0; i < 3; i++) delete net->maxpool[i];
+	delete net->arena;
+	delete net;
+}
+
+/* Buffers every picture of a batch keeps from one layer to the next */
+struct ArenaPicture
+{
+	uint16_t *input;
+	float *image;
+	float *dense1_output;
+};
+
+/* Scratch shared by the batch plus the buffers of each picture, for count pictures */
+static size_t arena_bytes(int count)
+{
+	size_t shared = Arena::round_up(HOST_SCRATCH_LEN * sizeof(uint16_t)) +
+			Arena::round_up(HOST_SCRATCH_LEN * sizeof(float)) +
+			Arena::round_up(count * sizeof(ArenaPicture));
+	size_t picture = Arena::round_up(HOST_INPUT_LEN * sizeof(uint16_t)) +
+			 Arena::round_up(HOST_OUTPUT_LEN * sizeof(float)) +
+			 Arena::round_up(DENSE1_OUTPUTS * sizeof(float));
+
+	return shared + count * picture;
+}
+
+static float random_value(float range)
+{
+	return (float)rand() / RAND_MAX * range;
+}
+
+/*
+ * Runs random data through the vector stages and the flat ones, formatting
+ * and maxpool must agree exactly. Both flows share the model's HostDense
+ * layers, load_model() checks those against DenseLayer.
+ */
+static bool check_host_layers(Network &net)
+{
+	int size = CONV2_PICTURE_SIZE, channels = CONV2_NUM_CHANNELS, len = size*size*channels;
+	vector<int> words(len);
+	vector<uint16_t> fixed(len), formatted((size+2)*(size+2)*channels);
+
+	for(int i = 0; i < len; i++)
+	{
+		words[i] = rand() & 0xffff;
+		fixed[i] = words[i];
+	}
+	vector<int> reference = format_image(pad_img(words, size, channels), size+2, channels);
+	format_padded(&fixed[0], size, channels, &formatted[0]);
+	for(size_t i = 0; i < formatted.size(); i++) if(formatted[i] != reference[i]) return false;
+
+	int img_size = CONV3_PICTURE_SIZE, filters = CONV3_NUM_FILTERS;
+	vector1D image(CONV2_OUTPUT_LEN), pooled(CONV2_OUTPUT_LEN/4), vector_pooled;
+	vector4D image4D, output;
+	vector2D flat;
+
+	for(int i = 0; i < CONV2_OUTPUT_LEN; i++) image[i] = random_value(8) - 4;
+	transform_1D_to_4D(image, image4D, img_size, filters);
+	output = net.maxpool[2]->forward_prop(image4D, {});
+
+	transform_4D_to_1D(output, vector_pooled, img_size/2, filters);
+	maxpool_planes(&image[0], img_size, filters, &pooled[0]);
+	if(pooled != vector_pooled) return false;
+
+	flatten(output, flat, img_size/2, filters);
+	maxpool_flatten(&image[0], img_size, filters, &pooled[0]);
+	return pooled == flat[0];
+}
+
+bool enable_arena(Network *net)
+{
+	if(net->arena != NULL) return true;
+
+	if(!check_host_layers(*net))
+	{
+		cout << "[app] Flat host layers do not match the vector ones, keeping the vector flow" << endl;
+		return false;
+	}
+
+	net->arena = new Arena(arena_bytes(1));
+	return true;
+}
+
+/*
+ * RESET does not clear the biases, so they are only sent when the IP holds
+ * another model's. Called under the accelerator lock after RESET.
+ */
+static bool send_bias(Accelerator &acc, const Model &model)
+{
+	if(acc.bias_version == model.version) return true;
+
+	if(!acc.upload(model.bias, BIAS_LEN) ||
+	   !acc.command(IP_COMMAND_LOAD_BIAS)) return false;
+
+	acc.bias_version = model.version;
+	return true;
+}
+
+bool load_bias(Accelerator &acc)
+{
+	ModelRef model = current_model();
+	lock_guard<mutex> guard(acc.lock);
+
+	if(model == NULL) return false;
+
+	acc.bias_version = 0;
+	return acc.command(IP_COMMAND_RESET) &&
+	       send_bias(acc, *model);
+}
+
+/* Reads count pictures of IMAGE_LEN values starting with picture first, returns how many were read */
+int load_pictures(const char *path, int first, int count, vector<vector<int> > &pictures)
+{
+	FILE *input_picture;
+	int in_temp;
+
+	input_picture = fopen(path, "r");
+	if(input_picture == NULL)
+	{
+		cout << "[app] Cannot open " << path << endl;
+		return 0;
+	}
+
+	for(long i = 0; i < (long)first * IMAGE_LEN; i++)
+	{
+		if(fscanf(input_picture, "%d", &in_temp) != 1)
+		{
+			fclose(input_picture);
+			return 0;
+		}
+	}
+
+	pictures.clear();
+	for(int picture = 0; picture < count; picture++)
+	{
+		vector<int> pixels(IMAGE_LEN);
+
+		for(int i = 0; i < IMAGE_LEN; i++)
+		{
+			if(fscanf(input_picture, "%d", &in_temp) != 1)
+			{
+				fclose(input_picture);
+				return pictures.size();
+			}
+			pixels[i] = in_temp;
+		}
+		pictures.push_back(pixels);
+	}
+	fclose(input_picture);
+
+	return pictures.size();
+}
+
+/* ------------------------ */
+/* -----Host side stages---- */
+/* ------------------------ */
+
+static void prepare_conv0_input(const vector<int> &pixels, ImageState &state)
+{
+	TRACE_SCOPE("load_image");
+
+	state.conv_input.clear();
+	for(int i = 0; i < IMAGE_LEN; i++)
+	{
+		state.conv_input.push_back((int)castFloatToBin((float)pixels[i]/255.0));
+	}
+
+	state.conv_input = pad_img(state.conv_input, CONV1_PICTURE_SIZE, CONV1_NUM_CHANNELS);
+	state.conv_input = format_image(state.conv_input, CONV1_PADDED_PICTURE_SIZE, CONV1_NUM_CHANNELS);
+
+	state.picture.assign(state.conv_input.begin(), state.conv_input.end());
+}
+
+/* Maxpool of a CONVn output followed by padding and formatting for the next layer */
+static void prepare_next_input(Network &net, int layer, ImageState &state, int img_size, int num_filters, int next_size, int next_channels, int next_padded_size)
+{
+	static const char *maxpool_names[2] = { "maxpool0", "maxpool1" };
+	static const char *format_names[2] = { "format_conv1_input", "format_conv2_input" };
+
+	TraceSpan maxpool_span(maxpool_names[layer]);
+
+	transform_1D_to_4D(state.image, state.image4D, img_size, num_filters);
+	state.output.clear();
+	state.output = net.maxpool[layer]->forward_prop(state.image4D, {});
+
+	transform_4D_to_1D(state.output, state.image, img_size/2, num_filters);
+	maxpool_span.end();
+
+	TraceSpan format_span(format_names[layer]);
+
+	// Transforming vector<float> to vector<int>
+	state.conv_input.clear();
+	for (long unsigned int i = 0; i < state.image.size(); ++i)
+	{
+		state.conv_input.push_back(castFloatToBin(state.image[i]));
+	}
+
+	state.conv_input = pad_img(state.conv_input, next_size, next_channels);
+	state.conv_input = format_image(state.conv_input, next_padded_size, next_channels);
+
+	state.picture.assign(state.conv_input.begin(), state.conv_input.end());
+}
+
+static void dense_layers(Network &net, const Model &model, ImageState &state, vector1D &scores)
+{
+	TraceSpan maxpool_span("maxpool2");
+
+	transform_1D_to_4D(state.image, state.image4D, CONV3_PICTURE_SIZE, CONV3_NUM_FILTERS);
+	state.output.clear();
+	state.output = net.maxpool[2]->forward_prop(state.image4D, {});
+	maxpool_span.end();
+
+	TraceSpan flatten_span("flatten");
+	flatten(state.output, state.dense1_input, CONV3_PICTURE_SIZE/2, CONV3_NUM_FILTERS);
+	flatten_span.end();
+
+	TraceSpan dense1_span("dense1");
+	state.dense1_output.resize(DENSE1_OUTPUTS);
+	model.host_dense[0]->forward(&state.dense1_input[0][0], &state.dense1_output[0]);
+	dense1_span.end();
+
+	TraceSpan dense2_span("dense2");
+	scores.resize(NUM_CLASSES);
+	model.host_dense[1]->forward(&state.dense1_output[0], &scores[0]);
+}
+
+/* Same as prepare_conv0_input() and prepare_next_input(), on arena buffers */
+static void arena_conv0_input(const vector<int> &pixels, uint16_t *fixed, ArenaPicture &state)
+{
+	TRACE_SCOPE("load_image");
+
+	quantize_pixels(&pixels[0], IMAGE_LEN, fixed);
+	format_padded(fixed, CONV1_PICTURE_SIZE, CONV1_NUM_CHANNELS, state.input);
+}
+
+static void arena_next_input(int layer, ArenaPicture &state, uint16_t *fixed, float *pooled, int img_size, int num_filters)
+{
+	static const char *maxpool_names[2] = { "maxpool0", "maxpool1" };
+	static const char *format_names[2] = { "format_conv1_input", "format_conv2_input" };
+	int pooled_len = img_size/2 * img_size/2 * num_filters;
+
+	TraceSpan maxpool_span(maxpool_names[layer]);
+	maxpool_planes(state.image, img_size, num_filters, pooled);
+	maxpool_span.end();
+
+	TraceSpan format_span(format_names[layer]);
+	quantize_floats(pooled, pooled_len, fixed);
+	format_padded(fixed, img_size/2, num_filters, state.input);
+}
+
+static void arena_dense_layers(const Model &model, ArenaPicture &state, float *pooled, vector1D &scores)
+{
+	TraceSpan maxpool_span("maxpool2");
+	maxpool_flatten(state.image, CONV3_PICTURE_SIZE, CONV3_NUM_FILTERS, pooled);
+	maxpool_span.end();
+
+	TraceSpan dense1_span("dense1");
+	model.host_dense[0]->forward(pooled, state.dense1_output);
+	dense1_span.end();
+
+	TraceSpan dense2_span("dense2");
+	scores.resize(NUM_CLASSES);
+	model.host_dense[1]->forward(state.dense1_output, &scores[0]);
+}
+
+/* ------------------------ */
+/* ----IP side (layers)---- */
+/* ------------------------ */
+
+static bool run_conv0(Accelerator &acc, const Model &model, const uint16_t *input, float *output)
+{
+	TRACE_SCOPE("conv0");
+	lock_guard<mutex> guard(acc.lock);
+
+	if(!acc.command(IP_COMMAND_RESET) || !send_bias(acc, model)) return false;
+
+	/* Send weights0, unless this model's are still in the IP from the previous picture */
+	if(!acc.keep_weights || acc.weights0_version != model.version)
+	{
+		if(!acc.upload(model.weights0, WEIGHTS0_LEN) ||
+		   !acc.command(IP_COMMAND_LOAD_WEIGHTS0)) return false;
+		acc.weights0_version = model.version;
+	}
+
+	/* Send input picture to CONV0, start CONV0 and read results */
+	return acc.upload(input, CONV0_INPUT_LEN) &&
+	       acc.command(IP_COMMAND_LOAD_CONV0_INPUT) &&
+	       acc.command(IP_COMMAND_START_CONV0) &&
+	       acc.command(IP_COMMAND_READ_CONV0_OUTPUT) &&
+	       acc.readback(output, CONV0_OUTPUT_LEN);
+}
+
+/* CONV1 and CONV2 weights do not fit the IP at once, they are sent in slices and the layer is started once per slice */
+static bool run_conv_sliced(Accelerator &acc, const Model &model, const uint16_t *input, float *output, const char *name, int input_len, int load_input, int load_weights, int start, int read, const uint16_t (*slices)[WEIGHTS_SLICE_LEN], int num_slices, int output_len)
+{
+	TraceSpan span(name);
+	lock_guard<mutex> guard(acc.lock);
+
+	if(!acc.command(IP_COMMAND_RESET) || !send_bias(acc, model)) return false;
+
+	if(!acc.upload(input, input_len) ||
+	   !acc.command(load_input)) return false;
+
+	for(int slice = 0; slice < num_slices; slice++)
+	{
+		if(!acc.upload(slices[slice], WEIGHTS_SLICE_LEN) ||
+		   !acc.command(load_weights) ||
+		   !acc.command(start)) return false;
+	}
+	acc.weights0_version = 0;
+
+	return acc.command(read) &&
+	       acc.readback(output, output_len);
+}
+
+static bool run_conv1(Accelerator &acc, const Model &model, const uint16_t *input, float *output)
+{
+	return run_conv_sliced(acc, model, input, output, "conv1", CONV1_INPUT_LEN, IP_COMMAND_LOAD_CONV1_INPUT, IP_COMMAND_LOAD_WEIGHTS1,
+			       IP_COMMAND_START_CONV1, IP_COMMAND_READ_CONV1_OUTPUT, model.weights1, WEIGHTS1_SLICES, CONV1_OUTPUT_LEN);
+}
+
+static bool run_conv2(Accelerator &acc, const Model &model, const uint16_t *input, float *output)
+{
+	return run_conv_sliced(acc, model, input, output, "conv2", CONV2_INPUT_LEN, IP_COMMAND_LOAD_CONV2_INPUT, IP_COMMAND_LOAD_WEIGHTS2,
+			       IP_COMMAND_START_CONV2, IP_COMMAND_READ_CONV2_OUTPUT, model.weights2, WEIGHTS2_SLICES, CONV2_OUTPUT_LEN);
+}
+
+/* ------------------------ */
+/* -----Classification----- */
+/* ------------------------ */
+
+static bool run_batch(Accelerator &acc, Network &net, const Model &model, const vector<const vector<int> *> &pictures, vector<vector1D> &scores)
+{
+	int count = pictures.size();
+	vector<ImageState> states(count);
+
+	scores.resize(count);
+
+	for(int i = 0; i < count; i++) prepare_conv0_input(*pictures[i], states[i]);
+	for(int i = 0; i < count; i++)
+	{
+		states[i].image.resize(CONV0_OUTPUT_LEN);
+		if(!run_conv0(acc, model, &states[i].picture[0], &states[i].image[0])) return false;
+	}
+
+	for(int i = 0; i < count; i++) prepare_next_input(net, 0, states[i], CONV1_PICTURE_SIZE, CONV1_NUM_FILTERS, CONV2_PICTURE_SIZE, CONV2_NUM_CHANNELS, CONV2_PADDED_PICTURE_SIZE);
+	for(int i = 0; i < count; i++)
+	{
+		states[i].image.resize(CONV1_OUTPUT_LEN);
+		if(!run_conv1(acc, model, &states[i].picture[0], &states[i].image[0])) return false;
+	}
+
+	for(int i = 0; i < count; i++) prepare_next_input(net, 1, states[i], CONV2_PICTURE_SIZE, CONV2_NUM_FILTERS, CONV3_PICTURE_SIZE, CONV3_NUM_CHANNELS, CONV3_PADDED_PICTURE_SIZE);
+	for(int i = 0; i < count; i++)
+	{
+		states[i].image.resize(CONV2_OUTPUT_LEN);
+		if(!run_conv2(acc, model, &states[i].picture[0], &states[i].image[0])) return false;
+	}
+
+	for(int i = 0; i < count; i++) dense_layers(net, model, states[i], scores[i]);
+
+	return true;
+}
+
+/* run_batch() with every intermediate in the network's arena, which is empty again on return */
+static bool run_batch_arena(Accelerator &acc, Network &net, const Model &model, const vector<const vector<int> *> &pictures, vector<vector1D> &scores)
+{
+	Arena &arena = *net.arena;
+	int count = pictures.size();
+	bool ok = true;
+
+	arena.reset();
+	if(!arena.reserve(arena_bytes(count))) return false;
+
+	uint16_t *fixed = arena.allocate<uint16_t>(HOST_SCRATCH_LEN);
+	float *pooled = arena.allocate<float>(HOST_SCRATCH_LEN);
+	ArenaPicture *states = arena.allocate<ArenaPicture>(count);
+
+	for(int i = 0; i < count; i++)
+	{
+		states[i].input = arena.allocate<uint16_t>(HOST_INPUT_LEN);
+		states[i].image = arena.allocate<float>(HOST_OUTPUT_LEN);
+		states[i].dense1_output = arena.allocate<float>(DENSE1_OUTPUTS);
+	}
+
+	scores.resize(count);
+
+	for(int i = 0; i < count; i++) arena_conv0_input(*pictures[i], fixed, states[i]);
+	for(int i = 0; i < count && ok; i++) ok = run_conv0(acc, model, states[i].input, states[i].image);
+
+	for(int i = 0; i < count && ok; i++) arena_next_input(0, states[i], fixed, pooled, CONV1_PICTURE_SIZE, CONV1_NUM_FILTERS);
+	for(int i = 0; i < count && ok; i++) ok = run_conv1(acc, model, states[i].input, states[i].image);
+
+	for(int i = 0; i < count && ok; i++) arena_next_input(1, states[i], fixed, pooled, CONV2_PICTURE_SIZE, CONV2_NUM_FILTERS);
+	for(int i = 0; i < count && ok; i++) ok = run_conv2(acc, model, states[i].input, states[i].image);
+
+	for(int i = 0; i < count && ok; i++) arena_dense_layers(model, states[i], pooled, scores[i]);
+
+	arena.reset();
+	return ok;
+}
+
+static bool run_flow(Accelerator &acc, Network &net, const Model &model, const vector<const vector<int> *> &pictures, vector<vector1D> &scores)
+{
+	if(net.arena != NULL) return run_batch_arena(acc, net, model, pictures, scores);
+
+	return run_batch(acc, net, model, pictures, scores);
+}
+
+bool classify_batch(Accelerator &acc, Network &net, const vector<const vector<int> *> &pictures, vector<vector1D> &scores)
+{
+	TRACE_SCOPE("classification");
+
+	// Held until the batch is done, a model swapped in meanwhile is used from the next batch on
+	ModelRef model = current_model();
+	if(model == NULL) return false;
+
+	if(net.cache == NULL) return run_flow(acc, net, *model, pictures, scores);
+
+	/* Only the pictures not in the cache go through the flow */
+	vector<const vector<int> *> missed;
+	vector<int> missed_index;
+	vector<vector1D> missed_scores;
+
+	scores.resize(pictures.size());
+	for(size_t i = 0; i < pictures.size(); i++)
+	{
+		if(!net.cache->lookup(*pictures[i], model->version, scores[i]))
+		{
+			missed.push_back(pictures[i]);
+			missed_index.push_back(i);
+		}
+	}
+	if(missed.empty()) return true;
+
+	if(!run_flow(acc, net, *model, missed, missed_scores)) return false;
+
+	for(size_t i = 0; i < missed.size(); i++)
+	{
+		scores[missed_index[i]] = missed_scores[i];
+		net.cache->insert(*missed[i], model->version, missed_scores[i]);
+	}
+	return true;
+}
+
+bool classify_image(Accelerator &acc, Network &net, const vector<int> &picture, vector1D &scores)
+{
+	vector<const vector<int> *> batch(1, &picture);
+	vector<vector1D> batch_scores;
+
+	if(!classify_batch(acc, net, batch, batch_scores)) return false;
+
+	scores = batch_scores[0];
+	return true;
+}
+
+int max_score_index(const vector1D &scores)
+{
+	float max_output = scores[0];
+	int max_index = 0;
+
+	for (int i = 0; i < (int)scores.size(); ++i)
+	{
+		if(scores[i] > max_output)
+		{
+			max_output = scores[i];
+			max_index = i;
+		}
+	}
+	return max_index;
+}
+
+/* The accuracy is measured on the animal classes only */
+bool is_animal(int label)
+{
+	return label == 2 ||
+	       label == 3 ||
+	       label == 4 ||
+	       label == 5 ||
+	       label == 6 ||
+	       label == 7;
+}
+
+/* ------------------------ */
+/* -----Data transforms----- */
+/* ------------------------ */
+
+/* Unpacks len 16-bit Q3.12 results (two per 32-bit word) into floats */
+void unpack_output(const int *p, float *image, int len)
+{
+	uint16_t temp;
+
+	for(int i = 0; i < len/2; i++)
+	{
+		temp = (uint16_t)((uint32_t)*(p+i) & 0x0000ffff);
+		*image++ = castBinToFloat(temp);
+
+		temp = (uint16_t)(((uint32_t)*(p+i) & 0xffff0000) >> 16);
+		*image++ = castBinToFloat(temp);
+	}
+}
+
+void flatten(vector4D source_vector,vector2D &dest_vector,int img_size, int num_of_channels)
+{
+	dest_vector.clear();
+	vector1D tmp;
+	for (int row = 0; row < img_size; ++row)
+	{	
+		for (int column = 0; column < img_size; ++column)
+		{
+			for (int channel = 0; channel < num_of_channels; ++channel)
+			{
+				tmp.push_back(source_vector[0][row][column][channel]);
+			}
+		}
+	}
+	dest_vector.push_back(tmp);
+}
+
+void transform_1D_to_4D(vector1D input_vector, vector4D& output_vector, int img_size, int num_of_channels)
+{
+	output_vector.clear();
+	vector3D rows;
+	for (int row = 0; row < img_size; ++row)
+	{	
+		vector2D columns;
+		for (int column = 0; column < img_size; ++column)
+		{
+			vector1D channels; 
+			for (int channel = 0; channel < num_of_channels; ++channel)
+			{
+				channels.push_back(input_vector[channel * img_size*img_size + column + row * img_size]);
+			}
+			columns.push_back(channels);
+		}
+		rows.push_back(columns);
+	}
+	output_vector.push_back(rows);
+}
+
+void transform_4D_to_1D(vector4D source_vector, vector1D& dest_vector,int img_size, int num_of_channels)
+{
+	dest_vector.clear();
+	for (int channel = 0; channel < num_of_channels; ++channel)
+	{	
+		for (int row = 0; row < img_size; ++row)
+		{
+			for (int column = 0; column < img_size; ++column)
+			{
+				dest_vector.push_back(source_vector[0][row][column][channel]);
+			}
+		}
+	}
+}
+
+vector<int> pad_img(vector<int> ram, int img_size, int num_of_channels)
+{
+	for(int channel = 0 ; channel < num_of_channels; channel++)
+    	{
+			// Firstly, zeros are emplaced for the first padded row (image_size(one row) + 2 for the edges)
+	        for (int i = 0; i < img_size+2; i++)
+	        {
+	        	ram.emplace((ram.begin() + (channel)*(img_size+2)*(img_size+2) + i), 0);
+	        }
+
+			// Secondly, zeros are added to each row's edge
+	        for(int rows = 1; rows < img_size + 1; rows++)
+	        {
+				// pos1 calulates the position to insert the left-most zero in each row (left edge)
+				// Component "(channel)*(img_size+2)*(img_size+2)" refers to the size of the channel
+				// Component "rows*img_size" refers to the number of rows that have been padded on the current channel
+				// Component "rows*2" takes into account the number of edge pixels that have been added (padded) on the current channel
+	        	int pos1 = (channel)*(img_size+2)*(img_size+2) + rows*img_size + rows*2;
+				// pos2 calulates the position to insert the right-most zero in each row (right edge)
+	        	int pos2 = (channel)*(img_size+2)*(img_size+2) + rows*img_size + rows*2 + 1 + img_size;
+	        	ram.emplace((ram.begin() + pos1), 0);
+	        	ram.emplace((ram.begin() + pos2), 0);
+	        }
+
+			// Finally, zeros are pushed back as we fill up the final row of the padded image (plus 2 for edges)
+	        for (int i = 0; i < img_size + 2; i++)
+	        {
+	        	ram.emplace((ram.begin() + ((channel)*(img_size+2)*(img_size+2)) + (img_size+2)*(img_size+1) + i), 0);
+	        }
+    	}
+    	
+    	return ram;
+}
+
+vector<int> format_image(vector<int> ram, int img_size, int num_of_channels)
+{
+	vector <int> temp_ram;
+
+	temp_ram.clear();
+	
+	for(int i = 0; i < img_size; i++)
+	{
+		for(int j = 0; j < num_of_channels; j++)
+		{
+			for(int k = 0; k < 3; k++)
+			{
+				temp_ram.push_back(ram[i + j * img_size * img_size + k * img_size]);
+			}
+		}
+	}
+	
+	for(int i = 3; i < img_size; i++)
+	{
+		for(int j = 0; j < img_size; j++)
+		{
+			for(int k = 0; k < num_of_channels; k++)
+			{
+				temp_ram.push_back(ram[j + k * img_size * img_size + i * img_size]);
+			}
+		}
+	}
+
+	ram.clear();
+	//ofstream results_file;
+	//results_file.open("../../data/picture1_formated.txt");
+	for(int i = 0; i < temp_ram.size(); i++) 
+	{
+		ram.push_back(temp_ram[i]);
+		//results_file << ram[ram.size() - 1] << endl;
+
+
+	}
+
+	//results_file.close();
+	return ram;
+}
+
+uint16_t castFloatToBin(float t) 
+{
+	int sign = (t >= 0) ? 0 : 1;
+	float resolution = 0.000244140625;
+	float half_of_resolution = 0.0001220703125;
+	int deo;
+	int integerPart;
+	int decimalPart;
+	uint16_t binaryValue;
+    
+	if(sign == 0)
+	{
+	deo = t/resolution;
+	if(t >= deo*resolution+half_of_resolution)
+	    deo++;
+	 binaryValue=deo;
+
+	}
+	else
+	{
+	 deo = t/resolution*(-1);
+	 if(t <= (-1)*deo*resolution-half_of_resolution)
+	     deo++;
+	 binaryValue = 65536-deo;
+	}
+
+	return binaryValue;
+}
+
+float castBinToFloat(uint16_t binaryValue) 
+{
+	uint16_t binaryValue_uint = binaryValue;
+	int sign = (binaryValue_uint >> 15) & 0x1;
+
+	if (sign == 1) {
+	binaryValue_uint = (~binaryValue_uint) + 1; // prebacujemo u pozitivno, posle cemo float pomnozitit sa -1
+	}
+
+	int integerPart = (binaryValue_uint >> 12) & 0x7;
+	int decimalPart = binaryValue_uint & 0xFFF;
+
+	float floatValue = (float)integerPart + ((float)decimalPart / 4096.0f);
+	if (sign == 1)
+	floatValue = floatValue * (-1);
+
+	return floatValue;
+}
+
+
+void extract_data()
+{
+	int in_temp;
+	FILE *input;
+
+	// Extracting the model
+
+	ModelRef model = load_model();
+	if(model == NULL) cout << "[app] Loading the model failed" << endl;
+	swap_model(model);
+
+	// Extracting labels
+	
+	input = fopen("../../../CNN_sysC_cpp/labele.txt", "r");
+	for(int i = 0; i < 10000; i++)
+	{
+		fscanf(input, "%d", &in_temp);
+		labels.push_back(in_temp);
+	}
+	fclose(input);	
+}
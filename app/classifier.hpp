@@ -0,0 +1,102 @@
+#ifndef CLASSIFIER_HPP
+#define CLASSIFIER_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include "../../specification/cpp_implementation/MaxPoolLayer.hpp"
+#include "../../specification/cpp_implementation/denselayer.hpp"
+#include "../../vp/TLM/addresses.hpp"
+#include "accelerator.hpp"
+
+class ResultCache;
+class Arena;
+
+typedef std::vector<std::vector<std::vector<std::vector<float>>>> vector4D;
+typedef std::vector<std::vector<std::vector<float>>> vector3D;
+typedef std::vector<std::vector<float>> vector2D;
+typedef std::vector<float> vector1D;
+
+/* Sizes of the transfers in 16-bit words */
+#define IMAGE_LEN			3072
+#define BIAS_LEN			128
+#define WEIGHTS0_LEN			864
+#define WEIGHTS_SLICE_LEN		4608
+#define CONV0_INPUT_LEN			3468
+#define CONV1_INPUT_LEN			10368
+#define CONV2_INPUT_LEN			3200
+#define CONV0_OUTPUT_LEN		32768
+#define CONV1_OUTPUT_LEN		8192
+#define CONV2_OUTPUT_LEN		4096
+#define NUM_CLASSES			10
+
+// Dense layer sizes in values
+#define DENSE1_INPUTS			(CONV3_PICTURE_SIZE/2 * CONV3_PICTURE_SIZE/2 * CONV3_NUM_FILTERS)
+#define DENSE1_OUTPUTS			512
+
+extern std::vector<int> labels;
+
+/* Per-thread state of the flow; the weights come from the current model (model.hpp) */
+struct Network
+{
+	MaxPoolLayer *maxpool[3];
+
+	// Optional, shared between threads; pictures found here skip the whole flow
+	ResultCache *cache;
+
+	// Set by enable_arena(): the buffers of one batch
+	Arena *arena;
+};
+
+/* Everything one image needs between two layers */
+struct ImageState
+{
+	std::vector<int> conv_input;
+	std::vector<uint16_t> picture;
+	vector1D image;
+	vector4D image4D;
+	vector4D output;
+	vector2D dense1_input;
+	vector1D dense1_output;
+};
+
+uint16_t castFloatToBin(float t);
+float castBinToFloat(uint16_t binaryValue);
+void flatten(vector4D source_vector, vector2D &dest_vector, int img_size, int num_of_channels);
+void transform_1D_to_4D(vector1D input_vector, vector4D& output_vector, int img_size, int num_of_channels);
+void transform_4D_to_1D(vector4D input_vector, vector1D& output_vector, int img_size, int num_of_channels);
+std::vector<int> format_image(std::vector<int> ram, int img_size, int num_of_channels);
+std::vector<int> pad_img(std::vector<int> ram, int img_size, int num_of_channels);
+void unpack_output(const int *p, float *image, int len);
+
+// Loads the labels and makes the model in data/ the current one
+void extract_data();
+int load_pictures(const char *path, int first, int count, std::vector<std::vector<int> > &pictures);
+
+Network *create_network();
+void destroy_network(Network *net);
+
+/*
+ * Switches the network to the flat host stages (host_layers.hpp) with every
+ * intermediate of a batch in one arena, so a classification does no heap
+ * allocation once the arena has grown to the batch size. The flat stages
+ * are checked against the vector ones first; false keeps the vector flow.
+ */
+bool enable_arena(Network *net);
+
+// Checks that the IP takes the current model's biases; the flow resends them whenever the model changes
+bool load_bias(Accelerator &acc);
+
+/*
+ * Runs the whole flow for a batch of raw 32x32x3 pictures (0-255 values).
+ * The batch is processed layer-major: every picture goes through CONV0
+ * before any goes through CONV1, and so on, so each IP layer and each host
+ * stage runs back to back. scores receives the dense2 output per picture.
+ */
+bool classify_batch(Accelerator &acc, Network &net, const std::vector<const std::vector<int> *> &pictures, std::vector<vector1D> &scores);
+bool classify_image(Accelerator &acc, Network &net, const std::vector<int> &picture, vector1D &scores);
+
+int max_score_index(const vector1D &scores);
+bool is_animal(int label);
+
+#endif
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include "classifier.hpp"
+#include "daemon_client.hpp"
+
+using namespace std;
+using namespace chrono;
+
+/*
+ * Load generator and example client of cnnd: classifies a slice of the set
+ * through the daemon, keeping -k requests of -r pictures in flight, and
+ * prints the accuracy, throughput and request round-trip percentiles.
+ */
+
+static void usage(const char *name)
+{
+	cout << "Usage: " << name << " [-S socket] [-f first] [-n count] [-r pictures_per_request] [-k in_flight]" << endl;
+	cout << "  -S  daemon socket (default " << DAEMON_SOCKET_PATH << ")" << endl;
+	cout << "  -f  first picture (default 0)" << endl;
+	cout << "  -n  number of pictures (default 100)" << endl;
+	cout << "  -r  pictures per request (default 1)" << endl;
+	cout << "  -k  requests in flight (default 8)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *socket_path = DAEMON_SOCKET_PATH;
+	int first = 0;
+	int count = 100;
+	int per_request = 1;
+	int in_flight = 8;
+	int opt;
+
+	vector<vector<int> > pictures;
+	vector<steady_clock::time_point> sent;
+	vector<double> round_trip_us;
+	vector<int> predictions;
+
+	while((opt = getopt(argc, argv, "S:f:n:r:k:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'S': socket_path = optarg; break;
+		case 'f': first = atoi(optarg); break;
+		case 'n': count = atoi(optarg); break;
+		case 'r': per_request = atoi(optarg); break;
+		case 'k': in_flight = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if(first < 0 || count < 1 || per_request < 1 || per_request > DAEMON_MAX_PICTURES || in_flight < 1)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	extract_data();
+	count = load_pictures("../../../CNN_sysC_cpp/slike.txt", first, count, pictures);
+	if(count == 0) return -1;
+
+	int sock = daemon_connect(socket_path);
+	if(sock < 0) return -1;
+
+	int num_requests = (count + per_request - 1) / per_request;
+	int next = 0;
+	int outstanding = 0;
+
+	sent.resize(num_requests);
+	predictions.assign(count, -1);
+
+	steady_clock::time_point start = steady_clock::now();
+
+	while(next < num_requests || outstanding > 0)
+	{
+		/* Keep the pipe full */
+		while(next < num_requests && outstanding < in_flight)
+		{
+			int len = min(per_request, count - next * per_request);
+
+			sent[next] = steady_clock::now();
+			if(!daemon_send(sock, next, pictures, next * per_request, len))
+			{
+				cout << "[client] Sending request " << next << " failed" << endl;
+				return -1;
+			}
+			next++;
+			outstanding++;
+		}
+
+		DaemonResponse response;
+		vector<DaemonResult> results;
+
+		if(!daemon_receive(sock, response, results) || response.id >= (uint32_t)num_requests)
+		{
+			cout << "[client] Lost the daemon" << endl;
+			return -1;
+		}
+		outstanding--;
+
+		if(response.status != DAEMON_STATUS_OK)
+		{
+			cout << "[client] Request " << response.id << " failed with status " << response.status << endl;
+			continue;
+		}
+
+		round_trip_us.push_back(duration_cast<nanoseconds>(steady_clock::now() - sent[response.id]).count() / 1000.0);
+		for(uint32_t i = 0; i < response.count; i++)
+		{
+			predictions[response.id * per_request + i] = results[i].prediction;
+		}
+	}
+
+	double wall = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e9;
+	close(sock);
+
+	int animal_count = 0;
+	int hit_count = 0;
+	for(int i = 0; i < count; i++)
+	{
+		int label = labels[first + i];
+		if(!is_animal(label)) continue;
+
+		animal_count++;
+		if(predictions[i] == label) hit_count++;
+	}
+
+	sort(round_trip_us.begin(), round_trip_us.end());
+
+	cout << "[client] Pictures classified: " << count << endl;
+	cout << "[client] Network accuracy is " << (animal_count ? (float)hit_count*100.0/animal_count : 0) << "%" << endl;
+	cout << "[client] Wall time " << fixed << setprecision(3) << wall << " s (" << count / wall << " pictures/s)" << endl;
+	if(!round_trip_us.empty())
+	{
+		cout << "[client] Request round trip p50 " << setprecision(1) << round_trip_us[round_trip_us.size() / 2]
+		     << " us, p99 " << round_trip_us[round_trip_us.size() * 99 / 100] << " us, max " << round_trip_us.back() << " us" << endl;
+	}
+
+	return 0;
+}
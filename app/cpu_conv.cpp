@@ -0,0 +1,76 @@
+#include <string.h>
+
+#include "cpu_conv.hpp"
+
+/*
+ * The first three rows are sent column by column ([column][channel][row]),
+ * every following row is sent whole with the channels innermost, so only the
+ * head of the stream has to be moved.
+ */
+void cpu_conv_unformat(const uint16_t *formatted, int padded_size, int num_of_channels, int16_t *picture)
+{
+	int row_len = padded_size * num_of_channels;
+
+	for(int column = 0; column < padded_size; column++)
+	{
+		for(int channel = 0; channel < num_of_channels; channel++)
+		{
+			for(int row = 0; row < 3; row++)
+			{
+				picture[row*row_len + column*num_of_channels + channel] = (int16_t)*formatted++;
+			}
+		}
+	}
+
+	memcpy(picture + 3*row_len, formatted, (padded_size - 3) * row_len * sizeof(int16_t));
+}
+
+/*
+ * With the channels innermost, one kernel row over one output pixel is a
+ * single dot product of 3*channels contiguous words, which the compiler
+ * turns into packed 16-bit multiply-adds.
+ */
+static inline int64_t dot(const int16_t *a, const int16_t *b, int len)
+{
+	int64_t sum = 0;
+
+	for(int i = 0; i < len; i++)
+	{
+		sum += (int32_t)a[i] * b[i];
+	}
+	return sum;
+}
+
+void cpu_conv(const int16_t *picture, int padded_size, int num_of_channels, const int16_t *weights, const int16_t *bias, int num_of_filters, uint16_t *output)
+{
+	int size = padded_size - 2;
+	int row_len = padded_size * num_of_channels;
+	int kernel_row_len = 3 * num_of_channels;
+
+	for(int filter = 0; filter < num_of_filters; filter++)
+	{
+		const int16_t *w = weights + filter * 3 * kernel_row_len;
+		int64_t b = (int64_t)bias[filter] << CPU_CONV_FRACTION_BITS;
+
+		for(int row = 0; row < size; row++)
+		{
+			const int16_t *in = picture + row * row_len;
+
+			for(int column = 0; column < size; column++)
+			{
+				const int16_t *window = in + column * num_of_channels;
+				int64_t sum = b;
+
+				sum += dot(window, w, kernel_row_len);
+				sum += dot(window + row_len, w + kernel_row_len, kernel_row_len);
+				sum += dot(window + 2*row_len, w + 2*kernel_row_len, kernel_row_len);
+
+				sum >>= CPU_CONV_FRACTION_BITS;
+				if(sum < 0) sum = 0;
+				if(sum > CPU_CONV_MAX_VALUE) sum = CPU_CONV_MAX_VALUE;
+
+				output[filter*size*size + row*size + column] = (uint16_t)sum;
+			}
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef CPU_CONV_HPP
+#define CPU_CONV_HPP
+
+#include <stdint.h>
+
+/*
+ * Host implementation of the IP's 3x3 convolutions in Q3.12 fixed point.
+ *
+ * It works on exactly what the IP receives: the format_image() stream of a
+ * padded picture, the weight slices as they are sent over DMA and the 128
+ * word bias memory. Results have the READ_CONVn_OUTPUT layout (one plane per
+ * filter, row-major). The arithmetic model of the IP is:
+ *
+ *  - weights of one filter are stored [row][column][channel], filters one
+ *    after another, CPU_CONV_SLICE_FILTERS filters per CONV1/CONV2 slice
+ *  - products are exact (Q6.24) and summed without overflow
+ *  - the bias is aligned to Q6.24 and added to the sum, which is then
+ *    truncated to Q3.12 (arithmetic shift by CPU_CONV_FRACTION_BITS)
+ *  - ReLU, then saturation to the largest positive Q3.12 value
+ */
+
+#define CPU_CONV_FRACTION_BITS		12
+#define CPU_CONV_MAX_VALUE		0x7fff
+#define CPU_CONV_SLICE_FILTERS		16
+
+// Bias memory offsets of the three layers (32 + 32 + 64 filters)
+#define CPU_CONV0_BIAS_OFFSET		0
+#define CPU_CONV1_BIAS_OFFSET		32
+#define CPU_CONV2_BIAS_OFFSET		64
+
+/* Reorders a format_image() stream back to a padded picture with the channels innermost ([row][column][channel]) */
+void cpu_conv_unformat(const uint16_t *formatted, int padded_size, int num_of_channels, int16_t *picture);
+
+/*
+ * Runs num_of_filters filters over a picture from cpu_conv_unformat().
+ * weights and bias point at the first filter, output at its plane; the
+ * planes are (padded_size-2)^2 words each.
+ */
+void cpu_conv(const int16_t *picture, int padded_size, int num_of_channels, const int16_t *weights, const int16_t *bias, int num_of_filters, uint16_t *output);
+
+#endif
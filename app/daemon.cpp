@@ -0,0 +1,486 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include "classifier.hpp"
+#include "accelerator.hpp"
+#include "inference.hpp"
+#include "trace.hpp"
+#include "daemon_protocol.hpp"
+#include "result_cache.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+/*
+ * cnnd owns the accelerator and serves classification requests from other
+ * processes (see daemon_protocol.hpp). Requests of all clients share one
+ * InferenceEngine queue, which forms batches of up to -b pictures, waiting
+ * at most -w microseconds for a batch to fill. With a p99 target (-l), the
+ * batch limit is halved whenever the p99 latency of the last window exceeds
+ * the target and grown back one step at a time while well below it.
+ *
+ * SIGHUP reloads the model from -M in the background. New batches use the
+ * new model as soon as it is loaded; the old one is freed once the batches
+ * still using it are done, and only then is another reload started, so at
+ * most two models are ever resident.
+ */
+
+// Completions per latency window of the batch controller
+#define CONTROL_WINDOW		256
+
+struct DaemonConfig
+{
+	const char *socket_path;
+	int engines;
+	int max_batch;
+	int max_wait_us;
+	int p99_target_us;
+	bool simulated;
+	bool cpu;
+	bool arena;
+	int cache_entries;
+	string device;
+	const char *model_dir;
+};
+
+struct Connection
+{
+	Connection(int fd) : fd(fd) {}
+	~Connection() { close(fd); }
+
+	int fd;
+	// Responses are written from the engine threads
+	mutex send_lock;
+};
+
+/* One request of a client, answered when its last picture completes */
+struct PendingRequest
+{
+	shared_ptr<Connection> connection;
+	uint32_t id;
+	atomic<int> remaining;
+	atomic<bool> failed;
+	vector<DaemonResult> results;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t reload_requested = 0;
+
+static InferenceEngine *engine;
+static DaemonConfig config;
+
+/* ------------------------ */
+/* ----Batch controller---- */
+/* ------------------------ */
+
+static mutex control_lock;
+static vector<uint32_t> window;
+static int batch_limit;
+static int wait_limit_us;
+
+static void control(uint32_t latency_us)
+{
+	if(config.p99_target_us <= 0) return;
+
+	lock_guard<mutex> guard(control_lock);
+
+	window.push_back(latency_us);
+	if(window.size() < CONTROL_WINDOW) return;
+
+	sort(window.begin(), window.end());
+	uint32_t p99 = window[window.size() * 99 / 100];
+	window.clear();
+
+	int batch = batch_limit;
+	int wait_us = wait_limit_us;
+
+	if((int)p99 > config.p99_target_us)
+	{
+		batch = max(1, batch / 2);
+		wait_us = wait_us / 2;
+	}
+	else if((int)p99 < config.p99_target_us * 7 / 10 && batch < config.max_batch)
+	{
+		batch++;
+		wait_us = config.max_wait_us;
+	}
+
+	if(batch != batch_limit || wait_us != wait_limit_us)
+	{
+		cout << "[cnnd] p99 " << p99 << " us, batch " << batch_limit << " -> " << batch
+		     << ", max wait " << wait_limit_us << " -> " << wait_us << " us" << endl;
+		batch_limit = batch;
+		wait_limit_us = wait_us;
+		engine->set_batching(batch_limit, wait_limit_us);
+	}
+}
+
+/* ------------------------ */
+/* --------Requests-------- */
+/* ------------------------ */
+
+static bool write_all(int fd, const void *data, size_t len)
+{
+	const char *p = (const char *)data;
+
+	while(len > 0)
+	{
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static void respond(Connection &connection, uint32_t id, uint32_t status, const vector<DaemonResult> &results)
+{
+	DaemonResponse response;
+
+	response.magic = DAEMON_MAGIC;
+	response.id = id;
+	response.status = status;
+	response.count = status == DAEMON_STATUS_OK ? results.size() : 0;
+
+	lock_guard<mutex> guard(connection.send_lock);
+	if(write_all(connection.fd, &response, sizeof(response)) && response.count > 0)
+	{
+		write_all(connection.fd, &results[0], results.size() * sizeof(DaemonResult));
+	}
+}
+
+static void picture_done(PendingRequest *request, int index, const InferenceResult &result)
+{
+	DaemonResult &out = request->results[index];
+
+	out.prediction = result.prediction;
+	out.latency_us = result.latency_ns / 1000;
+	for(int i = 0; i < DAEMON_NUM_CLASSES; i++)
+	{
+		out.scores[i] = result.ok ? result.scores[i] : 0;
+	}
+	if(!result.ok) request->failed = true;
+
+	control(out.latency_us);
+
+	if(--request->remaining == 0)
+	{
+		respond(*request->connection, request->id, request->failed ? DAEMON_STATUS_FAILED : DAEMON_STATUS_OK, request->results);
+		delete request;
+	}
+}
+
+/* Reads one request header and the memfd sent with it, returns false when the client is gone */
+static bool receive_request(int fd, DaemonRequest &request, int &picture_fd)
+{
+	char control_buffer[CMSG_SPACE(sizeof(int))];
+	struct iovec iov;
+	struct msghdr msg;
+	size_t received = 0;
+
+	picture_fd = -1;
+	while(received < sizeof(request))
+	{
+		iov.iov_base = (char *)&request + received;
+		iov.iov_len = sizeof(request) - received;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control_buffer;
+		msg.msg_controllen = sizeof(control_buffer);
+
+		ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) break;
+		received += n;
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if(cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		{
+			if(picture_fd >= 0) close(picture_fd);
+			memcpy(&picture_fd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+
+	if(received < sizeof(request))
+	{
+		if(picture_fd >= 0) close(picture_fd);
+		return false;
+	}
+	return true;
+}
+
+/* Without the seals the client could truncate the memfd while it is mapped and kill the daemon with SIGBUS */
+static bool sealed(int fd)
+{
+	int seals = fcntl(fd, F_GET_SEALS);
+
+	return seals >= 0 && (seals & DAEMON_PICTURE_SEALS) == DAEMON_PICTURE_SEALS;
+}
+
+static void serve(shared_ptr<Connection> connection)
+{
+	DaemonRequest header;
+	int picture_fd;
+	vector<int> picture(DAEMON_PICTURE_BYTES);
+
+	while(receive_request(connection->fd, header, picture_fd))
+	{
+		struct stat st;
+		size_t len = (size_t)header.count * DAEMON_PICTURE_BYTES;
+
+		if(header.magic != DAEMON_MAGIC || header.count == 0 || header.count > DAEMON_MAX_PICTURES || picture_fd < 0 ||
+		   !sealed(picture_fd) || fstat(picture_fd, &st) != 0 || (size_t)st.st_size < len)
+		{
+			cout << "[cnnd] Bad request " << header.id << endl;
+			if(picture_fd >= 0) close(picture_fd);
+			respond(*connection, header.id, DAEMON_STATUS_BAD_REQUEST, vector<DaemonResult>());
+			continue;
+		}
+
+		const uint8_t *pixels = (const uint8_t *)mmap(0, len, PROT_READ, MAP_SHARED, picture_fd, 0);
+		close(picture_fd);
+		if(pixels == MAP_FAILED)
+		{
+			respond(*connection, header.id, DAEMON_STATUS_BAD_REQUEST, vector<DaemonResult>());
+			continue;
+		}
+
+		PendingRequest *request = new PendingRequest;
+		request->connection = connection;
+		request->id = header.id;
+		request->remaining = header.count;
+		request->failed = false;
+		request->results.resize(header.count);
+
+		for(uint32_t i = 0; i < header.count; i++)
+		{
+			const uint8_t *p = pixels + (size_t)i * DAEMON_PICTURE_BYTES;
+			for(int j = 0; j < DAEMON_PICTURE_BYTES; j++) picture[j] = p[j];
+
+			engine->submit(picture, [request, i](const InferenceResult &result) { picture_done(request, i, result); });
+		}
+		munmap((void *)pixels, len);
+	}
+}
+
+/* ------------------------ */
+/* ----------Main---------- */
+/* ------------------------ */
+
+static void handle_signal(int signum)
+{
+	if(signum == SIGHUP) reload_requested = 1;
+	else stop_requested = 1;
+}
+
+/* Loads and swaps in a model per SIGHUP, then waits for the previous one to drain */
+static void reload_models()
+{
+	while(!stop_requested)
+	{
+		if(!reload_requested)
+		{
+			this_thread::sleep_for(chrono::milliseconds(50));
+			continue;
+		}
+		reload_requested = 0;
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		ModelRef model = load_model(config.model_dir);
+		if(model == NULL)
+		{
+			cout << "[cnnd] Reloading " << config.model_dir << " failed, keeping version " << current_model()->version << endl;
+			continue;
+		}
+
+		ModelRef old = swap_model(model);
+		uint32_t old_version = old->version;
+		weak_ptr<const Model> draining = old;
+
+		old.reset();
+		cout << "[cnnd] Model version " << model->version << " live after "
+		     << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+
+		while(!draining.expired() && !stop_requested) this_thread::sleep_for(chrono::milliseconds(1));
+		if(draining.expired()) cout << "[cnnd] Model version " << old_version << " retired" << endl;
+	}
+}
+
+static void usage(const char *name)
+{
+	cout << "Usage: " << name << " [-S socket] [-j engines] [-b max_batch] [-w max_wait_us] [-l p99_target_us] [-d dma,ip] [-s | -c] [-A] [-C cache_entries] [-M model_dir]" << endl;
+	cout << "  -S  socket path (default " << DAEMON_SOCKET_PATH << ")" << endl;
+	cout << "  -j  engine threads sharing the accelerator (default 2)" << endl;
+	cout << "  -b  largest batch (default 8)" << endl;
+	cout << "  -w  longest wait for a batch to fill, in microseconds (default 2000)" << endl;
+	cout << "  -l  p99 latency target in microseconds, adapts the batch limit (default off)" << endl;
+	cout << "  -d  accelerator as dma_path,ip_path (default /dev/dma,/dev/cnn-ip)" << endl;
+	cout << "  -s  use the simulated IP" << endl;
+	cout << "  -c  run the convolutions on the CPU reference" << endl;
+	cout << "  -A  keep the intermediates of each engine's batches in an arena" << endl;
+	cout << "  -C  cache the results of up to this many distinct pictures (default off)" << endl;
+	cout << "  -M  model directory, laid out like data/; kill -HUP reloads it (default " << MODEL_DIR << ")" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	vector<Accelerator *> accs;
+	int opt;
+
+	config.socket_path = DAEMON_SOCKET_PATH;
+	config.engines = 2;
+	config.max_batch = 8;
+	config.max_wait_us = 2000;
+	config.p99_target_us = 0;
+	config.simulated = false;
+	config.cpu = false;
+	config.arena = false;
+	config.cache_entries = 0;
+	config.model_dir = MODEL_DIR;
+
+	while((opt = getopt(argc, argv, "S:j:b:w:l:d:scAC:M:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'S': config.socket_path = optarg; break;
+		case 'j': config.engines = atoi(optarg); break;
+		case 'b': config.max_batch = atoi(optarg); break;
+		case 'w': config.max_wait_us = atoi(optarg); break;
+		case 'l': config.p99_target_us = atoi(optarg); break;
+		case 'd': config.device = optarg; break;
+		case 's': config.simulated = true; break;
+		case 'c': config.cpu = true; break;
+		case 'A': config.arena = true; break;
+		case 'C': config.cache_entries = atoi(optarg); break;
+		case 'M': config.model_dir = optarg; break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if(config.engines < 1 || config.max_batch < 1 || config.max_wait_us < 0 || (config.simulated && config.cpu) || config.cache_entries < 0)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	trace_enable(false);
+	extract_data();
+	if(strcmp(config.model_dir, MODEL_DIR) != 0) swap_model(load_model(config.model_dir));
+	if(current_model() == NULL) return -1;
+
+	/* One simulated IP or CPU backend per engine, or the single device shared by all */
+	if(config.simulated || config.cpu)
+	{
+		for(int i = 0; i < config.engines; i++)
+		{
+			accs.push_back(config.simulated ? (Accelerator *)new SimAccelerator() : new CpuAccelerator());
+		}
+	}
+	else
+	{
+		size_t comma = config.device.find(',');
+		DeviceAccelerator *device = comma == string::npos ? new DeviceAccelerator() :
+			new DeviceAccelerator(config.device.substr(0, comma), config.device.substr(comma + 1));
+		if(!device->is_open()) return -1;
+		accs.push_back(device);
+	}
+
+	for(size_t i = 0; i < accs.size(); i++)
+	{
+		if(!load_bias(*accs[i]))
+		{
+			cout << "[cnnd] Loading biases failed" << endl;
+			return -1;
+		}
+	}
+
+	batch_limit = config.max_batch;
+	wait_limit_us = config.max_wait_us;
+	engine = new InferenceEngine(batch_limit, wait_limit_us);
+	ResultCache *cache = config.cache_entries > 0 ? new ResultCache(config.cache_entries) : NULL;
+	engine->set_cache(cache);
+	for(int i = 0; i < config.engines; i++) engine->add_engine(accs[i % accs.size()]);
+	if(config.arena) engine->enable_arena();
+	engine->start();
+
+	/* Socket */
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, config.socket_path, sizeof(addr.sun_path) - 1);
+	unlink(config.socket_path);
+
+	if(listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0)
+	{
+		cout << "[cnnd] Cannot listen on " << config.socket_path << ": " << strerror(errno) << endl;
+		return -1;
+	}
+
+	// No SA_RESTART, so accept() returns on SIGINT/SIGTERM
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_signal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	sigaction(SIGHUP, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	// The reloader must not take the signals, or accept() would not see them
+	sigset_t signals, previous_signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+	thread reloader(reload_models);
+	pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+
+	cout << "[cnnd] Serving " << accs[0]->name() << " on " << config.socket_path << " with " << config.engines
+	     << " engines, batch " << config.max_batch << ", max wait " << config.max_wait_us << " us" << endl;
+
+	while(!stop_requested)
+	{
+		int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if(fd < 0)
+		{
+			if(errno == EINTR) continue;
+			cout << "[cnnd] accept failed: " << strerror(errno) << endl;
+			break;
+		}
+		thread(serve, make_shared<Connection>(fd)).detach();
+	}
+
+	cout << "[cnnd] Shutting down" << endl;
+	reloader.join();
+	close(listen_fd);
+	unlink(config.socket_path);
+
+	// Requests in flight still complete, the client threads may keep reading until their clients go
+	engine->stop();
+	if(cache != NULL) cache->report(cout);
+
+	return 0;
+}
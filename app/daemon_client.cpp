@@ -0,0 +1,122 @@
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <iostream>
+
+#include "daemon_client.hpp"
+
+using namespace std;
+
+int daemon_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if(sock < 0) return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	if(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+		cout << "[client] Cannot connect to " << path << ": " << strerror(errno) << endl;
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+bool daemon_send(int sock, uint32_t id, const vector<vector<int> > &pictures, int first, int count)
+{
+	size_t len = (size_t)count * DAEMON_PICTURE_BYTES;
+	DaemonRequest request;
+	char control_buffer[CMSG_SPACE(sizeof(int))];
+	struct iovec iov;
+	struct msghdr msg;
+
+	if(count < 1 || count > DAEMON_MAX_PICTURES) return false;
+
+	/* Pictures go into a memfd that the daemon maps, only its fd travels over the socket */
+	int fd = memfd_create("cnn-pictures", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(fd < 0) return false;
+
+	uint8_t *pixels = NULL;
+	if(ftruncate(fd, len) == 0)
+	{
+		pixels = (uint8_t *)mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	if(pixels == NULL || pixels == MAP_FAILED)
+	{
+		close(fd);
+		return false;
+	}
+
+	for(int i = 0; i < count; i++)
+	{
+		const vector<int> &picture = pictures[first + i];
+		for(int j = 0; j < DAEMON_PICTURE_BYTES; j++) pixels[(size_t)i * DAEMON_PICTURE_BYTES + j] = picture[j];
+	}
+	munmap(pixels, len);
+
+	if(fcntl(fd, F_ADD_SEALS, DAEMON_PICTURE_SEALS) != 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	request.magic = DAEMON_MAGIC;
+	request.id = id;
+	request.count = count;
+
+	iov.iov_base = &request;
+	iov.iov_len = sizeof(request);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control_buffer;
+	msg.msg_controllen = sizeof(control_buffer);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	ssize_t n;
+	do
+	{
+		n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	} while(n < 0 && errno == EINTR);
+
+	// The daemon holds its own reference now
+	close(fd);
+	return n == (ssize_t)sizeof(request);
+}
+
+static bool read_all(int fd, void *data, size_t len)
+{
+	char *p = (char *)data;
+
+	while(len > 0)
+	{
+		ssize_t n = recv(fd, p, len, 0);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+bool daemon_receive(int sock, DaemonResponse &response, vector<DaemonResult> &results)
+{
+	if(!read_all(sock, &response, sizeof(response)) || response.magic != DAEMON_MAGIC) return false;
+
+	results.resize(response.count);
+	return response.count == 0 || read_all(sock, &results[0], response.count * sizeof(DaemonResult));
+}
@@ -0,0 +1,20 @@
+#ifndef DAEMON_CLIENT_HPP
+#define DAEMON_CLIENT_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include "daemon_protocol.hpp"
+
+/* Client side of the cnnd protocol, see daemon_protocol.hpp */
+
+// Returns the connected socket, or -1
+int daemon_connect(const char *path);
+
+// Sends pictures [first, first + count) as one request through a memfd
+bool daemon_send(int sock, uint32_t id, const std::vector<std::vector<int> > &pictures, int first, int count);
+
+// Waits for the next response, results has response.count entries
+bool daemon_receive(int sock, DaemonResponse &response, std::vector<DaemonResult> &results);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef DAEMON_PROTOCOL_HPP
+#define DAEMON_PROTOCOL_HPP
+
+#include <stdint.h>
+#include <fcntl.h>
+
+/*
+ * Protocol between cnnd and its clients over a UNIX stream socket.
+ *
+ * A request is one DaemonRequest message carrying a memfd (SCM_RIGHTS) that
+ * holds count pictures of DAEMON_PICTURE_BYTES bytes each, 0-255 values in
+ * the order of slike.txt. The daemon maps the memfd read-only, so pictures
+ * are never copied through the socket. The memfd must carry the seals of
+ * DAEMON_PICTURE_SEALS, so the client can neither shrink it under the
+ * daemon's mapping (SIGBUS) nor change the pictures while they are read.
+ * Every request is answered with one DaemonResponse followed by count
+ * DaemonResult records; responses may come back in a different order than
+ * the requests, they are matched by id.
+ */
+
+#define DAEMON_SOCKET_PATH		"/tmp/cnnd.sock"
+#define DAEMON_MAGIC			0x434e4e31	/* "CNN1" */
+#define DAEMON_PICTURE_BYTES		3072
+#define DAEMON_MAX_PICTURES		1024
+#define DAEMON_NUM_CLASSES		10
+
+#define DAEMON_PICTURE_SEALS		(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+#define DAEMON_STATUS_OK		0
+#define DAEMON_STATUS_BAD_REQUEST	1
+#define DAEMON_STATUS_FAILED		2
+
+struct DaemonRequest
+{
+	uint32_t magic;
+	uint32_t id;
+	uint32_t count;
+};
+
+struct DaemonResponse
+{
+	uint32_t magic;
+	uint32_t id;
+	uint32_t status;
+	uint32_t count;
+};
+
+struct DaemonResult
+{
+	int32_t prediction;
+	float scores[DAEMON_NUM_CLASSES];
+	// Time from arrival at the daemon to completion
+	uint32_t latency_us;
+};
+
+#endif
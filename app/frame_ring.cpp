@@ -0,0 +1,262 @@
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include "frame_ring.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring needs address-free 64-bit atomics");
+static_assert(sizeof(FrameSlot) % FRAME_RING_CACHE_LINE == 0, "slots must not share cache lines");
+
+/* The header takes whole cache lines, the slots follow */
+size_t FrameRing::ring_bytes(int slots)
+{
+	return sizeof(FrameRingHeader) + (size_t)slots * sizeof(FrameSlot);
+}
+
+FrameRing::FrameRing(int fd, void *base, size_t len, int slots)
+	: memfd(fd), base(base), len(len), num_slots(slots)
+{
+	header = (FrameRingHeader *)base;
+	slot = (FrameSlot *)((char *)base + sizeof(FrameRingHeader));
+}
+
+FrameRing::~FrameRing()
+{
+	munmap(base, len);
+	::close(memfd);
+}
+
+/* The sequence protocol needs a power of two, at least two so a full ring differs from an empty one */
+bool FrameRing::valid_slots(uint32_t slots)
+{
+	return slots >= 2 && slots <= FRAME_RING_MAX_SLOTS && (slots & (slots - 1)) == 0;
+}
+
+FrameRing *FrameRing::create(int slots)
+{
+	if(slots < 0 || !valid_slots(slots))
+	{
+		cout << "[app] Frame ring size must be a power of two from 2 to " << FRAME_RING_MAX_SLOTS << endl;
+		return NULL;
+	}
+
+	// Sealed once sized; F_SEAL_SEAL keeps anyone from adding F_SEAL_WRITE later
+	size_t len = ring_bytes(slots);
+	int fd = memfd_create("cnn-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(fd < 0 || ftruncate(fd, len) != 0 || fcntl(fd, F_ADD_SEALS, FRAME_RING_SEALS | F_SEAL_SEAL) != 0)
+	{
+		if(fd >= 0) ::close(fd);
+		return NULL;
+	}
+
+	void *base = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(base == MAP_FAILED)
+	{
+		::close(fd);
+		return NULL;
+	}
+
+	FrameRing *ring = new FrameRing(fd, base, len, slots);
+	FrameRingHeader *header = new(base) FrameRingHeader;
+
+	header->slots = slots;
+	header->closed = 0;
+	header->head = 0;
+	header->tail = 0;
+	header->dropped = 0;
+	for(int i = 0; i < slots; i++)
+	{
+		FrameSlot *s = new(&ring->slot[i]) FrameSlot;
+		s->sequence = i;
+	}
+
+	// Published last, attach() checks it
+	atomic_thread_fence(memory_order_release);
+	header->magic = FRAME_RING_MAGIC;
+
+	return ring;
+}
+
+FrameRing *FrameRing::attach(const char *path)
+{
+	struct stat st;
+	int fd = open(path, O_RDWR | O_CLOEXEC);
+
+	if(fd < 0)
+	{
+		cout << "[app] Cannot open frame ring " << path << endl;
+		return NULL;
+	}
+
+	// Without the seals the producer could shrink the file under our mapping; with them st_size stays true
+	int seals = fcntl(fd, F_GET_SEALS);
+	if(seals < 0 || (seals & FRAME_RING_SEALS) != FRAME_RING_SEALS)
+	{
+		cout << "[app] " << path << " is not a sealed frame ring" << endl;
+		::close(fd);
+		return NULL;
+	}
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FrameRingHeader))
+	{
+		::close(fd);
+		return NULL;
+	}
+
+	void *base = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(base == MAP_FAILED)
+	{
+		::close(fd);
+		return NULL;
+	}
+
+	FrameRingHeader *header = (FrameRingHeader *)base;
+	uint32_t slots = 0;
+
+	if(header->magic == FRAME_RING_MAGIC)
+	{
+		atomic_thread_fence(memory_order_acquire);
+		slots = header->slots;
+	}
+	// Anything that can open the file can write the header, so it is checked like create() checks its argument
+	if(!valid_slots(slots) || (size_t)st.st_size < ring_bytes(slots))
+	{
+		cout << "[app] " << path << " is not a frame ring" << endl;
+		munmap(base, st.st_size);
+		::close(fd);
+		return NULL;
+	}
+
+	return new FrameRing(fd, base, st.st_size, slots);
+}
+
+/*
+ * A slot whose sequence equals the position is free for that position; the
+ * producer that wins the head claims it, fills it and sets sequence to
+ * position + 1, which hands it to the consumer of that position. The
+ * consumer sets it to position + slots, the next lap's free value.
+ */
+bool FrameRing::try_push(const uint8_t *pixels, uint32_t frame_id, uint64_t capture_ns)
+{
+	uint64_t mask = num_slots - 1;
+	uint64_t pos = header->head.load(memory_order_relaxed);
+
+	while(true)
+	{
+		FrameSlot &s = slot[pos & mask];
+		int64_t diff = (int64_t)(s.sequence.load(memory_order_acquire) - pos);
+
+		if(diff == 0)
+		{
+			if(header->head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+		}
+		else if(diff < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = header->head.load(memory_order_relaxed);
+		}
+	}
+
+	FrameSlot &s = slot[pos & mask];
+	s.frame_id = frame_id;
+	s.capture_ns = capture_ns;
+	memcpy(s.pixels, pixels, FRAME_BYTES);
+	s.sequence.store(pos + 1, memory_order_release);
+
+	return true;
+}
+
+/* Removes the oldest frame, copying it out unless frame is NULL */
+bool FrameRing::take(Frame *frame)
+{
+	uint64_t mask = num_slots - 1;
+	uint64_t pos = header->tail.load(memory_order_relaxed);
+
+	while(true)
+	{
+		FrameSlot &s = slot[pos & mask];
+		int64_t diff = (int64_t)(s.sequence.load(memory_order_acquire) - (pos + 1));
+
+		if(diff == 0)
+		{
+			if(header->tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+		}
+		else if(diff < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = header->tail.load(memory_order_relaxed);
+		}
+	}
+
+	FrameSlot &s = slot[pos & mask];
+	if(frame != NULL)
+	{
+		frame->frame_id = s.frame_id;
+		frame->capture_ns = s.capture_ns;
+		memcpy(frame->pixels, s.pixels, FRAME_BYTES);
+	}
+	s.sequence.store(pos + num_slots, memory_order_release);
+
+	return true;
+}
+
+bool FrameRing::push(const uint8_t *pixels, uint32_t frame_id, FrameRingPolicy policy, uint64_t capture_ns)
+{
+	if(capture_ns == 0) capture_ns = trace_now_ns();
+
+	while(!is_closed())
+	{
+		if(try_push(pixels, frame_id, capture_ns)) return true;
+
+		switch(policy)
+		{
+		case FRAME_RING_DROP_NEWEST:
+			header->dropped++;
+			return false;
+
+		case FRAME_RING_DROP_OLDEST:
+			// The producer takes the oldest frame out itself; if a consumer got it first, there is room anyway
+			if(take(NULL)) header->dropped++;
+			break;
+
+		case FRAME_RING_BLOCK:
+			this_thread::yield();
+			break;
+		}
+	}
+	return false;
+}
+
+bool FrameRing::pop(Frame &frame)
+{
+	if(!take(&frame)) return false;
+
+	frame.dequeue_ns = trace_now_ns();
+	return true;
+}
+
+void FrameRing::close()
+{
+	header->closed = 1;
+}
+
+uint64_t FrameRing::queued() const
+{
+	uint64_t head = header->head.load(memory_order_relaxed);
+	uint64_t tail = header->tail.load(memory_order_relaxed);
+
+	return head > tail ? head - tail : 0;
+}
@@ -0,0 +1,109 @@
+#ifndef FRAME_RING_HPP
+#define FRAME_RING_HPP
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <atomic>
+
+/*
+ * Lock-free ring of 32x32x3 frames in a memfd, shared between a capture
+ * process and the classifier. Any number of producers and consumers may use
+ * it (each slot carries a sequence number that tells whose turn it is), the
+ * usual case is one camera and one classifier.
+ *
+ * Frames carry the time they were captured (CLOCK_MONOTONIC, the clock of
+ * trace_now_ns()), which is the same in every process, so the consumer can
+ * measure the latency from capture to result.
+ *
+ * The consumer opens the ring through /proc/<pid>/fd/<fd> of the producer or
+ * an fd it received over a socket. The memfd carries FRAME_RING_SEALS, so
+ * neither side can shrink it under the other's mapping (SIGBUS); attach()
+ * refuses a file without them.
+ */
+
+#define FRAME_RING_MAGIC		0x46524d31	/* "FRM1" */
+#define FRAME_RING_MAX_SLOTS		(1 << 16)
+#define FRAME_BYTES			3072
+#define FRAME_RING_CACHE_LINE		64
+
+#define FRAME_RING_SEALS		(F_SEAL_SHRINK | F_SEAL_GROW)
+
+// What push() does when the ring is full
+enum FrameRingPolicy
+{
+	FRAME_RING_BLOCK,		// wait for the consumer
+	FRAME_RING_DROP_NEWEST,		// drop the frame being pushed
+	FRAME_RING_DROP_OLDEST		// drop the oldest queued frame to make room
+};
+
+struct alignas(FRAME_RING_CACHE_LINE) FrameSlot
+{
+	std::atomic<uint64_t> sequence;
+	uint64_t capture_ns;
+	uint32_t frame_id;
+	uint8_t pixels[FRAME_BYTES];
+};
+
+struct FrameRingHeader
+{
+	uint32_t magic;
+	uint32_t slots;
+	std::atomic<uint32_t> closed;
+
+	// Producers and consumers each get their own cache line
+	alignas(FRAME_RING_CACHE_LINE) std::atomic<uint64_t> head;
+	alignas(FRAME_RING_CACHE_LINE) std::atomic<uint64_t> tail;
+	alignas(FRAME_RING_CACHE_LINE) std::atomic<uint64_t> dropped;
+};
+
+struct Frame
+{
+	uint32_t frame_id;
+	uint64_t capture_ns;
+	// When pop() took it out of the ring
+	uint64_t dequeue_ns;
+	uint8_t pixels[FRAME_BYTES];
+};
+
+class FrameRing
+{
+public:
+	// New ring of slots frames (a power of two) in a fresh memfd
+	static FrameRing *create(int slots);
+	// Ring created by another process
+	static FrameRing *attach(const char *path);
+	~FrameRing();
+
+	int fd() const { return memfd; }
+	int slots() const { return num_slots; }
+
+	// capture_ns 0 means now; false if the frame was dropped or the ring closed
+	bool push(const uint8_t *pixels, uint32_t frame_id, FrameRingPolicy policy, uint64_t capture_ns = 0);
+	// false if the ring is empty
+	bool pop(Frame &frame);
+
+	// Producer side: no more frames will come
+	void close();
+	bool is_closed() const { return header->closed != 0; }
+
+	uint64_t dropped() const { return header->dropped; }
+	uint64_t queued() const;
+
+private:
+	FrameRing(int fd, void *base, size_t len, int slots);
+	static bool valid_slots(uint32_t slots);
+	static size_t ring_bytes(int slots);
+
+	bool try_push(const uint8_t *pixels, uint32_t frame_id, uint64_t capture_ns);
+	bool take(Frame *frame);
+
+	int memfd;
+	void *base;
+	size_t len;
+	FrameRingHeader *header;
+	FrameSlot *slot;
+	// Read from the header once, the other process could change it afterwards
+	int num_slots;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <math.h>
+#include <iostream>
+
+#include "host_layers.hpp"
+#include "classifier.hpp"
+
+using namespace std;
+
+/* ------------------------ */
+/* ------Quantization------ */
+/* ------------------------ */
+
+void quantize_pixels(const int *pixels, int len, uint16_t *fixed)
+{
+	for(int i = 0; i < len; i++) fixed[i] = castFloatToBin((float)pixels[i]/255.0);
+}
+
+void quantize_floats(const float *values, int len, uint16_t *fixed)
+{
+	for(int i = 0; i < len; i++) fixed[i] = castFloatToBin(values[i]);
+}
+
+/* ------------------------ */
+/* -------Formatting------- */
+/* ------------------------ */
+
+/* Word of the padded picture at (channel, row, column), the border is zero */
+static inline uint16_t padded_word(const uint16_t *picture, int img_size, int channel, int row, int column)
+{
+	if(row == 0 || column == 0 || row > img_size || column > img_size) return 0;
+
+	return picture[channel * img_size * img_size + (row - 1) * img_size + column - 1];
+}
+
+/*
+ * Same order as format_image(): the first three rows column by column with
+ * every channel's three words together, then the remaining rows pixel by
+ * pixel with the channels innermost.
+ */
+void format_padded(const uint16_t *picture, int img_size, int num_of_channels, uint16_t *formatted)
+{
+	int padded_size = img_size + 2;
+
+	for(int column = 0; column < padded_size; column++)
+	{
+		for(int channel = 0; channel < num_of_channels; channel++)
+		{
+			for(int row = 0; row < 3; row++) *formatted++ = padded_word(picture, img_size, channel, row, column);
+		}
+	}
+
+	for(int row = 3; row < padded_size; row++)
+	{
+		for(int column = 0; column < padded_size; column++)
+		{
+			for(int channel = 0; channel < num_of_channels; channel++) *formatted++ = padded_word(picture, img_size, channel, row, column);
+		}
+	}
+}
+
+/* ------------------------ */
+/* --------Maxpool--------- */
+/* ------------------------ */
+
+static inline float max4(const float *plane, int img_size, int row, int column)
+{
+	const float *p = plane + 2 * row * img_size + 2 * column;
+	float m = p[0];
+
+	if(p[img_size] > m) m = p[img_size];
+	if(p[1] > m) m = p[1];
+	if(p[img_size + 1] > m) m = p[img_size + 1];
+	return m;
+}
+
+void maxpool_planes(const float *image, int img_size, int num_of_channels, float *pooled)
+{
+	int half = img_size / 2;
+
+	for(int channel = 0; channel < num_of_channels; channel++)
+	{
+		const float *plane = image + channel * img_size * img_size;
+
+		for(int row = 0; row < half; row++)
+		{
+			for(int column = 0; column < half; column++) *pooled++ = max4(plane, img_size, row, column);
+		}
+	}
+}
+
+void maxpool_flatten(const float *image, int img_size, int num_of_channels, float *flat)
+{
+	int half = img_size / 2;
+
+	for(int row = 0; row < half; row++)
+	{
+		for(int column = 0; column < half; column++)
+		{
+			for(int channel = 0; channel < num_of_channels; channel++)
+			{
+				*flat++ = max4(image + channel * img_size * img_size, img_size, row, column);
+			}
+		}
+	}
+}
+
+/* ------------------------ */
+/* ------Dense layers------ */
+/* ------------------------ */
+
+HostDense::HostDense(int inputs, int outputs, HostActivation activation)
+	: num_inputs(inputs), num_outputs(outputs), activation(activation),
+	  weights((size_t)inputs * outputs), bias(outputs)
+{
+}
+
+bool HostDense::load(const char *weights_path, const char *bias_path)
+{
+	FILE *input;
+	float temp;
+
+	input = fopen(weights_path, "r");
+	if(input == NULL)
+	{
+		cout << "[app] Cannot open " << weights_path << endl;
+		return false;
+	}
+	for(int i = 0; i < num_inputs; i++)
+	{
+		for(int o = 0; o < num_outputs; o++)
+		{
+			if(fscanf(input, "%f", &temp) != 1)
+			{
+				fclose(input);
+				return false;
+			}
+			weights[(size_t)o * num_inputs + i] = temp;
+		}
+	}
+	fclose(input);
+
+	input = fopen(bias_path, "r");
+	if(input == NULL)
+	{
+		cout << "[app] Cannot open " << bias_path << endl;
+		return false;
+	}
+	for(int o = 0; o < num_outputs; o++)
+	{
+		if(fscanf(input, "%f", &bias[o]) != 1)
+		{
+			fclose(input);
+			return false;
+		}
+	}
+	fclose(input);
+
+	return true;
+}
+
+void HostDense::forward(const float *input, float *output) const
+{
+	for(int o = 0; o < num_outputs; o++)
+	{
+		const float *w = &weights[(size_t)o * num_inputs];
+		float sum = bias[o];
+
+		for(int i = 0; i < num_inputs; i++) sum += input[i] * w[i];
+		output[o] = sum;
+	}
+
+	if(activation == HOST_RELU)
+	{
+		for(int o = 0; o < num_outputs; o++) if(output[o] < 0) output[o] = 0;
+		return;
+	}
+
+	float max_output = output[0];
+	float total = 0;
+
+	for(int o = 1; o < num_outputs; o++) if(output[o] > max_output) max_output = output[o];
+	for(int o = 0; o < num_outputs; o++)
+	{
+		output[o] = expf(output[o] - max_output);
+		total += output[o];
+	}
+	for(int o = 0; o < num_outputs; o++) output[o] /= total;
+}
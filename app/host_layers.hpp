@@ -0,0 +1,59 @@
+#ifndef HOST_LAYERS_HPP
+#define HOST_LAYERS_HPP
+
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Host side stages of the flow on flat buffers, for the arena path of
+ * classify_batch() (HostDense serves the vector path too). They compute the same thing as the vector based stages
+ * (pad_img + format_image, transform_1D_to_4D + MaxPoolLayer + flatten,
+ * DenseLayer) without any intermediate containers, so the caller decides
+ * where every buffer lives.
+ */
+
+/* Q3.12 of 0-255 pixels scaled to [0, 1] */
+void quantize_pixels(const int *pixels, int len, uint16_t *fixed);
+void quantize_floats(const float *values, int len, uint16_t *fixed);
+
+/* format_image(pad_img(picture)) in one pass; picture is img_size x img_size per channel, formatted gets (img_size+2)^2 * channels words */
+void format_padded(const uint16_t *picture, int img_size, int num_of_channels, uint16_t *formatted);
+
+/* 2x2 maxpool of a READ_CONVn_OUTPUT image (one plane per channel), the result is again one plane per channel */
+void maxpool_planes(const float *image, int img_size, int num_of_channels, float *pooled);
+
+/* 2x2 maxpool followed by flatten(), the result is [row][column][channel] */
+void maxpool_flatten(const float *image, int img_size, int num_of_channels, float *flat);
+
+enum HostActivation
+{
+	HOST_RELU,
+	HOST_SOFTMAX
+};
+
+/*
+ * Fully connected layer with its weights stored one output after another,
+ * so every output is a dot product over contiguous memory. The weight files
+ * are read as [input][output] (the Keras kernel layout the dense1/dense2
+ * files are exported in); load_model() checks that against DenseLayer.
+ */
+class HostDense
+{
+public:
+	HostDense(int inputs, int outputs, HostActivation activation);
+
+	bool load(const char *weights_path, const char *bias_path);
+	void forward(const float *input, float *output) const;
+
+	int inputs() const { return num_inputs; }
+	int outputs() const { return num_outputs; }
+
+private:
+	int num_inputs;
+	int num_outputs;
+	HostActivation activation;
+	std::vector<float> weights;
+	std::vector<float> bias;
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include <iostream>
+#include <chrono>
+
+#include "inference.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+InferenceEngine::InferenceEngine(int max_batch, int max_wait_us)
+	: running(false), stopping(false), cache(NULL)
+{
+	set_batching(max_batch, max_wait_us);
+}
+
+InferenceEngine::~InferenceEngine()
+{
+	stop();
+
+	for(size_t i = 0; i < engines.size(); i++)
+	{
+		destroy_network(engines[i]->net);
+		delete engines[i];
+	}
+}
+
+void InferenceEngine::add_engine(Accelerator *acc)
+{
+	Engine *engine = new Engine;
+
+	engine->acc = acc;
+	engine->net = create_network();
+	engine->net->cache = cache;
+	engines.push_back(engine);
+}
+
+void InferenceEngine::set_cache(ResultCache *cache)
+{
+	this->cache = cache;
+	for(size_t i = 0; i < engines.size(); i++) engines[i]->net->cache = cache;
+}
+
+void InferenceEngine::enable_arena()
+{
+	for(size_t i = 0; i < engines.size(); i++) ::enable_arena(engines[i]->net);
+}
+
+bool InferenceEngine::start()
+{
+	if(running || engines.empty()) return false;
+
+	stopping = false;
+	running = true;
+	for(size_t i = 0; i < engines.size(); i++)
+	{
+		engines[i]->thread = thread(&InferenceEngine::worker, this, ref(*engines[i]));
+	}
+	return true;
+}
+
+void InferenceEngine::stop()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		if(!running) return;
+		stopping = true;
+	}
+	ready.notify_all();
+
+	for(size_t i = 0; i < engines.size(); i++) engines[i]->thread.join();
+
+	lock_guard<mutex> guard(lock);
+	running = false;
+}
+
+void InferenceEngine::set_batching(int max_batch, int max_wait_us)
+{
+	lock_guard<mutex> guard(lock);
+
+	this->max_batch = max_batch < 1 ? 1 : max_batch;
+	this->max_wait_us = max_wait_us < 0 ? 0 : max_wait_us;
+}
+
+int InferenceEngine::pending()
+{
+	lock_guard<mutex> guard(lock);
+	return queue.size();
+}
+
+future<InferenceResult> InferenceEngine::submit(const vector<int> &picture)
+{
+	Request *request = new Request;
+	future<InferenceResult> result = request->promise.get_future();
+
+	request->picture = picture;
+	enqueue(request);
+	return result;
+}
+
+void InferenceEngine::submit(const vector<int> &picture, InferenceCallback callback)
+{
+	Request *request = new Request;
+
+	request->picture = picture;
+	request->callback = callback;
+	enqueue(request);
+}
+
+/* Requests that arrive while the engine is stopped fail right away */
+void InferenceEngine::enqueue(Request *request)
+{
+	request->submit_ns = trace_now_ns();
+
+	{
+		lock_guard<mutex> guard(lock);
+		if(running && !stopping)
+		{
+			queue.push_back(request);
+			request = NULL;
+		}
+	}
+
+	if(request != NULL)
+	{
+		InferenceResult result;
+		result.ok = false;
+		result.prediction = -1;
+		complete(request, result);
+		return;
+	}
+	// An engine holding a partial batch has to see the new request as well
+	ready.notify_all();
+}
+
+void InferenceEngine::complete(Request *request, InferenceResult &result)
+{
+	result.latency_ns = trace_now_ns() - request->submit_ns;
+
+	if(request->callback)
+	{
+		request->callback(result);
+	}
+	else
+	{
+		request->promise.set_value(result);
+	}
+	delete request;
+}
+
+void InferenceEngine::worker(Engine &engine)
+{
+	vector<Request *> batch;
+	vector<const vector<int> *> pictures;
+	vector<vector1D> scores;
+
+	while(true)
+	{
+		{
+			unique_lock<mutex> guard(lock);
+			while(queue.empty() && !stopping) ready.wait(guard);
+			if(queue.empty()) return;
+
+			// Hold a partial batch until it is full or the oldest request is due
+			while(max_wait_us > 0 && !stopping && !queue.empty() && (int)queue.size() < max_batch)
+			{
+				uint64_t deadline = queue.front()->submit_ns + max_wait_us * 1000ull;
+				uint64_t now = trace_now_ns();
+				if(now >= deadline) break;
+
+				ready.wait_for(guard, chrono::nanoseconds(deadline - now));
+			}
+			if(queue.empty()) continue;
+
+			batch.clear();
+			while(!queue.empty() && (int)batch.size() < max_batch)
+			{
+				batch.push_back(queue.front());
+				queue.pop_front();
+			}
+		}
+
+		pictures.clear();
+		for(size_t i = 0; i < batch.size(); i++) pictures.push_back(&batch[i]->picture);
+
+		bool ok = classify_batch(*engine.acc, *engine.net, pictures, scores);
+		if(!ok)
+		{
+			cout << "[app] Classification on " << engine.acc->name() << " failed" << endl;
+		}
+
+		for(size_t i = 0; i < batch.size(); i++)
+		{
+			InferenceResult result;
+
+			result.ok = ok;
+			result.prediction = ok ? max_score_index(scores[i]) : -1;
+			if(ok) result.scores = scores[i];
+			complete(batch[i], result);
+		}
+	}
+}
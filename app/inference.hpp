@@ -0,0 +1,95 @@
+#ifndef INFERENCE_HPP
+#define INFERENCE_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+
+#include "classifier.hpp"
+
+struct InferenceResult
+{
+	bool ok;
+	int prediction;
+	vector1D scores;
+	// From submit() to completion, queueing included
+	uint64_t latency_ns;
+};
+
+typedef std::function<void(const InferenceResult &result)> InferenceCallback;
+
+/*
+ * Asynchronous front end of the classification flow. Requests go into one
+ * queue; every engine (an accelerator with its own host layers and thread)
+ * takes up to max_batch queued pictures and runs them layer-major. With a
+ * max_wait_us, an engine holds a partial batch until it fills up or its
+ * oldest request has waited that long. Engines sharing an accelerator
+ * overlap their host stages with each other's IP layers.
+ *
+ * Callbacks run on the engine threads and should return quickly.
+ */
+class InferenceEngine
+{
+public:
+	InferenceEngine(int max_batch = 1, int max_wait_us = 0);
+	// Finishes the queued requests first
+	~InferenceEngine();
+
+	// Before start(); the accelerator must have its bias loaded and outlive the engine
+	void add_engine(Accelerator *acc);
+	// Before start(); result cache shared by all engines, NULL to disable
+	void set_cache(ResultCache *cache);
+	// After add_engine(), before start(); every engine's intermediates go to its own arena
+	void enable_arena();
+	bool start();
+	// Stops taking requests, waits for the queued ones and joins the engines
+	void stop();
+
+	std::future<InferenceResult> submit(const std::vector<int> &picture);
+	void submit(const std::vector<int> &picture, InferenceCallback callback);
+
+	// Can be changed while running, applies to the next batch
+	void set_batching(int max_batch, int max_wait_us);
+
+	// Requests queued but not yet taken by an engine
+	int pending();
+
+private:
+	struct Request
+	{
+		std::vector<int> picture;
+		std::promise<InferenceResult> promise;
+		InferenceCallback callback;
+		uint64_t submit_ns;
+	};
+
+	struct Engine
+	{
+		Accelerator *acc;
+		Network *net;
+		std::thread thread;
+	};
+
+	void enqueue(Request *request);
+	void worker(Engine &engine);
+	void complete(Request *request, InferenceResult &result);
+
+	int max_batch;
+	int max_wait_us;
+	bool running;
+	bool stopping;
+
+	std::vector<Engine *> engines;
+	ResultCache *cache;
+
+	std::mutex lock;
+	std::condition_variable ready;
+	std::deque<Request *> queue;
+};
+
+#endif
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "classifier.hpp"
+#include "trace.hpp"
+#include "cpu_conv.hpp"
+#include "model.hpp"
+
+using namespace std;
+using namespace chrono;
+
+/*
+ * Microbenchmarks of the host side kernels, one per kernel and layer
+ * geometry. Written in the Google Benchmark style (a registered function
+ * loops while state.keep_running()) without the dependency. Inputs are fixed
+ * pseudo-random data, so numbers are comparable between runs and commits.
+ */
+
+/* ------------------------ */
+/* ---------Harness-------- */
+/* ------------------------ */
+
+/* Only the loop is timed: the clock starts at the first keep_running() and stops at the last */
+class BenchState
+{
+public:
+	BenchState(uint64_t iterations) : iterations(iterations), done(0), bytes(0) {}
+
+	bool keep_running()
+	{
+		if(done == 0) start = steady_clock::now();
+		if(done++ < iterations) return true;
+
+		stop = steady_clock::now();
+		return false;
+	}
+	void set_bytes_processed(uint64_t b) { bytes = b; }
+
+	uint64_t iterations;
+	uint64_t done;
+	uint64_t bytes;
+	steady_clock::time_point start;
+	steady_clock::time_point stop;
+};
+
+typedef void (*BenchFunction)(BenchState &state);
+
+struct BenchEntry
+{
+	const char *name;
+	BenchFunction function;
+};
+
+static vector<BenchEntry> &registry()
+{
+	static vector<BenchEntry> entries;
+	return entries;
+}
+
+struct BenchRegistrar
+{
+	BenchRegistrar(const char *name, BenchFunction function)
+	{
+		BenchEntry entry = { name, function };
+		registry().push_back(entry);
+	}
+};
+
+#define MICROBENCH(name) \
+	static void name(BenchState &state); \
+	static BenchRegistrar name##_registrar(#name, name); \
+	static void name(BenchState &state)
+
+/* Keeps the compiler from dropping a result that is never used */
+template <class T> static inline void do_not_optimize(T &value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static void reset_inputs();
+
+/* Every run starts from the same seed, so it sees the same inputs however many runs calibration took */
+static double run_once(const BenchEntry &entry, uint64_t iterations, uint64_t &bytes)
+{
+	BenchState state(iterations);
+
+	reset_inputs();
+	entry.function(state);
+
+	bytes = state.bytes;
+	return duration_cast<nanoseconds>(state.stop - state.start).count();
+}
+
+/* Grows the iteration count until one run takes at least min_time seconds */
+static void run_benchmark(const BenchEntry &entry, double min_time)
+{
+	uint64_t iterations = 1;
+	uint64_t bytes = 0;
+	double ns = run_once(entry, iterations, bytes);
+
+	while(ns < min_time * 1e9 && iterations < (1ULL << 30))
+	{
+		double scale = ns > 0 ? min_time * 1e9 / ns * 1.4 : 10;
+		if(scale > 10) scale = 10;
+		if(scale < 2) scale = 2;
+		iterations = (uint64_t)(iterations * scale);
+		ns = run_once(entry, iterations, bytes);
+	}
+
+	printf("%-36s %12.0f ns %12llu", entry.name, ns / iterations, (unsigned long long)iterations);
+	if(bytes) printf(" %10.1f MB/s", bytes * iterations / (ns / 1e9) / 1e6);
+	printf("\n");
+}
+
+/* ------------------------ */
+/* ---------Inputs--------- */
+/* ------------------------ */
+
+#define INPUT_SEED	12345
+
+static uint32_t seed = INPUT_SEED;
+
+static void reset_inputs()
+{
+	seed = INPUT_SEED;
+}
+
+static uint32_t next_random()
+{
+	seed = seed * 1664525 + 1013904223;
+	return seed >> 8;
+}
+
+static vector<int> random_fixed_point(int len)
+{
+	vector<int> v(len);
+	for(int i = 0; i < len; i++) v[i] = next_random() & 0xffff;
+	return v;
+}
+
+static vector1D random_floats(int len)
+{
+	vector1D v(len);
+	for(int i = 0; i < len; i++) v[i] = (next_random() % 8192) / 1024.0f - 4.0f;
+	return v;
+}
+
+static vector4D random_4D(int img_size, int num_of_channels)
+{
+	vector4D v;
+	transform_1D_to_4D(random_floats(img_size*img_size*num_of_channels), v, img_size, num_of_channels);
+	return v;
+}
+
+static Network *network()
+{
+	static Network *net = create_network();
+	return net;
+}
+
+static const Model *model()
+{
+	static ModelRef model = load_model();
+	return model.get();
+}
+
+/* ------------------------ */
+/* -----Fixed point casts--- */
+/* ------------------------ */
+
+MICROBENCH(castFloatToBin_32768)
+{
+	vector1D in = random_floats(CONV0_OUTPUT_LEN);
+	uint16_t sum = 0;
+
+	state.set_bytes_processed(in.size() * sizeof(float));
+	while(state.keep_running())
+	{
+		for(size_t i = 0; i < in.size(); i++) sum += castFloatToBin(in[i]);
+		do_not_optimize(sum);
+	}
+}
+
+MICROBENCH(castBinToFloat_32768)
+{
+	vector<int> in = random_fixed_point(CONV0_OUTPUT_LEN);
+	float sum = 0;
+
+	state.set_bytes_processed(in.size() * sizeof(uint16_t));
+	while(state.keep_running())
+	{
+		for(size_t i = 0; i < in.size(); i++) sum += castBinToFloat(in[i]);
+		do_not_optimize(sum);
+	}
+}
+
+/* ------------------------ */
+/* ---Padding and format--- */
+/* ------------------------ */
+
+static void bench_pad_img(BenchState &state, int img_size, int num_of_channels)
+{
+	vector<int> in = random_fixed_point(img_size*img_size*num_of_channels);
+
+	state.set_bytes_processed(in.size() * sizeof(int));
+	while(state.keep_running())
+	{
+		vector<int> out = pad_img(in, img_size, num_of_channels);
+		do_not_optimize(out[0]);
+	}
+}
+
+MICROBENCH(pad_img_conv0_32x32x3)	{ bench_pad_img(state, CONV1_PICTURE_SIZE, CONV1_NUM_CHANNELS); }
+MICROBENCH(pad_img_conv1_16x16x32)	{ bench_pad_img(state, CONV2_PICTURE_SIZE, CONV2_NUM_CHANNELS); }
+MICROBENCH(pad_img_conv2_8x8x32)	{ bench_pad_img(state, CONV3_PICTURE_SIZE, CONV3_NUM_CHANNELS); }
+
+static void bench_format_image(BenchState &state, int padded_size, int num_of_channels)
+{
+	vector<int> in = random_fixed_point(padded_size*padded_size*num_of_channels);
+
+	state.set_bytes_processed(in.size() * sizeof(int));
+	while(state.keep_running())
+	{
+		vector<int> out = format_image(in, padded_size, num_of_channels);
+		do_not_optimize(out[0]);
+	}
+}
+
+MICROBENCH(format_image_conv0_34x34x3)	{ bench_format_image(state, CONV1_PADDED_PICTURE_SIZE, CONV1_NUM_CHANNELS); }
+MICROBENCH(format_image_conv1_18x18x32)	{ bench_format_image(state, CONV2_PADDED_PICTURE_SIZE, CONV2_NUM_CHANNELS); }
+MICROBENCH(format_image_conv2_10x10x32)	{ bench_format_image(state, CONV3_PADDED_PICTURE_SIZE, CONV3_NUM_CHANNELS); }
+
+/* ------------------------ */
+/* ----Layout transforms---- */
+/* ------------------------ */
+
+static void bench_transform_1D_to_4D(BenchState &state, int img_size, int num_of_channels)
+{
+	vector1D in = random_floats(img_size*img_size*num_of_channels);
+	vector4D out;
+
+	state.set_bytes_processed(in.size() * sizeof(float));
+	while(state.keep_running())
+	{
+		transform_1D_to_4D(in, out, img_size, num_of_channels);
+		do_not_optimize(out[0][0][0][0]);
+	}
+}
+
+MICROBENCH(transform_1D_to_4D_32x32x32)	{ bench_transform_1D_to_4D(state, CONV1_PICTURE_SIZE, CONV1_NUM_FILTERS); }
+MICROBENCH(transform_1D_to_4D_16x16x32)	{ bench_transform_1D_to_4D(state, CONV2_PICTURE_SIZE, CONV2_NUM_FILTERS); }
+MICROBENCH(transform_1D_to_4D_8x8x64)	{ bench_transform_1D_to_4D(state, CONV3_PICTURE_SIZE, CONV3_NUM_FILTERS); }
+
+static void bench_transform_4D_to_1D(BenchState &state, int img_size, int num_of_channels)
+{
+	vector4D in = random_4D(img_size, num_of_channels);
+	vector1D out;
+
+	state.set_bytes_processed(img_size*img_size*num_of_channels * sizeof(float));
+	while(state.keep_running())
+	{
+		transform_4D_to_1D(in, out, img_size, num_of_channels);
+		do_not_optimize(out[0]);
+	}
+}
+
+MICROBENCH(transform_4D_to_1D_16x16x32)	{ bench_transform_4D_to_1D(state, CONV1_PICTURE_SIZE/2, CONV1_NUM_FILTERS); }
+MICROBENCH(transform_4D_to_1D_8x8x32)	{ bench_transform_4D_to_1D(state, CONV2_PICTURE_SIZE/2, CONV2_NUM_FILTERS); }
+
+MICROBENCH(flatten_4x4x64)
+{
+	vector4D in = random_4D(CONV3_PICTURE_SIZE/2, CONV3_NUM_FILTERS);
+	vector2D out;
+
+	state.set_bytes_processed(in[0].size() * in[0].size() * CONV3_NUM_FILTERS * sizeof(float));
+	while(state.keep_running())
+	{
+		flatten(in, out, CONV3_PICTURE_SIZE/2, CONV3_NUM_FILTERS);
+		do_not_optimize(out[0][0]);
+	}
+}
+
+/* ------------------------ */
+/* -----Output unpacking---- */
+/* ------------------------ */
+
+static void bench_unpack_output(BenchState &state, int len)
+{
+	vector<int> in = random_fixed_point(len);
+	vector1D out(len);
+
+	state.set_bytes_processed(len * sizeof(uint16_t));
+	while(state.keep_running())
+	{
+		unpack_output(&in[0], &out[0], len);
+		do_not_optimize(out[0]);
+	}
+}
+
+MICROBENCH(unpack_output_conv0_32768)	{ bench_unpack_output(state, CONV0_OUTPUT_LEN); }
+MICROBENCH(unpack_output_conv1_8192)	{ bench_unpack_output(state, CONV1_OUTPUT_LEN); }
+MICROBENCH(unpack_output_conv2_4096)	{ bench_unpack_output(state, CONV2_OUTPUT_LEN); }
+
+/* ------------------------ */
+/* ---CPU reference conv--- */
+/* ------------------------ */
+
+static void bench_cpu_conv(BenchState &state, int padded_size, int num_of_channels, int num_of_filters)
+{
+	vector<int> random_input = random_fixed_point(padded_size*padded_size*num_of_channels);
+	vector<int> random_weights = random_fixed_point(9*num_of_channels*num_of_filters);
+	vector<int> random_bias = random_fixed_point(num_of_filters);
+	vector<uint16_t> in(random_input.begin(), random_input.end());
+	vector<int16_t> weights(random_weights.begin(), random_weights.end());
+	vector<int16_t> bias(random_bias.begin(), random_bias.end());
+	vector<int16_t> picture(in.size());
+	vector<uint16_t> out((padded_size-2)*(padded_size-2)*num_of_filters);
+
+	state.set_bytes_processed(in.size() * sizeof(uint16_t));
+	while(state.keep_running())
+	{
+		cpu_conv_unformat(&in[0], padded_size, num_of_channels, &picture[0]);
+		cpu_conv(&picture[0], padded_size, num_of_channels, &weights[0], &bias[0], num_of_filters, &out[0]);
+		do_not_optimize(out[0]);
+	}
+}
+
+MICROBENCH(cpu_conv0_34x34x3_32)	{ bench_cpu_conv(state, CONV1_PADDED_PICTURE_SIZE, CONV1_NUM_CHANNELS, CONV1_NUM_FILTERS); }
+MICROBENCH(cpu_conv1_18x18x32_32)	{ bench_cpu_conv(state, CONV2_PADDED_PICTURE_SIZE, CONV2_NUM_CHANNELS, CONV2_NUM_FILTERS); }
+MICROBENCH(cpu_conv2_10x10x32_64)	{ bench_cpu_conv(state, CONV3_PADDED_PICTURE_SIZE, CONV3_NUM_CHANNELS, CONV3_NUM_FILTERS); }
+
+/* ------------------------ */
+/* ------Host layers------- */
+/* ------------------------ */
+
+static void bench_maxpool(BenchState &state, int layer, int img_size, int num_of_channels)
+{
+	vector4D in = random_4D(img_size, num_of_channels);
+
+	state.set_bytes_processed(img_size*img_size*num_of_channels * sizeof(float));
+	while(state.keep_running())
+	{
+		vector4D out = network()->maxpool[layer]->forward_prop(in, {});
+		do_not_optimize(out[0][0][0][0]);
+	}
+}
+
+MICROBENCH(MaxPoolLayer_forward_32x32x32)	{ bench_maxpool(state, 0, CONV1_PICTURE_SIZE, CONV1_NUM_FILTERS); }
+MICROBENCH(MaxPoolLayer_forward_16x16x32)	{ bench_maxpool(state, 1, CONV2_PICTURE_SIZE, CONV2_NUM_FILTERS); }
+MICROBENCH(MaxPoolLayer_forward_8x8x64)		{ bench_maxpool(state, 2, CONV3_PICTURE_SIZE, CONV3_NUM_FILTERS); }
+
+/* The dense stage of both flows */
+static void bench_dense(BenchState &state, int layer, int inputs)
+{
+	const HostDense &dense = *model()->host_dense[layer];
+	vector1D in = random_floats(inputs), out(dense.outputs());
+
+	state.set_bytes_processed(inputs * sizeof(float));
+	while(state.keep_running())
+	{
+		dense.forward(&in[0], &out[0]);
+		do_not_optimize(out[0]);
+	}
+}
+
+MICROBENCH(HostDense_forward_1024x512)	{ bench_dense(state, 0, 1024); }
+MICROBENCH(HostDense_forward_512x10)	{ bench_dense(state, 1, 512); }
+
+/* ------------------------ */
+/* -----------Main--------- */
+/* ------------------------ */
+
+int main(int argc, char *argv[])
+{
+	double min_time = 0.5;
+	const char *filter = NULL;
+	int opt;
+
+	while((opt = getopt(argc, argv, "t:f:l")) != -1)
+	{
+		switch(opt)
+		{
+		case 't':
+			min_time = atof(optarg);
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 'l':
+			for(size_t i = 0; i < registry().size(); i++) cout << registry()[i].name << endl;
+			return 0;
+		default:
+			cout << "Usage: " << argv[0] << " [-t min_seconds] [-f name_filter] [-l]" << endl;
+			return -1;
+		}
+	}
+
+	trace_enable(false);
+
+	// Load the dense weights before anything is timed
+	network();
+	if(model() == NULL) return -1;
+
+	printf("%-36s %15s %12s %13s\n", "benchmark", "time/iter", "iterations", "throughput");
+	for(size_t i = 0; i < registry().size(); i++)
+	{
+		if(filter != NULL && strstr(registry()[i].name, filter) == NULL) continue;
+		run_benchmark(registry()[i], min_time);
+	}
+
+	return 0;
+}
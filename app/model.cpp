@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <string>
+#include <atomic>
+
+#include "model.hpp"
+
+using namespace std;
+
+static atomic<uint32_t> next_version(1);
+
+// Read with atomic_load/atomic_store only
+static ModelRef current;
+
+Model::Model()
+	: version(0)
+{
+	for(int i = 0; i < 2; i++) host_dense[i] = NULL;
+}
+
+Model::~Model()
+{
+	for(int i = 0; i < 2; i++) delete host_dense[i];
+}
+
+/* Reads len float values from input and converts them to Q3.12 */
+static bool read_fixed(FILE *input, uint16_t *values, int len)
+{
+	float temp;
+
+	for(int i = 0; i < len; i++)
+	{
+		if(fscanf(input, "%f", &temp) != 1) return false;
+		values[i] = castFloatToBin(temp);
+	}
+	return true;
+}
+
+/*
+ * HostDense reads the weight file as [input][output]; the specification's
+ * DenseLayer, loaded from the same files, has to give the same outputs for
+ * a random input up to float summation order. This also catches a file
+ * that changed between the two reads.
+ */
+static bool dense_matches(const HostDense &host, const string &weights_path, const string &bias_path, int activation)
+{
+	DenseLayer reference(host.inputs(), host.outputs(), activation);
+	vector2D input(1, vector<float>(host.inputs()));
+	vector<float> output(host.outputs());
+
+	reference.load_dense_layer(weights_path, bias_path);
+	for(int i = 0; i < host.inputs(); i++) input[0][i] = (float)rand() / RAND_MAX * 8 - 4;
+
+	vector2D expected = reference.forward_prop(input);
+	host.forward(&input[0][0], &output[0]);
+
+	for(int o = 0; o < host.outputs(); o++)
+	{
+		if(fabsf(output[o] - expected[0][o]) > 1e-4f * (1 + fabsf(expected[0][o]))) return false;
+	}
+	return true;
+}
+
+/* Reads the slices one after another from one file */
+static bool read_weights(const string &path, uint16_t *slices, int num_slices, int slice_len)
+{
+	FILE *input = fopen(path.c_str(), "r");
+
+	if(input == NULL)
+	{
+		cout << "[app] Cannot open " << path << endl;
+		return false;
+	}
+
+	bool ok = read_fixed(input, slices, num_slices * slice_len);
+	fclose(input);
+
+	if(!ok) cout << "[app] " << path << " is too short" << endl;
+	return ok;
+}
+
+ModelRef load_model(const char *dir)
+{
+	string base(dir);
+	shared_ptr<Model> model(new Model);
+
+	if(!read_weights(base + "/conv0_input/bias_formated.txt", model->bias, 1, BIAS_LEN) ||
+	   !read_weights(base + "/conv0_input/weights0_formated.txt", model->weights0, 1, WEIGHTS0_LEN) ||
+	   !read_weights(base + "/conv1_input/weights1_formated.txt", model->weights1[0], WEIGHTS1_SLICES, WEIGHTS_SLICE_LEN) ||
+	   !read_weights(base + "/conv2_input/weights2_formated.txt", model->weights2[0], WEIGHTS2_SLICES, WEIGHTS_SLICE_LEN)) return ModelRef();
+
+	string dense1_weights = base + "/parametars/dense1/dense1_weights.txt", dense1_bias = base + "/parametars/dense1/dense1_bias.txt";
+	string dense2_weights = base + "/parametars/dense2/dense2_weights.txt", dense2_bias = base + "/parametars/dense2/dense2_bias.txt";
+
+	/* DenseLayer does not report missing files, HostDense reads the same ones first */
+	model->host_dense[0] = new HostDense(DENSE1_INPUTS, DENSE1_OUTPUTS, HOST_RELU);
+	model->host_dense[1] = new HostDense(DENSE1_OUTPUTS, NUM_CLASSES, HOST_SOFTMAX);
+	if(!model->host_dense[0]->load(dense1_weights.c_str(), dense1_bias.c_str()) ||
+	   !model->host_dense[1]->load(dense2_weights.c_str(), dense2_bias.c_str())) return ModelRef();
+
+	if(!dense_matches(*model->host_dense[0], dense1_weights, dense1_bias, 0) ||
+	   !dense_matches(*model->host_dense[1], dense2_weights, dense2_bias, 1))
+	{
+		cout << "[app] Dense layers in " << dir << " do not read the same twice" << endl;
+		return ModelRef();
+	}
+
+	model->version = next_version++;
+	return model;
+}
+
+ModelRef current_model()
+{
+	return atomic_load(&current);
+}
+
+ModelRef swap_model(ModelRef model)
+{
+	return atomic_exchange(&current, model);
+}
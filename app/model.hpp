@@ -0,0 +1,61 @@
+#ifndef MODEL_HPP
+#define MODEL_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "classifier.hpp"
+#include "host_layers.hpp"
+
+#define MODEL_DIR		"../../data"
+
+#define WEIGHTS1_SLICES		2
+#define WEIGHTS2_SLICES		4
+
+/* ------------------------ */
+/* ---------Models--------- */
+/* ------------------------ */
+
+/*
+ * Everything a classification needs from the trained network: the IP's
+ * bias and weight slices in Q3.12 and the two dense layers. A model never
+ * changes once loaded, so any number of threads may use it at once; both
+ * flows run the dense layers through HostDense::forward(), which is const.
+ * Everything is read from disk by load_model(), a batch reads no files.
+ *
+ * The process has one current model. classify_batch() takes a reference
+ * to it for the whole batch, so swapping in a new model never affects a
+ * batch already running: new batches see the new model at once, and the
+ * old one is freed when the last batch holding it finishes.
+ */
+struct Model
+{
+	Model();
+	~Model();
+
+	// Unique per loaded model, part of the result cache key and of the IP residency checks
+	uint32_t version;
+
+	uint16_t bias[BIAS_LEN];
+	uint16_t weights0[WEIGHTS0_LEN];
+	uint16_t weights1[WEIGHTS1_SLICES][WEIGHTS_SLICE_LEN];
+	uint16_t weights2[WEIGHTS2_SLICES][WEIGHTS_SLICE_LEN];
+
+	HostDense *host_dense[2];
+
+private:
+	Model(const Model &);
+	Model &operator=(const Model &);
+};
+
+typedef std::shared_ptr<const Model> ModelRef;
+
+/* Reads a model from dir (laid out like data/), NULL if a file is missing or short */
+ModelRef load_model(const char *dir = MODEL_DIR);
+
+ModelRef current_model();
+
+/* Makes model the current one and returns the previous one, which stays valid while referenced */
+ModelRef swap_model(ModelRef model);
+
+#endif
@@ -0,0 +1,136 @@
+#include <iostream>
+#include <iomanip>
+
+#include "result_cache.hpp"
+#include "classifier.hpp"
+
+using namespace std;
+
+// Rough per-entry cost of the list node, the index node and the vector headers
+#define ENTRY_OVERHEAD_BYTES	96
+
+ResultCache::ResultCache(size_t capacity, int stripes)
+	: capacity(capacity), entry_count(0), hit_count(0), miss_count(0), eviction_count(0)
+{
+	// A power of two, so a stripe is picked by masking, and no more stripes than entries
+	num_stripes = 1;
+	while(num_stripes < stripes && (size_t)num_stripes * 2 <= capacity) num_stripes <<= 1;
+
+	for(int i = 0; i < num_stripes; i++) this->stripes.push_back(new Stripe);
+}
+
+ResultCache::~ResultCache()
+{
+	for(int i = 0; i < num_stripes; i++) delete stripes[i];
+}
+
+static inline uint64_t mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+/* Packs the 0-255 pixels eight to a word and folds the words with multiply-rotate rounds */
+uint64_t ResultCache::hash(const vector<int> &picture, uint32_t model_version)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ull ^ model_version;
+
+	for(int i = 0; i < IMAGE_LEN; i += 8)
+	{
+		uint64_t word = 0;
+		for(int j = 0; j < 8; j++) word |= (uint64_t)(picture[i + j] & 0xff) << (8 * j);
+
+		h ^= word * 0x87c37b91114253d5ull;
+		h = (h << 31) | (h >> 33);
+		h = h * 5 + 0x52dce729;
+	}
+	return mix(h);
+}
+
+bool ResultCache::same_picture(const Entry &entry, const vector<int> &picture, uint32_t model_version)
+{
+	if(entry.model_version != model_version) return false;
+
+	for(int i = 0; i < IMAGE_LEN; i++)
+	{
+		if(entry.pixels[i] != (uint8_t)picture[i]) return false;
+	}
+	return true;
+}
+
+bool ResultCache::lookup(const vector<int> &picture, uint32_t model_version, vector<float> &scores)
+{
+	uint64_t key = hash(picture, model_version);
+	Stripe &s = stripe(key);
+	lock_guard<mutex> guard(s.lock);
+
+	unordered_map<uint64_t, list<Entry>::iterator>::iterator it = s.index.find(key);
+	if(it == s.index.end() || !same_picture(*it->second, picture, model_version))
+	{
+		miss_count++;
+		return false;
+	}
+
+	s.lru.splice(s.lru.begin(), s.lru, it->second);
+	scores = it->second->scores;
+	hit_count++;
+	return true;
+}
+
+void ResultCache::insert(const vector<int> &picture, uint32_t model_version, const vector<float> &scores)
+{
+	uint64_t key = hash(picture, model_version);
+	Stripe &s = stripe(key);
+	lock_guard<mutex> guard(s.lock);
+
+	// A colliding or older entry under the same key is replaced
+	unordered_map<uint64_t, list<Entry>::iterator>::iterator it = s.index.find(key);
+	if(it != s.index.end())
+	{
+		s.lru.erase(it->second);
+		s.index.erase(it);
+		entry_count--;
+	}
+
+	// A full cache makes room in this stripe; with nothing here to evict the picture is not kept
+	if(entry_count.fetch_add(1) >= capacity)
+	{
+		if(s.lru.empty())
+		{
+			entry_count--;
+			return;
+		}
+		s.index.erase(s.lru.back().key);
+		s.lru.pop_back();
+		entry_count--;
+		eviction_count++;
+	}
+
+	s.lru.push_front(Entry());
+	Entry &entry = s.lru.front();
+	entry.key = key;
+	entry.model_version = model_version;
+	entry.pixels.assign(picture.begin(), picture.begin() + IMAGE_LEN);
+	entry.scores = scores;
+	s.index[key] = s.lru.begin();
+}
+
+size_t ResultCache::bytes()
+{
+	return entries() * (IMAGE_LEN + NUM_CLASSES * sizeof(float) + sizeof(Entry) + ENTRY_OVERHEAD_BYTES);
+}
+
+void ResultCache::report(ostream &out)
+{
+	uint64_t hits = hit_count, misses = miss_count;
+	ios::fmtflags flags = out.flags();
+
+	out << "[app] Result cache: " << hits << " hits, " << misses << " misses ("
+	    << fixed << setprecision(1) << (hits + misses ? hits * 100.0 / (hits + misses) : 0) << "% hit rate), "
+	    << entries() << " entries, " << bytes() / 1024 << " KiB, " << eviction_count << " evictions" << endl;
+	out.flags(flags);
+}
@@ -0,0 +1,70 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <ostream>
+
+/*
+ * Scores of recently classified pictures, keyed by a 64-bit hash of the raw
+ * 3072 pixels and the model version. The pixels are kept as well, so a hash
+ * collision is a miss and never a wrong answer. The cache is split into
+ * stripes by hash, each with its own lock and LRU list, and holds at most
+ * capacity pictures in total. Only a full cache evicts, and then from the
+ * stripe being inserted into, so the stripes share the capacity unevenly.
+ */
+class ResultCache
+{
+public:
+	ResultCache(size_t capacity, int stripes = 16);
+	~ResultCache();
+
+	bool lookup(const std::vector<int> &picture, uint32_t model_version, std::vector<float> &scores);
+	void insert(const std::vector<int> &picture, uint32_t model_version, const std::vector<float> &scores);
+
+	uint64_t hits() const { return hit_count; }
+	uint64_t misses() const { return miss_count; }
+	size_t entries() const { return entry_count; }
+	// Pixels, scores and bookkeeping of the cached pictures
+	size_t bytes();
+
+	void report(std::ostream &out);
+
+	static uint64_t hash(const std::vector<int> &picture, uint32_t model_version);
+
+private:
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t model_version;
+		std::vector<uint8_t> pixels;
+		std::vector<float> scores;
+	};
+
+	struct Stripe
+	{
+		std::mutex lock;
+		// Most recently used first
+		std::list<Entry> lru;
+		std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+	};
+
+	Stripe &stripe(uint64_t key) { return *stripes[key & (num_stripes - 1)]; }
+	static bool same_picture(const Entry &entry, const std::vector<int> &picture, uint32_t model_version);
+
+	std::vector<Stripe *> stripes;
+	int num_stripes;
+	size_t capacity;
+	// Pictures in all stripes, reserved before an insert takes its stripe's slot
+	std::atomic<size_t> entry_count;
+
+	std::atomic<uint64_t> hit_count;
+	std::atomic<uint64_t> miss_count;
+	std::atomic<uint64_t> eviction_count;
+};
+
+#endif
@@ -0,0 +1,272 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <limits>
+
+#include "scheduler.hpp"
+#include "trace.hpp"
+
+using namespace std;
+using namespace chrono;
+
+// Weight of the newest picture in an engine's service time average
+#define SERVICE_TIME_ALPHA	0.2
+
+Scheduler::Scheduler()
+	: cache(NULL), wall_ns(0)
+{
+}
+
+Scheduler::~Scheduler()
+{
+	for(size_t i = 0; i < engines.size(); i++)
+	{
+		destroy_network(engines[i]->net);
+		delete engines[i];
+	}
+}
+
+void Scheduler::add_engine(Accelerator *acc, int batch)
+{
+	Engine *engine = new Engine;
+
+	engine->acc = acc;
+	engine->net = create_network();
+	engine->net->cache = cache;
+	engine->batch = batch < 1 ? 1 : batch;
+	engine->service_ns = 0;
+	engine->failed = false;
+	engine->pictures = 0;
+	engine->busy_ns = 0;
+
+	engines.push_back(engine);
+}
+
+void Scheduler::set_cache(ResultCache *cache)
+{
+	this->cache = cache;
+	for(size_t i = 0; i < engines.size(); i++) engines[i]->net->cache = cache;
+}
+
+void Scheduler::enable_arena()
+{
+	for(size_t i = 0; i < engines.size(); i++) ::enable_arena(engines[i]->net);
+}
+
+/* Engines not measured yet are assumed to be as fast as the measured ones on average */
+double Scheduler::service_estimate(const Engine &engine)
+{
+	if(engine.failed) return numeric_limits<double>::infinity();
+	if(engine.service_ns > 0) return engine.service_ns;
+
+	double sum = 0;
+	int measured = 0;
+	for(size_t i = 0; i < engines.size(); i++)
+	{
+		if(engines[i]->service_ns > 0 && !engines[i]->failed)
+		{
+			sum += engines[i]->service_ns;
+			measured++;
+		}
+	}
+	return measured ? sum / measured : 1;
+}
+
+bool Scheduler::take(Engine &engine, vector<int> &batch)
+{
+	lock_guard<mutex> guard(engine.lock);
+
+	batch.clear();
+	while(!engine.queue.empty() && (int)batch.size() < engine.batch)
+	{
+		batch.push_back(engine.queue.front());
+		engine.queue.pop_front();
+	}
+	return !batch.empty();
+}
+
+/*
+ * Takes pictures from the back of the other queues, starting with the one
+ * that would finish last. A picture is only moved if the thief finishes it
+ * before its owner would get to it.
+ */
+bool Scheduler::steal(Engine &thief, vector<int> &batch)
+{
+	double thief_ns = service_estimate(thief);
+	vector<int> stolen;
+
+	while(stolen.empty())
+	{
+		Engine *victim = NULL;
+		double victim_remaining = 0;
+
+		for(size_t i = 0; i < engines.size(); i++)
+		{
+			Engine *engine = engines[i];
+			if(engine == &thief) continue;
+
+			lock_guard<mutex> guard(engine->lock);
+			if(engine->queue.empty()) continue;
+
+			double remaining = engine->queue.size() * service_estimate(*engine);
+			if(victim == NULL || remaining > victim_remaining)
+			{
+				victim = engine;
+				victim_remaining = remaining;
+			}
+		}
+		if(victim == NULL) return false;
+
+		{
+			lock_guard<mutex> guard(victim->lock);
+			double victim_ns = service_estimate(*victim);
+
+			while(!victim->queue.empty() &&
+			      thief_ns * (stolen.size() + 1) < victim_ns * victim->queue.size())
+			{
+				stolen.push_back(victim->queue.back());
+				victim->queue.pop_back();
+			}
+		}
+
+		// Nothing worth stealing from the slowest queue, so nothing anywhere
+		if(stolen.empty()) return false;
+	}
+
+	{
+		lock_guard<mutex> guard(thief.lock);
+		// Stolen in reverse, keep the original order
+		thief.queue.insert(thief.queue.end(), stolen.rbegin(), stolen.rend());
+	}
+	return take(thief, batch);
+}
+
+void Scheduler::worker(Engine &engine, const vector<vector<int> > &pictures, vector<vector1D> &scores)
+{
+	vector<int> batch;
+	vector<const vector<int> *> batch_pictures;
+	vector<vector1D> batch_scores;
+
+	while(take(engine, batch) || steal(engine, batch))
+	{
+		batch_pictures.clear();
+		for(size_t i = 0; i < batch.size(); i++) batch_pictures.push_back(&pictures[batch[i]]);
+
+		steady_clock::time_point start = steady_clock::now();
+		if(!classify_batch(*engine.acc, *engine.net, batch_pictures, batch_scores))
+		{
+			cout << "[app] Engine " << engine.acc->name() << " failed, its pictures go to the other engines" << endl;
+
+			lock_guard<mutex> guard(engine.lock);
+			engine.queue.insert(engine.queue.begin(), batch.begin(), batch.end());
+			engine.failed = true;
+			return;
+		}
+		double ns = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+
+		for(size_t i = 0; i < batch.size(); i++)
+		{
+			scores[batch[i]] = batch_scores[i];
+			done[batch[i]] = 1;
+		}
+
+		double per_picture = ns / batch.size();
+		double service = engine.service_ns;
+		engine.service_ns = service > 0 ? (1 - SERVICE_TIME_ALPHA) * service + SERVICE_TIME_ALPHA * per_picture : per_picture;
+		engine.pictures += batch.size();
+		engine.busy_ns += ns;
+	}
+}
+
+/*
+ * Every round deals the pictures still to do over the engines that have
+ * not failed and runs them until their queues are empty. A failing engine
+ * leaves its pictures in its queue for the others to steal, but those may
+ * have run dry and stopped already, so what is left goes to the next
+ * round. Each round but the last loses an engine, so the rounds end.
+ */
+bool Scheduler::run(const vector<vector<int> > &pictures, vector<vector1D> &scores)
+{
+	int count = pictures.size();
+	vector<int> pending;
+	vector<Engine *> live;
+	vector<double> estimate;
+
+	if(engines.empty()) return false;
+
+	TRACE_SCOPE("scheduler_run");
+
+	scores.assign(count, vector1D());
+	done.assign(count, 0);
+	for(int picture = 0; picture < count; picture++) pending.push_back(picture);
+
+	for(size_t i = 0; i < engines.size(); i++)
+	{
+		engines[i]->failed = false;
+		engines[i]->pictures = 0;
+		engines[i]->busy_ns = 0;
+	}
+
+	steady_clock::time_point start = steady_clock::now();
+
+	while(!pending.empty())
+	{
+		vector<thread> threads;
+
+		live.clear();
+		estimate.clear();
+		for(size_t i = 0; i < engines.size(); i++)
+		{
+			engines[i]->queue.clear();
+			if(engines[i]->failed) continue;
+			live.push_back(engines[i]);
+			estimate.push_back(service_estimate(*engines[i]));
+		}
+		if(live.empty()) break;
+
+		/* Deal in proportion to speed: each picture goes to the queue that would finish it first */
+		for(size_t p = 0; p < pending.size(); p++)
+		{
+			size_t best = 0;
+			for(size_t i = 1; i < live.size(); i++)
+			{
+				if((live[i]->queue.size() + 1) * estimate[i] < (live[best]->queue.size() + 1) * estimate[best]) best = i;
+			}
+			live[best]->queue.push_back(pending[p]);
+		}
+
+		for(size_t i = 0; i < live.size(); i++)
+		{
+			threads.push_back(thread(&Scheduler::worker, this, ref(*live[i]), cref(pictures), ref(scores)));
+		}
+		for(size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+		pending.clear();
+		for(int picture = 0; picture < count; picture++)
+		{
+			if(!done[picture]) pending.push_back(picture);
+		}
+	}
+
+	wall_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+	return pending.empty();
+}
+
+void Scheduler::report(ostream &out)
+{
+	ios::fmtflags flags = out.flags();
+
+	out << "[app] Engine          pictures   service ms   busy %" << endl;
+	for(size_t i = 0; i < engines.size(); i++)
+	{
+		Engine &engine = *engines[i];
+
+		out << "[app] " << setw(3) << i << " " << left << setw(10) << engine.acc->name() << right
+		    << setw(10) << engine.pictures
+		    << setw(13) << fixed << setprecision(3) << engine.service_ns / 1e6
+		    << setw(9) << setprecision(1) << (wall_ns > 0 ? engine.busy_ns * 100.0 / wall_ns : 0)
+		    << (engine.failed ? "  failed" : "") << endl;
+	}
+	out.flags(flags);
+}
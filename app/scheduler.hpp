@@ -0,0 +1,68 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <ostream>
+
+#include "classifier.hpp"
+
+/*
+ * Spreads whole pictures over engines of different speed (IP instances and
+ * CPU backends). Every engine has its own thread, host layers and queue.
+ * The pictures are dealt out in proportion to the measured speed of the
+ * engines; an engine that runs dry steals from the back of the queue that
+ * would finish last, but only pictures it can finish sooner than their owner.
+ * The speed estimates are kept from one run() to the next.
+ */
+class Scheduler
+{
+public:
+	Scheduler();
+	~Scheduler();
+
+	// Several engines may share one accelerator, its lock serializes the IP layers
+	void add_engine(Accelerator *acc, int batch = 1);
+	// Result cache shared by all engines, NULL to disable
+	void set_cache(ResultCache *cache);
+	// After add_engine(); every engine's intermediates go to its own arena
+	void enable_arena();
+
+	// Classifies all pictures, false if some could not be classified by any engine
+	bool run(const std::vector<std::vector<int> > &pictures, std::vector<vector1D> &scores);
+
+	// Pictures and mean service time per engine, for the last run
+	void report(std::ostream &out);
+
+private:
+	struct Engine
+	{
+		Accelerator *acc;
+		Network *net;
+		int batch;
+
+		std::mutex lock;
+		std::deque<int> queue;
+		// Moving average of the time one picture takes, 0 until measured
+		std::atomic<double> service_ns;
+		std::atomic<bool> failed;
+
+		uint64_t pictures;
+		double busy_ns;
+	};
+
+	void worker(Engine &engine, const std::vector<std::vector<int> > &pictures, std::vector<vector1D> &scores);
+	bool take(Engine &engine, std::vector<int> &batch);
+	bool steal(Engine &thief, std::vector<int> &batch);
+	double service_estimate(const Engine &engine);
+
+	std::vector<Engine *> engines;
+	ResultCache *cache;
+	std::vector<char> done;
+	double wall_ns;
+};
+
+#endif
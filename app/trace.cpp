@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+
+#include "trace.hpp"
+
+using namespace std;
+using namespace chrono;
+
+/* Histogram with 16 linear sub-buckets per power of two (~6% resolution) */
+#define HIST_SUB_BITS		4
+#define HIST_SUB_BUCKETS	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+/* Distinct span names with a histogram per thread, spans past that only go to the ring */
+#define TRACE_MAX_STAGES	64
+
+/*
+ * Reports may run while traced threads still record. Every thread only
+ * writes its own trace, so all fields are atomics written with plain
+ * relaxed load/store pairs (no locked instructions on the hot path); the
+ * ring head and the stage count are published with release stores. A span
+ * is announced in writing before its slot is overwritten, so a reader can
+ * tell which of the spans it copied may have changed under it.
+ */
+struct TraceEvent
+{
+	atomic<const char *> name;
+	atomic<uint64_t> start_ns;
+	atomic<uint64_t> dur_ns;
+	atomic<int> arg;
+};
+
+struct StageHistogram
+{
+	const char *name;
+	atomic<uint64_t> count;
+	atomic<uint64_t> max_ns;
+	atomic<uint64_t> total_ns;
+	atomic<uint64_t> buckets[HIST_BUCKETS];
+};
+
+struct ThreadTrace
+{
+	int tid;
+	// Spans below head are complete, the one at writing - 1 may be half written
+	atomic<uint64_t> head;
+	atomic<uint64_t> writing;
+	TraceEvent ring[TRACE_RING_SIZE];
+	atomic<int> stage_count;
+	StageHistogram *stages[TRACE_MAX_STAGES];
+};
+
+/* What a report reads of a stage, added up over threads */
+struct StageSnapshot
+{
+	const char *name;
+	uint64_t count;
+	uint64_t max_ns;
+	uint64_t total_ns;
+	vector<uint64_t> buckets;
+};
+
+static bool enabled = true;
+static mutex registry_lock;
+static vector<ThreadTrace *> registry;
+static thread_local ThreadTrace *local_trace = NULL;
+
+static int hist_index(uint64_t value)
+{
+	if(value < HIST_SUB_BUCKETS)
+		return (int)value;
+
+	int msb = 63 - __builtin_clzll(value);
+	int sub = (int)((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+
+	return (msb - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+static uint64_t hist_value(int index)
+{
+	if(index < HIST_SUB_BUCKETS)
+		return index;
+
+	int msb = index / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+	uint64_t sub = index % HIST_SUB_BUCKETS;
+	uint64_t low = (HIST_SUB_BUCKETS + sub) << (msb - HIST_SUB_BITS);
+
+	// Middle of the bucket
+	return low + ((1ULL << (msb - HIST_SUB_BITS)) >> 1);
+}
+
+static ThreadTrace *thread_trace()
+{
+	if(local_trace == NULL)
+	{
+		ThreadTrace *t = new ThreadTrace();
+		t->head.store(0, memory_order_relaxed);
+		t->writing.store(0, memory_order_relaxed);
+		t->stage_count.store(0, memory_order_relaxed);
+
+		lock_guard<mutex> guard(registry_lock);
+		t->tid = registry.size() + 1;
+		registry.push_back(t);
+		local_trace = t;
+	}
+	return local_trace;
+}
+
+void trace_enable(bool enable)
+{
+	enabled = enable;
+}
+
+bool trace_is_enabled()
+{
+	return enabled;
+}
+
+uint64_t trace_now_ns()
+{
+	uint64_t now = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+
+	// Zero is reserved for "span not started"
+	return now ? now : 1;
+}
+
+/* Only the owning thread writes, so a relaxed load and store is enough */
+static void add_relaxed(atomic<uint64_t> &value, uint64_t n)
+{
+	value.store(value.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static StageHistogram *find_stage(ThreadTrace *t, const char *name)
+{
+	int count = t->stage_count.load(memory_order_relaxed);
+
+	for(int i = 0; i < count; i++)
+	{
+		if(t->stages[i]->name == name)
+			return t->stages[i];
+	}
+	if(count == TRACE_MAX_STAGES)
+		return NULL;
+
+	StageHistogram *stage = new StageHistogram();
+
+	stage->name = name;
+	stage->count.store(0, memory_order_relaxed);
+	stage->max_ns.store(0, memory_order_relaxed);
+	stage->total_ns.store(0, memory_order_relaxed);
+	for(int i = 0; i < HIST_BUCKETS; i++) stage->buckets[i].store(0, memory_order_relaxed);
+
+	t->stages[count] = stage;
+	t->stage_count.store(count + 1, memory_order_release);
+	return stage;
+}
+
+void trace_record(const char *name, uint64_t start_ns, uint64_t end_ns, int arg)
+{
+	ThreadTrace *t = thread_trace();
+	uint64_t dur = end_ns - start_ns;
+	uint64_t head = t->head.load(memory_order_relaxed);
+	StageHistogram *stage = find_stage(t, name);
+
+	t->writing.store(head + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	TraceEvent &e = t->ring[head % TRACE_RING_SIZE];
+	e.name.store(name, memory_order_relaxed);
+	e.start_ns.store(start_ns, memory_order_relaxed);
+	e.dur_ns.store(dur, memory_order_relaxed);
+	e.arg.store(arg, memory_order_relaxed);
+	t->head.store(head + 1, memory_order_release);
+
+	if(stage == NULL) return;
+
+	add_relaxed(stage->count, 1);
+	add_relaxed(stage->total_ns, dur);
+	if(dur > stage->max_ns.load(memory_order_relaxed)) stage->max_ns.store(dur, memory_order_relaxed);
+	add_relaxed(stage->buckets[hist_index(dur)], 1);
+}
+
+static uint64_t percentile(const StageSnapshot &stage, double p)
+{
+	uint64_t rank = (uint64_t)(p * stage.count);
+	uint64_t seen = 0;
+
+	if(rank >= stage.count) rank = stage.count - 1;
+
+	for(int i = 0; i < HIST_BUCKETS; i++)
+	{
+		seen += stage.buckets[i];
+		if(seen > rank)
+			return min(hist_value(i), stage.max_ns);
+	}
+	return stage.max_ns;
+}
+
+/*
+ * Stages are merged by name, so the same literal in two translation units
+ * still ends up in one row. With threads still recording, the counters of
+ * a stage may be a few spans apart from each other.
+ */
+static vector<StageSnapshot> merge_stages()
+{
+	vector<StageSnapshot> merged;
+
+	lock_guard<mutex> guard(registry_lock);
+	for(size_t t = 0; t < registry.size(); t++)
+	{
+		int count = registry[t]->stage_count.load(memory_order_acquire);
+
+		for(int s = 0; s < count; s++)
+		{
+			const StageHistogram &src = *registry[t]->stages[s];
+			StageSnapshot *dst = NULL;
+
+			for(size_t i = 0; i < merged.size(); i++)
+			{
+				if(strcmp(merged[i].name, src.name) == 0)
+				{
+					dst = &merged[i];
+					break;
+				}
+			}
+			if(dst == NULL)
+			{
+				merged.push_back(StageSnapshot());
+				dst = &merged.back();
+				dst->name = src.name;
+				dst->count = 0;
+				dst->max_ns = 0;
+				dst->total_ns = 0;
+				dst->buckets.assign(HIST_BUCKETS, 0);
+			}
+
+			dst->count += src.count.load(memory_order_relaxed);
+			dst->total_ns += src.total_ns.load(memory_order_relaxed);
+			dst->max_ns = max(dst->max_ns, src.max_ns.load(memory_order_relaxed));
+			for(int i = 0; i < HIST_BUCKETS; i++) dst->buckets[i] += src.buckets[i].load(memory_order_relaxed);
+		}
+	}
+	return merged;
+}
+
+void trace_report(ostream &out)
+{
+	vector<StageSnapshot> stages = merge_stages();
+
+	if(stages.empty()) return;
+
+	out << endl << "[trace] Latency per stage (us)" << endl;
+	out << left << setw(28) << "stage" << right
+	    << setw(10) << "count"
+	    << setw(12) << "mean"
+	    << setw(12) << "p50"
+	    << setw(12) << "p95"
+	    << setw(12) << "p99"
+	    << setw(12) << "max" << endl;
+
+	out << fixed << setprecision(1);
+	for(size_t i = 0; i < stages.size(); i++)
+	{
+		const StageSnapshot &s = stages[i];
+
+		out << left << setw(28) << s.name << right
+		    << setw(10) << s.count
+		    << setw(12) << s.total_ns / 1000.0 / s.count
+		    << setw(12) << percentile(s, 0.50) / 1000.0
+		    << setw(12) << percentile(s, 0.95) / 1000.0
+		    << setw(12) << percentile(s, 0.99) / 1000.0
+		    << setw(12) << s.max_ns / 1000.0 << endl;
+	}
+	out.unsetf(ios::floatfield);
+	out << setprecision(6);
+}
+
+struct EventCopy
+{
+	const char *name;
+	uint64_t start_ns;
+	uint64_t dur_ns;
+	int arg;
+	int tid;
+};
+
+/* Appends the buffered spans of a thread, leaving out those it overwrote while they were copied */
+static void copy_events(const ThreadTrace *trace, vector<EventCopy> &events)
+{
+	uint64_t head = trace->head.load(memory_order_acquire);
+	uint64_t oldest = head - min(head, (uint64_t)TRACE_RING_SIZE);
+	size_t first = events.size();
+
+	for(uint64_t i = oldest; i < head; i++)
+	{
+		const TraceEvent &e = trace->ring[i % TRACE_RING_SIZE];
+		EventCopy copy;
+
+		copy.name = e.name.load(memory_order_relaxed);
+		copy.start_ns = e.start_ns.load(memory_order_relaxed);
+		copy.dur_ns = e.dur_ns.load(memory_order_relaxed);
+		copy.arg = e.arg.load(memory_order_relaxed);
+		copy.tid = trace->tid;
+		events.push_back(copy);
+	}
+
+	// Span w overwrites span w - TRACE_RING_SIZE
+	atomic_thread_fence(memory_order_acquire);
+	uint64_t writing = trace->writing.load(memory_order_relaxed);
+
+	if(writing > oldest + TRACE_RING_SIZE)
+	{
+		size_t stale = min(writing - oldest - TRACE_RING_SIZE, head - oldest);
+		events.erase(events.begin() + first, events.begin() + first + stale);
+	}
+}
+
+bool trace_dump_chrome(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	vector<EventCopy> events;
+	uint64_t epoch_ns = 0;
+
+	if(file == NULL) return false;
+
+	{
+		lock_guard<mutex> guard(registry_lock);
+		for(size_t t = 0; t < registry.size(); t++) copy_events(registry[t], events);
+	}
+
+	// Timestamps are relative to the oldest buffered span
+	for(size_t i = 0; i < events.size(); i++)
+	{
+		if(epoch_ns == 0 || events[i].start_ns < epoch_ns) epoch_ns = events[i].start_ns;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for(size_t i = 0; i < events.size(); i++)
+	{
+		const EventCopy &e = events[i];
+
+		fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+			i == 0 ? "" : ",\n", e.name, e.tid,
+			(e.start_ns - epoch_ns) / 1000.0, e.dur_ns / 1000.0);
+		if(e.arg >= 0) fprintf(file, ",\"args\":{\"arg\":%d}", e.arg);
+		fprintf(file, "}");
+	}
+
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
@@ -0,0 +1,74 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <stdint.h>
+#include <ostream>
+
+/* ------------------------ */
+/* ---------Tracing-------- */
+/* ------------------------ */
+
+/*
+ * Low overhead span tracing for the classification flow.
+ *
+ * Every thread records finished spans into its own ring buffer (no locking on
+ * the hot path) and into per-stage latency histograms. The ring buffer keeps
+ * the newest TRACE_RING_SIZE spans for the Chrome/Perfetto timeline, while the
+ * histograms see every span of the run, so the percentiles are exact to the
+ * histogram resolution even if the ring has wrapped.
+ *
+ * Span names must be string literals (or otherwise outlive the run), they are
+ * stored by pointer.
+ */
+
+#define TRACE_RING_SIZE		(1 << 16)
+
+void trace_enable(bool enable);
+bool trace_is_enabled();
+
+uint64_t trace_now_ns();
+void trace_record(const char *name, uint64_t start_ns, uint64_t end_ns, int arg);
+
+// Prints count, p50, p95, p99 and max per span name
+void trace_report(std::ostream &out);
+
+// Writes every buffered span in Chrome trace event format (chrome://tracing, ui.perfetto.dev)
+bool trace_dump_chrome(const char *path);
+
+class TraceSpan
+{
+public:
+	explicit TraceSpan(const char *name, int arg = -1)
+		: name(name), arg(arg), start_ns(trace_is_enabled() ? trace_now_ns() : 0)
+	{
+	}
+
+	~TraceSpan()
+	{
+		end();
+	}
+
+	// Closes the span before the end of the scope, further calls are ignored
+	void end()
+	{
+		if(start_ns)
+		{
+			trace_record(name, start_ns, trace_now_ns(), arg);
+			start_ns = 0;
+		}
+	}
+
+private:
+	TraceSpan(const TraceSpan &);
+	TraceSpan &operator=(const TraceSpan &);
+
+	const char *name;
+	int arg;
+	uint64_t start_ns;
+};
+
+#define TRACE_CONCAT_INNER(a, b)	a##b
+#define TRACE_CONCAT(a, b)		TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name)		TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#endif
@@ -17,6 +17,11 @@
 #include <linux/platform_device.h>
 #include <linux/of.h>
 #include <linux/ioport.h>
+#include <linux/mutex.h>
+#include <linux/capability.h>
+#include <linux/wait.h>
+#include <linux/list.h>
+#include <linux/kref.h>
 #include <asm/io.h>
 
 /* DMA headers */
@@ -25,13 +30,25 @@
 #include <linux/mm.h>
 #include <linux/interrupt.h>
 
+/* Statistics headers */
+
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+
+#define CREATE_TRACE_POINTS
+#include "title_trace.h"
+
+#include "title_ioctl.h"
+
 MODULE_AUTHOR("Vajo Bojan David Nadezda");
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION("Driver for title_ip");
 
 #define DRIVER_NAME "title_driver" 
 #define DEVICE_NAME "title_device"
-#define BUFF_SIZE 20
+#define BUFF_SIZE 32
 
 /* -------------------------------------- */
 /* -------TITLE IP RELATED MACROS-------- */
@@ -41,23 +58,10 @@ MODULE_DESCRIPTION("Driver for title_ip");
 
 #define POSSITION_LEN               106*2
 
-#define D0_LETTER_MATRIX_LEN        16602*2
-#define D1_LETTER_MATRIX_LEN        22716*2
-#define D2_LETTER_MATRIX_LEN        29792*2
-#define D3_LETTER_MATRIX_LEN        37569*2
-#define D4_LETTER_MATRIX_LEN        46423*2
+#define TEXT_WORDS                  1024
 
-#define D0_BRAM                     101
-#define D1_BRAM                     67
-#define D2_BRAM                     50
-#define D3_BRAM                     40
-#define D4_BRAM                     33
-
-#define D0_WIDTH                    640
-#define D1_WIDTH                    960
-#define D2_WIDTH                    1280
-#define D3_WIDTH                    1600
-#define D4_WIDTH                    1920
+/* Bytes of one band of a dimension code, three 16-bit channels per pixel */
+#define BAND_LEN(d)                 ((u64)(d)->width*(d)->band_rows*3*2)
 
 #define MAX_PKT_LEN			        101*640*3*2
 
@@ -70,6 +74,8 @@ MODULE_DESCRIPTION("Driver for title_ip");
 #define IP_COMMAND_SEND_FROM_BRAM	    0x0040
 #define IP_COMMAND_RESET	            0x0080
 
+#define IP_NUM_COMMANDS                 8
+
 /* -------------------------------------- */
 /* ----------DMA RELATED MACROS---------- */
 /* -------------------------------------- */
@@ -89,6 +95,29 @@ MODULE_DESCRIPTION("Driver for title_ip");
 #define ERR_IRQ_EN			    1 << 14
 
 #define AXI_OFFSET              0x4
+/* First word of the text or position memory the next load writes, cores with partial-loads only */
+#define LOAD_START_OFFSET       0x8
+
+/* Geometry of the original core, D0..D4, for device trees without a "geometry" property */
+static const struct title_dimension default_dimensions[] =
+{
+	{  640, 101, 16602 },
+	{  960,  67, 22716 },
+	{ 1280,  50, 29792 },
+	{ 1600,  40, 37569 },
+	{ 1920,  33, 46423 },
+};
+
+/* -------------------------------------- */
+/* --------INSTANCE RELATED MACROS------- */
+/* -------------------------------------- */
+
+#define TITLE_MAX_INSTANCES         8
+
+/* Every instance owns two minors: 2*n for title-ipn and 2*n+1 for dman */
+#define TITLE_MINORS                (2*TITLE_MAX_INSTANCES)
+#define MINOR_INSTANCE(minor)       ((minor) / 2)
+#define MINOR_IS_DMA(minor)         ((minor) & 1)
 
 /* -------------------------------------- */
 /* --------FUNCTION DECLARATIONS--------- */
@@ -100,6 +129,7 @@ int         title_open(struct inode *pinode, struct file *pfile);
 int         title_close(struct inode *pinode, struct file *pfile);
 ssize_t     title_read(struct file *pfile, char __user *buffer, size_t length, loff_t *offset);
 ssize_t     title_write(struct file *pfile, const char __user *buffer, size_t length, loff_t *offset);
+static long title_ioctl(struct file *pfile, unsigned int cmd, unsigned long arg);
 
 static int  __init title_init(void);
 static void __exit title_exit(void);
@@ -120,6 +150,13 @@ int dma_init(void __iomem *base_address);
 unsigned int dma_simple_write(dma_addr_t TxBufferPtr, unsigned int pkt_len, void __iomem *base_address); 
 unsigned int dma_simple_read(dma_addr_t TxBufferPtr, unsigned int pkt_len, void __iomem *base_address);
 
+struct title_instance;
+
+static void title_stats_init(void);
+static void title_stats_exit(void);
+static void title_stats_dma_start(struct title_instance *inst, int to_device, unsigned int len);
+static void title_stats_dma_done(struct title_instance *inst);
+
 /* -------------------------------------- */
 /* -----------GLOBAL VARIABLES----------- */
 /* -------------------------------------- */
@@ -133,13 +170,102 @@ struct title_info
     int irq_num1;
 };
 
+/*
+ * One title IP together with the DMA that feeds it. The two are separate
+ * platform devices and may be probed in any order; each creates its own
+ * device node (title-ipN, dmaN) once probed, and the instance can be
+ * opened as soon as both halves are there. Open files keep the instance
+ * itself alive after its halves are removed; they then get -ENODEV.
+ */
+struct title_instance
+{
+	int id;
+	/* One for instances[] while a half is probed, one per open file */
+	struct kref ref;
+
+	struct title_info *dma_p;
+	struct title_info *title_p;
+
+	/* The DMA platform device, owner of the coherent buffer */
+	struct device *dma_dev;
+	struct device *node_title;
+	struct device *node_dma;
+
+	dma_addr_t tx_phy_buffer;
+	u16 *tx_vir_buffer;
+
+	volatile int ip_command_over;
+	volatile int ip_frame_over;
+	int transaction_over;
+	int input_command;
+	int dimension;
+	int offset;
+	u64 ip_command_start;
+
+	/* Start of the DMA transfer in flight, 0 if none */
+	u64 dma_start;
+	unsigned int dma_len_in_flight;
+	int dma_to_device;
+
+	/* Job queue, see JOB SCHEDULING; queue_lock protects everything below */
+	struct mutex queue_lock;
+	/* Both halves are probed; cleared by title_remove before it frees one */
+	int present;
+	wait_queue_head_t queue_wait;
+	/* Clients with waiting jobs, served round-robin from the head */
+	struct list_head run_queue;
+	/* Client whose job is on the IP, or which holds it with TITLE_IOC_LOCK */
+	struct title_client *owner;
+	struct title_job *running;
+
+	/* Client whose load the letter memories hold, NULL after a RESET; see TITLE_IOC_RESIDENT */
+	struct title_client *letter_data_owner;
+	struct title_client *letter_matrix_owner;
+	struct title_client *text_owner;
+	struct title_client *position_owner;
+
+	/* The core has the load start register ("partial-loads" in the device tree) */
+	int partial_loads;
+
+	/* Transfer lengths per dimension code, see TITLE_IOC_GET_GEOMETRY; changed under queue_lock */
+	struct title_dimensions geometry;
+};
+
+/* One open file; jobs are its write() calls, waiting until the scheduler hands them the IP */
+struct title_client
+{
+	struct title_instance *inst;
+	/* In inst->run_queue while it has waiting jobs */
+	struct list_head node;
+	struct list_head jobs;
+	unsigned int weight;
+	/* Jobs left in its current turn */
+	unsigned int credit;
+	int locked;
+
+	/* Last command of this client */
+	int input_command;
+	int dimension;
+	int offset;
+};
+
+struct title_job
+{
+	struct list_head node;
+	int running;
+};
+
 dev_t my_dev_id;
 static struct class *my_class;
-static struct device *my_device_title;
-static struct device *my_device_dma;
 static struct cdev *my_cdev;
-static struct title_info *dma_p = NULL;
-static struct title_info *title_p = NULL;
+
+/* Indexed by instance id; probe, remove and open take instances_lock */
+static struct title_instance *instances[TITLE_MAX_INSTANCES];
+static DEFINE_MUTEX(instances_lock);
+
+/* Ids handed out in probe order when the device tree gives none, per compatible */
+static int next_dma_id;
+static int next_title_id;
 
 struct file_operations my_fops =
 {
@@ -148,6 +274,7 @@ struct file_operations my_fops =
 	.release = title_close,
 	.read = title_read,
 	.write = title_write,
+	.unlocked_ioctl = title_ioctl,
 	.mmap = title_mmap
 };
 
@@ -169,8 +296,26 @@ static struct platform_driver title_driver = {
 	.remove		= title_remove,
 };
 
-dma_addr_t tx_phy_buffer;
-u16 *tx_vir_buffer;
+/* -------------------------------------- */
+/* --------------STATISTICS-------------- */
+/* -------------------------------------- */
+
+/* Latency histograms use power of two buckets in ns: bucket n counts [2^(n-1), 2^n) */
+#define STATS_HIST_BUCKETS          32
+
+struct title_stats
+{
+	u64 command_count[IP_NUM_COMMANDS];
+	u64 bytes_to_device;
+	u64 bytes_from_device;
+	u64 spin_ns;
+	u64 dma_latency[STATS_HIST_BUCKETS];
+	u64 ip_latency[STATS_HIST_BUCKETS];
+};
+
+/* Per-CPU so the hot path (title_write and the ISRs) never shares a cache line or takes a lock; summed over all instances */
+static DEFINE_PER_CPU(struct title_stats, title_stats);
+static struct dentry *stats_dir;
 
 /* -------------------------------------- */
 /* -------INIT AND EXIT FUNCTIONS-------- */
@@ -179,11 +324,10 @@ u16 *tx_vir_buffer;
 static int __init title_init(void)
 {
 	int ret = 0;
-	int i = 0;
 
 	// printk(KERN_INFO "[title_init] Initialize Module \"%s\"\n", DEVICE_NAME);
 
-	ret = alloc_chrdev_region(&my_dev_id, 0, 2, "TITLE_region");
+	ret = alloc_chrdev_region(&my_dev_id, 0, TITLE_MINORS, "TITLE_region");
 	if(ret)
 	{
 		printk(KERN_ALERT "[title_init] Failed CHRDEV!\n");
@@ -199,95 +343,45 @@ static int __init title_init(void)
 	}
 	// printk(KERN_INFO "[title_init] Successful class chardev1 create!\n");
 
-	my_device_title = device_create(my_class, NULL, MKDEV(MAJOR(my_dev_id), 0), NULL, "title-ip");
-	if(my_device_title == NULL)
-	{
-		goto fail_1;
-	}
-	// printk(KERN_INFO "[title_init] Device title-ip created\n");
-
-
-	my_device_dma = device_create(my_class, NULL, MKDEV(MAJOR(my_dev_id), 1), NULL, "dma");
-	if(my_device_dma == NULL)
-	{
-		goto fail_2;
-	}
-	// printk(KERN_INFO "[title_init] Device dma created\n");
-
+	/* The device nodes are created by title_probe, one pair per instance */
 	my_cdev = cdev_alloc();	
 	my_cdev->ops = &my_fops;
 	my_cdev->owner = THIS_MODULE;
-	ret = cdev_add(my_cdev, my_dev_id, 2);
+	ret = cdev_add(my_cdev, my_dev_id, TITLE_MINORS);
 	if(ret)
 	{
 		printk(KERN_ERR "[title_init] Failed to add cdev\n");
-		goto fail_3;
+		goto fail_1;
 	}
 	// printk(KERN_INFO "[title_init] Module init done\n");
 
-	ret = dma_set_coherent_mask(my_device_dma, DMA_BIT_MASK(64));
-	if(ret < 0)
-	{
-		printk(KERN_WARNING "[title_init] DMA coherent mask not set!\n");
-	}
-	else
-	{
-		// printk(KERN_INFO "[title_init] DMA coherent mask set\n");
-	}
-
-	tx_vir_buffer = dma_alloc_coherent(my_device_dma, MAX_PKT_LEN, &tx_phy_buffer, GFP_KERNEL);
-	// printk(KERN_INFO "[title_init] Virtual and physical addresses coherent starting at %x and ending at %x\n", tx_phy_buffer, tx_phy_buffer+(uint)(MAX_PKT_LEN));
-	if(!tx_vir_buffer)
-	{
-		printk(KERN_ALERT "[title_init] Could not allocate dma_alloc_coherent for img");
-		goto fail_4;
-	}
-	else
-	{
-		// printk("[title_init] Successfully allocated memory for dma transaction buffer\n");
-	}
-	
-	for (i = 0; i < MAX_PKT_LEN/2; i++)
+	title_stats_init();
+	ret = platform_driver_register(&title_driver);
+	if(ret)
 	{
-		tx_vir_buffer[i] = 0x0000;
+		title_stats_exit();
+		goto fail_2;
 	}
-	
-	// printk(KERN_INFO "[title_init] DMA memory reset.\n");
-	return platform_driver_register(&title_driver);
+	return 0;
 
-	fail_4:
-		cdev_del(my_cdev);
-	fail_3:
-		device_destroy(my_class, MKDEV(MAJOR(my_dev_id),1));
 	fail_2:
-		device_destroy(my_class, MKDEV(MAJOR(my_dev_id),0));
+		cdev_del(my_cdev);
 	fail_1:
 		class_destroy(my_class);
 	fail_0:
-		unregister_chrdev_region(my_dev_id, 2);
+		unregister_chrdev_region(my_dev_id, TITLE_MINORS);
 	return -1;
 } 
 
 
 static void __exit title_exit(void)
 {
-    	/* Reset DMA memory */
-	int i = 0;
-	for (i = 0; i < MAX_PKT_LEN/2; i++) 
-	{
-		tx_vir_buffer[i] = 0x0000;
-	}
-
-	// printk(KERN_INFO "[title_exit] DMA memory reset\n");
-
-	/* Exit Device Module */
+	/* Removes every instance, with its device nodes and DMA buffer */
 	platform_driver_unregister(&title_driver);
+	title_stats_exit();
 	cdev_del(my_cdev);
-	device_destroy(my_class, MKDEV(MAJOR(my_dev_id),0));
-	device_destroy(my_class, MKDEV(MAJOR(my_dev_id),1));
 	class_destroy(my_class);
-	unregister_chrdev_region(my_dev_id, 2);
-	dma_free_coherent(my_device_dma, MAX_PKT_LEN, tx_vir_buffer, tx_phy_buffer);
+	unregister_chrdev_region(my_dev_id, TITLE_MINORS);
 	// printk(KERN_INFO "[title_exit] Exit device module finished\"%s\".\n", DEVICE_NAME);
 }
 
@@ -299,253 +393,723 @@ module_exit(title_exit);
 /* -----PROBE AND REMOVE FUNCTIONS------- */
 /* -------------------------------------- */
 
-int device_fsm = 0;
+/* Instance a platform device belongs to: the device tree "instance" property, else probe order */
+static int title_instance_id(struct platform_device *pdev, int is_dma)
+{
+	u32 id;
 
-static int title_probe(struct platform_device *pdev) 
+	if(of_property_read_u32(pdev->dev.of_node, "instance", &id) == 0)
+		return id;
+	return is_dma ? next_dma_id++ : next_title_id++;
+}
+
+/* Called with instances_lock held */
+static struct title_instance *title_get_instance(int id)
+{
+	struct title_instance *inst;
+
+	if(id < 0 || id >= TITLE_MAX_INSTANCES)
+	{
+		printk(KERN_ALERT "[title_probe] Instance %d out of range, at most %d instances\n", id, TITLE_MAX_INSTANCES);
+		return NULL;
+	}
+	if(instances[id])
+		return instances[id];
+
+	inst = kzalloc(sizeof(struct title_instance), GFP_KERNEL);
+	if(!inst)
+		return NULL;
+	inst->id = id;
+	kref_init(&inst->ref);
+	mutex_init(&inst->queue_lock);
+	init_waitqueue_head(&inst->queue_wait);
+	INIT_LIST_HEAD(&inst->run_queue);
+	instances[id] = inst;
+	return inst;
+}
+
+static void title_free_instance(struct kref *ref)
+{
+	kfree(container_of(ref, struct title_instance, ref));
+}
+
+/* Called with instances_lock held, drops the instance from instances[] once both halves are gone */
+static void title_put_instance(struct title_instance *inst)
+{
+	if(inst->dma_p || inst->title_p)
+		return;
+	instances[inst->id] = NULL;
+	kref_put(&inst->ref, title_free_instance);
+}
+
+static int dma_probe(struct platform_device *pdev, struct title_instance *inst)
 {
 	struct resource *r_mem;
+	struct title_info *dma_p;
 	int rc = 0;
-	const char *comp = of_get_property(pdev->dev.of_node, "compatible", NULL);
+
+	if(inst->dma_p)
+	{
+		printk(KERN_ALERT "[title_probe] dma%d probed twice\n", inst->id);
+		return -EBUSY;
+	}
+
+	r_mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+	if(!r_mem)
+	{
+		printk(KERN_ALERT "[title_probe] Failed to get reg resource.\n");
+		return -ENODEV;
+	}
+
+	printk(KERN_ALERT "[title_probe] Probing dma%d\n", inst->id);
+	 
+	dma_p = (struct title_info *) kmalloc(sizeof(struct title_info), GFP_KERNEL);
+	if(!dma_p) 
+	{
+		printk(KERN_ALERT "[title_probe] Could not allocate DMA device\n");
+		return -ENOMEM;
+	}
+
+	dma_p->mem_start = r_mem->start;
+	dma_p->mem_end = r_mem->end;
+
+	if(!request_mem_region(dma_p->mem_start, dma_p->mem_end - dma_p->mem_start + 1,	DEVICE_NAME)) 
+	{
+		printk(KERN_ALERT "[title_probe] Could not lock memory region at %p\n",(void *)dma_p->mem_start);
+		rc = -EBUSY;
+		goto error4;
+	}
+
+	dma_p->base_addr = ioremap(dma_p->mem_start, dma_p->mem_end - dma_p->mem_start + 1);
+	if (!dma_p->base_addr) 
+	{
+		printk(KERN_ALERT "[title_probe] Could not allocate memory\n");
+		rc = -EIO;
+		goto error5;
+	}
 	
-	// if(comp)  	printk(KERN_INFO "Probing %s\n", comp);
-	// else 	printk(KERN_INFO "Not found\n");
+	// printk(KERN_INFO "[title_probe] dma base address start at %x\n", dma_p->base_addr);
 
-	if(comp == "dma_ip") device_fsm = 0;
-	if(comp == "title_ip") device_fsm = 1;
+	/* Every instance streams from its own buffer, owned by its own DMA device */
+	dma_set_coherent_mask(&pdev->dev, DMA_BIT_MASK(32));
+	inst->tx_vir_buffer = dma_alloc_coherent(&pdev->dev, TITLE_DMA_BUFFER_LEN, &inst->tx_phy_buffer, GFP_KERNEL | GFP_DMA);
+	if(!inst->tx_vir_buffer)
+	{
+		printk(KERN_ALERT "[title_probe] Could not allocate dma_alloc_coherent for dma%d\n", inst->id);
+		rc = -ENOMEM;
+		goto error6;
+	}
+	memset(inst->tx_vir_buffer, 0, TITLE_DMA_BUFFER_LEN);
+	inst->dma_dev = &pdev->dev;
 
-	switch(device_fsm)
+	inst->node_dma = device_create(my_class, &pdev->dev, MKDEV(MAJOR(my_dev_id), 2*inst->id + 1), inst, "dma%d", inst->id);
+	if(IS_ERR(inst->node_dma))
 	{
-	case 0:
-		
-		r_mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-		if(!r_mem)
-		{
-			printk(KERN_ALERT "[title_probe] Failed to get reg resource.\n");
-			return -ENODEV;
-		}
+		printk(KERN_ERR "[title_probe] Failed to create device dma%d\n", inst->id);
+		rc = PTR_ERR(inst->node_dma);
+		goto error7;
+	}
 
-		printk(KERN_ALERT "[title_probe] Probing dma_p\n");
-		 
-		dma_p = (struct title_info *) kmalloc(sizeof(struct title_info), GFP_KERNEL);
-		if(!dma_p) 
-		{
-			printk(KERN_ALERT "[title_probe] Could not allocate DMA device\n");
-			return -ENOMEM;
-		}
+	dma_init(dma_p->base_addr);
+	inst->dma_p = dma_p;
+	platform_set_drvdata(pdev, inst);
+	
+	// printk(KERN_NOTICE "[title_probe] TITLE platform driver registered - dma%d\n", inst->id);
+	return 0;
 
-		dma_p->mem_start = r_mem->start;
-		dma_p->mem_end = r_mem->end;
+	error7:
+		dma_free_coherent(&pdev->dev, TITLE_DMA_BUFFER_LEN, inst->tx_vir_buffer, inst->tx_phy_buffer);
+		inst->tx_vir_buffer = NULL;
+		inst->dma_dev = NULL;
+	error6:
+		iounmap(dma_p->base_addr);
+	error5:
+		release_mem_region(dma_p->mem_start, dma_p->mem_end - dma_p->mem_start + 1);
+	error4:
+		kfree(dma_p);
+		return rc;			
+}
 
-		if(!request_mem_region(dma_p->mem_start, dma_p->mem_end - dma_p->mem_start + 1,	DEVICE_NAME)) 
-		{
-			printk(KERN_ALERT "[title_probe] Could not lock memory region at %p\n",(void *)dma_p->mem_start);
-			rc = -EBUSY;
-			goto error4;
-		}
+/* A band and a letter matrix of every dimension code have to fit the DMA buffer */
+static int title_check_geometry(const struct title_dimensions *geometry)
+{
+	const struct title_dimension *d;
+	unsigned int i;
 
-		dma_p->base_addr = ioremap(dma_p->mem_start, dma_p->mem_end - dma_p->mem_start + 1);
-		if (!dma_p->base_addr) 
-		{
-			printk(KERN_ALERT "[title_probe] Could not allocate memory\n");
-			rc = -EIO;
-			goto error5;
-		}
-		
-		// printk(KERN_INFO "[title_probe] dma base address start at %x\n", dma_p->base_addr);
-		
-        /*		
-		
-		dma_p->irq_num = platform_get_irq(pdev, 0);
-		if(!dma_p->irq_num)
+	if(geometry->count < 1 || geometry->count > TITLE_MAX_DIMENSIONS)
+	{
+		printk(KERN_WARNING "[title_check_geometry] %u dimension codes, 1 to %d allowed\n", geometry->count, TITLE_MAX_DIMENSIONS);
+		return -EINVAL;
+	}
+	for(i = 0; i < geometry->count; i++)
+	{
+		d = &geometry->dimensions[i];
+		if(!d->width || !d->band_rows || !d->letter_matrix_words ||
+		   BAND_LEN(d) > TITLE_DMA_BUFFER_LEN || (u64)d->letter_matrix_words*2 > TITLE_DMA_BUFFER_LEN)
 		{
-			printk(KERN_ERR "[title_probe] Could not get IRQ resource\n");
-			rc = -ENODEV;
-			goto error5;
+			printk(KERN_WARNING "[title_check_geometry] Dimension %u (%ux%u, %u letter matrix words) does not fit the DMA buffer\n",
+			       i, d->width, d->band_rows, d->letter_matrix_words);
+			return -EINVAL;
 		}
+	}
+	return 0;
+}
 
-		if (request_irq(dma_p->irq_num, dma_MM2S_isr, 0, DEVICE_NAME, dma_p)) {
-			printk(KERN_ERR "[title_probe] Could not register IRQ %d\n", dma_p->irq_num);
-			return -EIO;
-			goto error6;
-		}
-		else {
-			printk(KERN_INFO "[title_probe] Registered MM2S IRQ %d\n", dma_p->irq_num);
-		}
-		if(!dma_p->irq_num)
+/* The "geometry" property, width, band rows and letter matrix words per dimension code, or the original core's table */
+static void title_read_geometry(struct platform_device *pdev, struct title_instance *inst)
+{
+	struct title_dimensions *geometry = &inst->geometry;
+	u32 cells[3*TITLE_MAX_DIMENSIONS];
+	int count = of_property_count_u32_elems(pdev->dev.of_node, "geometry");
+	int i;
+
+	if(count > 0)
+	{
+		if(count % 3 == 0 && count <= 3*TITLE_MAX_DIMENSIONS &&
+		   of_property_read_u32_array(pdev->dev.of_node, "geometry", cells, count) == 0)
 		{
-			printk(KERN_ERR "[title_probe] Could not get IRQ resource\n");
-			rc = -ENODEV;
-			goto error5;
+			geometry->count = count / 3;
+			for(i = 0; i < count / 3; i++)
+			{
+				geometry->dimensions[i].width = cells[3*i];
+				geometry->dimensions[i].band_rows = cells[3*i + 1];
+				geometry->dimensions[i].letter_matrix_words = cells[3*i + 2];
+			}
+			if(title_check_geometry(geometry) == 0)
+			{
+				printk(KERN_INFO "[title_probe] title-ip%d has %u dimension codes\n", inst->id, geometry->count);
+				return;
+			}
 		}
+		printk(KERN_WARNING "[title_probe] Bad geometry property of title-ip%d, using D0..D4\n", inst->id);
+	}
 
-		if (request_irq(dma_p->irq_num, dma_S2MM_isr, 0, DEVICE_NAME, dma_p)) {
-			printk(KERN_ERR "[title_probe] Could not register IRQ %d\n", dma_p->irq_num);
-			return -EIO;
-			goto error6;
-		}
-		else {
-			printk(KERN_INFO "[title_probe] Registered S2MM IRQ %d\n", dma_p->irq_num);
-		}
-        */
-		
-		dma_init(dma_p->base_addr);
-		
-		// printk(KERN_NOTICE "[title_probe] TITLE platform driver registered - dma\n");
-		device_fsm++;	
-		return 0;
+	geometry->count = ARRAY_SIZE(default_dimensions);
+	memcpy(geometry->dimensions, default_dimensions, sizeof(default_dimensions));
+}
 
-		error6:
-			iounmap(dma_p->base_addr);
-		error5:
-			release_mem_region(dma_p->mem_start, dma_p->mem_end - dma_p->mem_start + 1);
-			kfree(dma_p);
-		error4:
-			return rc;			
-	break;
+/* Bytes the DMA moves for a command, 0 if it moves none or the command is malformed */
+static unsigned int title_dma_len(struct title_instance *inst, int input_command, int dimension, int start)
+{
+	const struct title_dimension *d = NULL;
+	unsigned int dma_len = 0;
+
+	mutex_lock(&inst->queue_lock);
+	if(dimension >= 0 && (unsigned int)dimension < inst->geometry.count)
+		d = &inst->geometry.dimensions[dimension];
+
+	switch(input_command)
+	{
+	case IP_COMMAND_LOAD_LETTER_DATA:
+		dma_len = LETTER_DATA_LEN;
+		break;
+
+	case IP_COMMAND_LOAD_LETTER_MATRIX:
+		if(d)
+			dma_len = d->letter_matrix_words*2;
+		break;
+
+	case IP_COMMAND_LOAD_TEXT:
+		if(dimension > 0 && dimension <= TEXT_WORDS && start <= TEXT_WORDS - dimension)
+			dma_len = dimension*2;
+		break;
+
+	case IP_COMMAND_LOAD_POSSITION:
+		if(start < 0)
+			dma_len = POSSITION_LEN;
+		else if(dimension > 0 && start <= POSSITION_LEN/2 - dimension)
+			dma_len = dimension*2;
+		break;
+
+	case IP_COMMAND_LOAD_PHOTO:
+	case IP_COMMAND_SEND_FROM_BRAM:
+		if(d)
+			dma_len = BAND_LEN(d);
+		break;
+	}
+	mutex_unlock(&inst->queue_lock);
+	return dma_len;
+}
+
+static int ip_probe(struct platform_device *pdev, struct title_instance *inst)
+{
+	struct resource *r_mem;
+	struct title_info *title_p;
+	int rc = 0;
+
+	if(inst->title_p)
+	{
+		printk(KERN_ALERT "[title_probe] title-ip%d probed twice\n", inst->id);
+		return -EBUSY;
+	}
+
+	r_mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+	if(!r_mem)
+	{
+		printk(KERN_ALERT "[title_probe] Failed to get reg resource.\n");
+		return -ENODEV;
+	}
 	
+	printk(KERN_ALERT "[title_probe] Probing title-ip%d\n", inst->id);
 	
-	case 1:
-		
-		r_mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-		if(!r_mem)
-		{
-			printk(KERN_ALERT "[title_probe] Failed to get reg resource.\n");
-			return -ENODEV;
-		}
-		
-		printk(KERN_ALERT "[title_probe] Probing title_p\n");
-		
-		title_p = (struct title_info *) kmalloc(sizeof(struct title_info), GFP_KERNEL);
-		if(!title_p) 
-		{
-			printk(KERN_ALERT "[title_probe] Could not allocate TITLE device\n");
-			return -ENOMEM;
-		}
+	title_p = (struct title_info *) kmalloc(sizeof(struct title_info), GFP_KERNEL);
+	if(!title_p) 
+	{
+		printk(KERN_ALERT "[title_probe] Could not allocate TITLE device\n");
+		return -ENOMEM;
+	}
 
-		title_p->mem_start = r_mem->start;
-		title_p->mem_end = r_mem->end;
+	title_p->mem_start = r_mem->start;
+	title_p->mem_end = r_mem->end;
 
-		if(!request_mem_region(title_p->mem_start, title_p->mem_end - title_p->mem_start + 1, DEVICE_NAME)) 
-		{
-			printk(KERN_ALERT "[title_probe] Could not lock memory region at %p\n",(void *)title_p->mem_start);
-			rc = -EBUSY;
-			goto error1;
-		}
+	if(!request_mem_region(title_p->mem_start, title_p->mem_end - title_p->mem_start + 1, DEVICE_NAME)) 
+	{
+		printk(KERN_ALERT "[title_probe] Could not lock memory region at %p\n",(void *)title_p->mem_start);
+		rc = -EBUSY;
+		goto error1;
+	}
 
-		title_p->base_addr = ioremap(title_p->mem_start, title_p->mem_end - title_p->mem_start + 1);
-		if (!title_p->base_addr) 
-		{
-			printk(KERN_ALERT "[title_probe] Could not allocate memory\n");
-			rc = -EIO;
-			goto error2;
-		}
+	title_p->base_addr = ioremap(title_p->mem_start, title_p->mem_end - title_p->mem_start + 1);
+	if (!title_p->base_addr) 
+	{
+		printk(KERN_ALERT "[title_probe] Could not allocate memory\n");
+		rc = -EIO;
+		goto error2;
+	}
+	
+	// printk(KERN_INFO "[title_probe] title-ip base address start at %x\n", title_p->base_addr);
 		
-		// printk(KERN_INFO "[title_probe] title-ip base address start at %x\n", title_p->base_addr);
-			
-		title_p->irq_num0 = platform_get_irq(pdev, 0);
-        title_p->irq_num1 = platform_get_irq(pdev, 1);
+	title_p->irq_num0 = platform_get_irq(pdev, 0);
+	title_p->irq_num1 = platform_get_irq(pdev, 1);
 
-		if(!title_p->irq_num0 || !title_p->irq_num1)
-		{
-			printk(KERN_ERR "[title_probe] Could not get IRQ resource\n");
-			rc = -ENODEV;
-			goto error2;
-		}
+	if(title_p->irq_num0 <= 0 || title_p->irq_num1 <= 0)
+	{
+		printk(KERN_ERR "[title_probe] Could not get IRQ resource\n");
+		rc = -ENODEV;
+		goto error3;
+	}
 
-		if (request_irq(title_p->irq_num0, title_command_isr, IRQF_TRIGGER_RISING, DEVICE_NAME, title_p)) {
-			printk(KERN_ERR "[title_probe] Could not register IRQ0 %d\n", title_p->irq_num0);
-			return -EIO;
-			goto error3;
-		}
-		else {
-            printk(KERN_INFO "[title_probe] Registered IRQ0 %d\n", title_p->irq_num0);
-		}
-        
-        if (request_irq(title_p->irq_num1, title_frame_isr, IRQF_TRIGGER_RISING, DEVICE_NAME, title_p)) {
-			printk(KERN_ERR "[title_probe] Could not register IRQ1 %d\n", title_p->irq_num1);
-			return -EIO;
-			goto error33;
-		}
-		else {
-			printk(KERN_INFO "[title_probe] Registered IRQ1 %d\n", title_p->irq_num1);
-		}
-		
-		enable_irq(title_p->irq_num0);
-        enable_irq(title_p->irq_num1);
+	/* The ISRs get the instance, so every core's interrupts land on its own state */
+	if (request_irq(title_p->irq_num0, title_command_isr, IRQF_TRIGGER_RISING, DEVICE_NAME, inst)) {
+		printk(KERN_ERR "[title_probe] Could not register IRQ0 %d\n", title_p->irq_num0);
+		rc = -EIO;
+		goto error3;
+	}
+	else {
+		printk(KERN_INFO "[title_probe] Registered IRQ0 %d for title-ip%d\n", title_p->irq_num0, inst->id);
+	}
+	
+	if (request_irq(title_p->irq_num1, title_frame_isr, IRQF_TRIGGER_RISING, DEVICE_NAME, inst)) {
+		printk(KERN_ERR "[title_probe] Could not register IRQ1 %d\n", title_p->irq_num1);
+		rc = -EIO;
+		goto error33;
+	}
+	else {
+		printk(KERN_INFO "[title_probe] Registered IRQ1 %d for title-ip%d\n", title_p->irq_num1, inst->id);
+	}
 
-		iowrite32(IP_COMMAND_RESET, title_p->base_addr);
-		// printk(KERN_INFO "[title_probe] TITLE IP reset\n");
+	inst->node_title = device_create(my_class, &pdev->dev, MKDEV(MAJOR(my_dev_id), 2*inst->id), inst, "title-ip%d", inst->id);
+	if(IS_ERR(inst->node_title))
+	{
+		printk(KERN_ERR "[title_probe] Failed to create device title-ip%d\n", inst->id);
+		rc = PTR_ERR(inst->node_title);
+		goto error333;
+	}
+	
+	inst->partial_loads = of_property_read_bool(pdev->dev.of_node, "partial-loads");
+	title_read_geometry(pdev, inst);
 
-		return 0;
+	iowrite32(IP_COMMAND_RESET, title_p->base_addr);
+	// printk(KERN_INFO "[title_probe] TITLE IP reset\n");
 
-		error33:
-            free_irq(title_p->irq_num0, title_p);           
-        error3:
-			iounmap(title_p->base_addr);
-		error2:
-			release_mem_region(title_p->mem_start, title_p->mem_end - title_p->mem_start + 1);
-			kfree(title_p);
-		error1:
-			return rc;			
-	break;
-	
-	default:
-		// printk(KERN_INFO "[title_probe] Device FSM in illegal state.\n");
-		return -1;
-	break;
-    }
+	inst->title_p = title_p;
+	platform_set_drvdata(pdev, inst);
+	return 0;
+
+	error333:
+		free_irq(title_p->irq_num1, inst);
+	error33:
+		free_irq(title_p->irq_num0, inst);           
+	error3:
+		iounmap(title_p->base_addr);
+	error2:
+		release_mem_region(title_p->mem_start, title_p->mem_end - title_p->mem_start + 1);
+	error1:
+		kfree(title_p);
+		return rc;			
+}
+
+static int title_probe(struct platform_device *pdev) 
+{
+	struct title_instance *inst;
+	int is_dma = of_device_is_compatible(pdev->dev.of_node, "dma_ip");
+	int rc;
+
+	if(!is_dma && !of_device_is_compatible(pdev->dev.of_node, "title_ip"))
+	{
+		// printk(KERN_INFO "[title_probe] Unknown compatible\n");
+		return -ENODEV;
+	}
+
+	mutex_lock(&instances_lock);
+	inst = title_get_instance(title_instance_id(pdev, is_dma));
+	if(!inst)
+	{
+		mutex_unlock(&instances_lock);
+		return -ENOMEM;
+	}
+
+	rc = is_dma ? dma_probe(pdev, inst) : ip_probe(pdev, inst);
+	if(rc)
+	{
+		title_put_instance(inst);
+	}
+	else
+	{
+		mutex_lock(&inst->queue_lock);
+		inst->present = inst->title_p && inst->dma_p;
+		mutex_unlock(&inst->queue_lock);
+	}
+	mutex_unlock(&instances_lock);
+	return rc;
 }
 
 static int title_remove(struct platform_device *pdev) 
 {
-	switch (device_fsm)
+	struct title_instance *inst = platform_get_drvdata(pdev);
+	struct title_info *title_p, *dma_p;
+
+	mutex_lock(&instances_lock);
+
+	/* Waiting jobs fail and no new one starts; the one on the IP still needs both halves */
+	mutex_lock(&inst->queue_lock);
+	inst->present = 0;
+	wake_up_all(&inst->queue_wait);
+	mutex_unlock(&inst->queue_lock);
+	wait_event(inst->queue_wait, !READ_ONCE(inst->running));
+
+	if(of_device_is_compatible(pdev->dev.of_node, "title_ip"))
 	{
-	case 0: 
-		printk(KERN_ALERT "[title_remove] title_p device platform driver removed\n");
+		printk(KERN_ALERT "[title_remove] title-ip%d device platform driver removed\n", inst->id);
+		title_p = inst->title_p;
+		device_destroy(my_class, MKDEV(MAJOR(my_dev_id), 2*inst->id));
 		// iowrite32(0, title_p->base_addr);
-		free_irq(title_p->irq_num0, title_p);
-        free_irq(title_p->irq_num1, title_p);
+		free_irq(title_p->irq_num0, inst);
+		free_irq(title_p->irq_num1, inst);
 
 		// printk(KERN_INFO "[title_remove] IRQ numbers for title free\n");
 		
-        iounmap(title_p->base_addr);
+		iounmap(title_p->base_addr);
 		release_mem_region(title_p->mem_start, title_p->mem_end - title_p->mem_start + 1);
 		kfree(title_p);
-	break;
-
-	case 1:
-		printk(KERN_ALERT "[title_remove] dma_p platform driver removed\n");
+		inst->title_p = NULL;
+	}
+	else
+	{
+		printk(KERN_ALERT "[title_remove] dma%d platform driver removed\n", inst->id);
+		dma_p = inst->dma_p;
+		device_destroy(my_class, MKDEV(MAJOR(my_dev_id), 2*inst->id + 1));
 		// iowrite32(0, dma_p->base_addr);
 		//free_irq(dma_p->irq_num, NULL);
 		// printk(KERN_INFO "[title_remove] IRQ numbers for dma free\n");
+		dma_free_coherent(inst->dma_dev, TITLE_DMA_BUFFER_LEN, inst->tx_vir_buffer, inst->tx_phy_buffer);
+		inst->tx_vir_buffer = NULL;
+		inst->dma_dev = NULL;
 		iounmap(dma_p->base_addr);
 		release_mem_region(dma_p->mem_start, dma_p->mem_end - dma_p->mem_start + 1);
 		kfree(dma_p);
-		--device_fsm;
-	break;
-
-	default:
-		// printk(KERN_INFO "[title_remove] Device FSM in illegal state. \n");
-		return -1;
+		inst->dma_p = NULL;
 	}
+	title_put_instance(inst);
+	mutex_unlock(&instances_lock);
 	
 	// printk(KERN_INFO "[title_remove] Succesfully removed driver\n");
 	return 0;
 }
 
 
+/* -------------------------------------- */
+/* ------------JOB SCHEDULING------------ */
+/* -------------------------------------- */
+
+/*
+ * Every write() to title-ipN is a job. Jobs of one client run in order,
+ * clients with waiting jobs take turns: the client at the head of
+ * run_queue runs up to its weight in jobs, then goes to the tail. A
+ * client holding the IP with TITLE_IOC_LOCK is the only one served until
+ * it unlocks. The job handed the IP is inst->running until title_job_done.
+ */
+
+/* Hands the IP to the next job if it is free, called with queue_lock held */
+static void title_schedule(struct title_instance *inst)
+{
+	struct title_client *client;
+	struct title_job *job;
+
+	if(inst->running)
+		return;
+
+	/* A half is gone: waiting jobs give up, title_remove waits for the IP to go idle */
+	if(!inst->present)
+	{
+		wake_up_all(&inst->queue_wait);
+		return;
+	}
+
+	if(inst->owner && inst->owner->locked)
+	{
+		client = inst->owner;
+		if(list_empty(&client->jobs))
+			return;
+	}
+	else
+	{
+		if(list_empty(&inst->run_queue))
+		{
+			inst->owner = NULL;
+			return;
+		}
+		client = list_first_entry(&inst->run_queue, struct title_client, node);
+	}
+
+	job = list_first_entry(&client->jobs, struct title_job, node);
+	list_del(&job->node);
+	inst->owner = client;
+	inst->running = job;
+	job->running = 1;
+	wake_up_all(&inst->queue_wait);
+}
+
+/* Queues the job and waits until it owns the IP */
+static int title_job_begin(struct title_client *client, struct title_job *job)
+{
+	struct title_instance *inst = client->inst;
+	int ret;
+
+	job->running = 0;
+
+	mutex_lock(&inst->queue_lock);
+	if(!inst->present)
+	{
+		mutex_unlock(&inst->queue_lock);
+		return -ENODEV;
+	}
+	list_add_tail(&job->node, &client->jobs);
+	if(list_empty(&client->node))
+	{
+		client->credit = client->weight;
+		list_add_tail(&client->node, &inst->run_queue);
+	}
+	title_schedule(inst);
+	mutex_unlock(&inst->queue_lock);
+
+	ret = wait_event_interruptible(inst->queue_wait, READ_ONCE(job->running) || !READ_ONCE(inst->present));
+
+	mutex_lock(&inst->queue_lock);
+	if(job->running)
+	{
+		/* Handed over, maybe while a signal came in; the caller runs it and calls title_job_done */
+		mutex_unlock(&inst->queue_lock);
+		return 0;
+	}
+	list_del(&job->node);
+	if(list_empty(&client->jobs))
+		list_del_init(&client->node);
+	mutex_unlock(&inst->queue_lock);
+	return ret ? -ERESTARTSYS : -ENODEV;
+}
+
+static void title_job_done(struct title_client *client)
+{
+	struct title_instance *inst = client->inst;
+
+	mutex_lock(&inst->queue_lock);
+	inst->running = NULL;
+
+	if(list_empty(&client->jobs))
+	{
+		list_del_init(&client->node);
+	}
+	else if(--client->credit == 0)
+	{
+		client->credit = client->weight;
+		list_move_tail(&client->node, &inst->run_queue);
+	}
+
+	title_schedule(inst);
+	mutex_unlock(&inst->queue_lock);
+}
+
+/* Blocks until the client owns the IP with nothing running, then keeps it across jobs */
+static int title_lock(struct title_client *client)
+{
+	struct title_job job;
+	int ret;
+
+	if(client->locked)
+		return 0;
+
+	/* An empty job: once it is handed the IP, the client is the owner */
+	ret = title_job_begin(client, &job);
+	if(ret)
+		return ret;
+	client->locked = 1;
+	title_job_done(client);
+	return 0;
+}
+
+static void title_unlock(struct title_client *client)
+{
+	struct title_instance *inst = client->inst;
+
+	mutex_lock(&inst->queue_lock);
+	client->locked = 0;
+	if(inst->owner == client && !inst->running)
+	{
+		inst->owner = NULL;
+		title_schedule(inst);
+	}
+	mutex_unlock(&inst->queue_lock);
+}
+
+static long title_ioctl(struct file *pfile, unsigned int cmd, unsigned long arg)
+{
+	struct title_client *client = pfile->private_data;
+	struct title_instance *inst = client->inst;
+	int weight, resident = 0, present;
+	struct title_dimensions geometry;
+
+	if(MINOR_IS_DMA(iminor(pfile->f_inode)))
+		return -ENOTTY;
+
+	mutex_lock(&inst->queue_lock);
+	present = inst->present;
+	mutex_unlock(&inst->queue_lock);
+	if(!present)
+		return -ENODEV;
+
+	switch(cmd)
+	{
+	case TITLE_IOC_LOCK:
+		return title_lock(client);
+
+	case TITLE_IOC_UNLOCK:
+		title_unlock(client);
+		return 0;
+
+	case TITLE_IOC_SET_WEIGHT:
+		if(get_user(weight, (int __user *)arg))
+			return -EFAULT;
+		if(weight < 1 || weight > TITLE_MAX_WEIGHT)
+			return -EINVAL;
+		mutex_lock(&client->inst->queue_lock);
+		client->weight = weight;
+		if(client->credit > weight)
+			client->credit = weight;
+		mutex_unlock(&client->inst->queue_lock);
+		return 0;
+
+	case TITLE_IOC_GET_GEOMETRY:
+		mutex_lock(&inst->queue_lock);
+		geometry = inst->geometry;
+		mutex_unlock(&inst->queue_lock);
+		return copy_to_user((void __user *)arg, &geometry, sizeof(geometry)) ? -EFAULT : 0;
+
+	case TITLE_IOC_SET_GEOMETRY:
+		if(!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		if(copy_from_user(&geometry, (void __user *)arg, sizeof(geometry)))
+			return -EFAULT;
+		if(title_check_geometry(&geometry))
+			return -EINVAL;
+		mutex_lock(&inst->queue_lock);
+		/* Only between jobs, title_write checks its length again once the IP is its own */
+		if(!client->locked || inst->owner != client)
+		{
+			mutex_unlock(&inst->queue_lock);
+			return -EBUSY;
+		}
+		inst->geometry = geometry;
+		inst->letter_matrix_owner = NULL;
+		mutex_unlock(&inst->queue_lock);
+		printk(KERN_INFO "[title_ioctl] title-ip%d has %u dimension codes\n", inst->id, geometry.count);
+		return 0;
+
+	case TITLE_IOC_RESIDENT:
+		mutex_lock(&inst->queue_lock);
+		if(inst->letter_data_owner == client)
+			resident |= TITLE_RESIDENT_LETTER_DATA;
+		if(inst->letter_matrix_owner == client)
+			resident |= TITLE_RESIDENT_LETTER_MATRIX;
+		if(inst->text_owner == client)
+			resident |= TITLE_RESIDENT_TEXT;
+		if(inst->position_owner == client)
+			resident |= TITLE_RESIDENT_POSITION;
+		mutex_unlock(&inst->queue_lock);
+		return put_user(resident, (int __user *)arg);
+
+	default:
+		return -ENOTTY;
+	}
+}
+
+
 /* -------------------------------------- */
 /* ------OPEN AND CLOSE FUNCTIONS-------- */
 /* -------------------------------------- */
 
 int title_open(struct inode *pinode, struct file *pfile)
 {
+	struct title_instance *inst;
+	struct title_client *client;
+	int id = MINOR_INSTANCE(iminor(pinode));
+
+	client = kzalloc(sizeof(struct title_client), GFP_KERNEL);
+	if(!client)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&client->node);
+	INIT_LIST_HEAD(&client->jobs);
+	client->weight = 1;
+
+	mutex_lock(&instances_lock);
+	inst = instances[id];
+	/* A node exists as soon as its half is probed, the instance is usable once both are */
+	if(!inst || !inst->present)
+	{
+		mutex_unlock(&instances_lock);
+		kfree(client);
+		return -ENODEV;
+	}
+	kref_get(&inst->ref);
+	client->inst = inst;
+	pfile->private_data = client;
+	mutex_unlock(&instances_lock);
+
 //	printk(KERN_INFO "TITLE FILE OPENED\n");
 	return 0;
 }
 
 int title_close(struct inode *pinode, struct file *pfile)
 {
+	struct title_client *client = pfile->private_data;
+	struct title_instance *inst = client->inst;
+
+	/* No write() of this file can be waiting any more, only a lock may be left */
+	title_unlock(client);
+
+	/* A later client could get the same address */
+	mutex_lock(&inst->queue_lock);
+	if(inst->letter_data_owner == client)
+		inst->letter_data_owner = NULL;
+	if(inst->letter_matrix_owner == client)
+		inst->letter_matrix_owner = NULL;
+	if(inst->text_owner == client)
+		inst->text_owner = NULL;
+	if(inst->position_owner == client)
+		inst->position_owner = NULL;
+	mutex_unlock(&inst->queue_lock);
+	kfree(client);
+	kref_put(&inst->ref, title_free_instance);
 //	printk(KERN_INFO "TITLE FILE CLOSE\n");
 	return 0;
 }
@@ -555,25 +1119,19 @@ int title_close(struct inode *pinode, struct file *pfile)
 /* -------READ AND WRITE FUNCTIONS------- */
 /* -------------------------------------- */
 
-int transaction_over = 0;
-volatile int ip_command_over = 0;
-volatile int ip_frame_over = 0;
-int input_command;
-int dimension;
-int offset;
-
 ssize_t title_read(struct file *pfile, char __user *buf, size_t length, loff_t *offset)
 {   
     char buff[BUFF_SIZE];
     int ret = 0;
-	int minor = MINOR(pfile->f_inode->i_rdev);
+	struct title_client *client = pfile->private_data;
+	struct title_instance *inst = client->inst;
     long int len;
 
-	switch(minor)
+	switch(MINOR_IS_DMA(iminor(pfile->f_inode)))
 	{
 	// Reading from TITLE 
 	case 0:
-	    len = scnprintf(buff, BUFF_SIZE, "%d\n", ip_frame_over);
+	    len = scnprintf(buff, BUFF_SIZE, "%d\n", inst->ip_frame_over);
         ret = copy_to_user(buf, buff, len);
         if(ret)
             return -EFAULT;
@@ -600,7 +1158,21 @@ ssize_t title_write(struct file *pfile, const char __user *buf, size_t length, l
 {
 	char buff[BUFF_SIZE]; 
 	int ret = 0;
-	int minor = MINOR(pfile->f_inode->i_rdev);
+	struct title_client *client = pfile->private_data;
+	struct title_instance *inst = client->inst;
+	struct title_job job;
+	int input_command, dimension, fields;
+	unsigned int buffer_offset = 0;
+	int start = -1;
+	unsigned int dma_len = 0;
+	int to_device = 1;
+	u64 spin_ns;
+
+	if(length >= BUFF_SIZE)
+	{
+		printk(KERN_WARNING "[title_write] Command longer than %d bytes\n", BUFF_SIZE - 1);
+		return -EINVAL;
+	}
 	ret = copy_from_user(buff, buf, length);  
 	if(ret)
 	{
@@ -609,14 +1181,22 @@ ssize_t title_write(struct file *pfile, const char __user *buf, size_t length, l
 	}  
 	buff[length] = '\0';
 	
-	switch(minor)
+	switch(MINOR_IS_DMA(iminor(pfile->f_inode)))
 	{
 		// Writing into CNN 
 		case 0:
 			// printk(KERN_INFO "[title_write] Writing into title-ip");
-			sscanf(buff, "%d,%d,%d", &input_command, &dimension, &offset);  
+			/* command,dimension,offset[,buffer_offset[,start]], see title_ioctl.h */
+			fields = sscanf(buff, "%d,%d,%d,%u,%d", &client->input_command, &client->dimension, &client->offset, &buffer_offset, &start);
+			if(fields < 3 || (fields == 5 && start < 0))
+			{
+				printk(KERN_WARNING "[title_write] Malformed TITLE command\n");
+				return -EINVAL;
+			}
+			input_command = client->input_command;
+			dimension = client->dimension;
 			
-            if(offset == 0)
+            if(client->offset == 0)
             {
 			    // Check if command is valid //
 	
@@ -630,103 +1210,123 @@ ssize_t title_write(struct file *pfile, const char __user *buf, size_t length, l
 			       input_command != IP_COMMAND_RESET)
 			    {
 				    printk(KERN_WARNING "[title_write] Wrong TITLE command! %d\n", input_command);
-				    return 0;
+				    return -EINVAL;
 			    }
 					
 
-			    switch(input_command)
-			    {
-			    // Write command 
-			    case IP_COMMAND_LOAD_LETTER_DATA:
-				    dma_simple_write(tx_phy_buffer, LETTER_DATA_LEN, dma_p->base_addr);
-				    // printk(KERN_INFO "[title_write] Starting DMA transaction: LOAD LETTER_DATA\n");
-		    	break;
-			
-			    case IP_COMMAND_LOAD_LETTER_MATRIX:
-                    if(dimension == 0)
-				        dma_simple_write(tx_phy_buffer, D0_LETTER_MATRIX_LEN, dma_p->base_addr);
-				    else if(dimension == 1)
-				        dma_simple_write(tx_phy_buffer, D1_LETTER_MATRIX_LEN, dma_p->base_addr);
-                    else if(dimension == 2)
-				        dma_simple_write(tx_phy_buffer, D2_LETTER_MATRIX_LEN, dma_p->base_addr);
-                    else if(dimension == 3)
-				        dma_simple_write(tx_phy_buffer, D3_LETTER_MATRIX_LEN, dma_p->base_addr);
-                    else if(dimension == 4)
-				        dma_simple_write(tx_phy_buffer, D4_LETTER_MATRIX_LEN, dma_p->base_addr);
-                    
-                    // printk(KERN_INFO "[title_write] Starting DMA transaction: LOAD LETTER_MATRIX\n");
-			    break;
-			
-			    case IP_COMMAND_LOAD_TEXT:
-				    dma_simple_write(tx_phy_buffer, dimension*2, dma_p->base_addr);
-				    // printk(KERN_INFO "[title_write] Starting DMA transaction: LOAD TEXT\n");
-			    break;
-			
-			    case IP_COMMAND_LOAD_POSSITION:
-				    dma_simple_write(tx_phy_buffer, POSSITION_LEN, dma_p->base_addr);
-				    // printk(KERN_INFO "[title_write] Starting DMA transaction: LOAD POSSITION\n");
-			    break;
-			
-			    case IP_COMMAND_LOAD_PHOTO:
-                    if(dimension == 0)
-				        dma_simple_write(tx_phy_buffer, D0_BRAM*D0_WIDTH*3*2, dma_p->base_addr);
-				    else if(dimension == 1)
-				        dma_simple_write(tx_phy_buffer, D1_BRAM*D1_WIdTH*3*2, dma_p->base_addr);
-                    else if(dimension == 2)
-				        dma_simple_write(tx_phy_buffer, D2_BRAM*D2_WIDTH*3*2, dma_p->base_addr);
-                    else if(dimension == 3)
-				        dma_simple_write(tx_phy_buffer, D3_BRAM*D3_WIDTH*3*2, dma_p->base_addr);
-                    else if(dimension == 4)
-				        dma_simple_write(tx_phy_buffer, D4_BRAM*D4_WIDTH*3*2, dma_p->base_addr);
-				
-				    // printk(KERN_INFO "[title_write] Starting DMA transaction: LOAD PHOTO\n");
-			    break;
-			
+			    dma_len = title_dma_len(inst, input_command, dimension, start);
+			    // SEND_FROM_BRAM is the only read
+			    to_device = input_command != IP_COMMAND_SEND_FROM_BRAM;
 
-			    // Read command 
-			    case IP_COMMAND_SEND_FROM_BRAM:
-                    if(dimension == 0)
-				        dma_simple_read(tx_phy_buffer, D0_BRAM*D0_WIDTH*3*2, dma_p->base_addr);
-				    else if(dimension == 1)
-				        dma_simple_read(tx_phy_buffer, D1_BRAM*D1_WIDTH*3*2, dma_p->base_addr);
-                    else if(dimension == 2)
-				        dma_simple_read(tx_phy_buffer, D2_BRAM*D2_WIDTH*3*2, dma_p->base_addr);
-                    else if(dimension == 3)
-				        dma_simple_read(tx_phy_buffer, D3_BRAM*D3_WIDTH*3*2, dma_p->base_addr);
-                    else if(dimension == 4)
-				        dma_simple_read(tx_phy_buffer, D4_BRAM*D4_WIDTH*3*2, dma_p->base_addr);
-				    
-				    // printk(KERN_INFO "[title_write] Starting DMA transaction: SEND FROM BRAM\n");
-			    break;
+                if(!dma_len && input_command != IP_COMMAND_PROCESSING && input_command != IP_COMMAND_RESET)
+                {
+                    printk(KERN_WARNING "[title_write] No transfer length for command %d dimension %d\n", input_command, dimension);
+                    return -EINVAL;
+                }
+                if(start >= 0)
+                {
+                    if(input_command != IP_COMMAND_LOAD_TEXT && input_command != IP_COMMAND_LOAD_POSSITION)
+                    {
+                        printk(KERN_WARNING "[title_write] Command %d has no start word\n", input_command);
+                        return -EINVAL;
+                    }
+                    if(!inst->partial_loads)
+                        return -EOPNOTSUPP;
+                }
+                if(buffer_offset % TITLE_DMA_ALIGN || dma_len > TITLE_DMA_BUFFER_LEN || buffer_offset > TITLE_DMA_BUFFER_LEN - dma_len)
+                {
+                    printk(KERN_WARNING "[title_write] Transfer of %u bytes at %u is outside the DMA buffer\n", dma_len, buffer_offset);
+                    return -EINVAL;
+                }
 
-			
-			    default:
-				    // NOT A LOAD OR READ COMMAND
-			    break;
-			    }
+                /* From here on the IP and the DMA buffer belong to this job */
+                ret = title_job_begin(client, &job);
+                if(ret)
+                    return ret;
+
+                /* The geometry may have been replaced while the job waited, it stays as it is until title_job_done */
+                if(title_dma_len(inst, input_command, dimension, start) != dma_len)
+                {
+                    title_job_done(client);
+                    return -EAGAIN;
+                }
+
+                /* Patching a memory makes sense only on top of this client's own contents */
+                if((start > 0 || (start == 0 && input_command == IP_COMMAND_LOAD_POSSITION)) &&
+                   (input_command == IP_COMMAND_LOAD_TEXT ? inst->text_owner : inst->position_owner) != client)
+                {
+                    title_job_done(client);
+                    return -ESTALE;
+                }
+                if(inst->partial_loads &&
+                   (input_command == IP_COMMAND_LOAD_TEXT || input_command == IP_COMMAND_LOAD_POSSITION))
+                    iowrite32(start < 0 ? 0 : start, inst->title_p->base_addr + LOAD_START_OFFSET);
+
+                if(dma_len)
+                {
+                    title_stats_dma_start(inst, to_device, dma_len);
+                    if(to_device)
+                        dma_simple_write(inst->tx_phy_buffer + buffer_offset, dma_len, inst->dma_p->base_addr);
+                    else
+                        dma_simple_read(inst->tx_phy_buffer + buffer_offset, dma_len, inst->dma_p->base_addr);
+                }
 
 			    // Write into TITLE IP 
-			    ip_command_over = 0;
-                ip_frame_over = 0;
-                iowrite32((u32)input_command, title_p->base_addr);
+			    inst->input_command = input_command;
+			    inst->dimension = dimension;
+			    inst->offset = client->offset;
+			    inst->ip_command_over = 0;
+                inst->ip_frame_over = 0;
+                this_cpu_inc(title_stats.command_count[ffs(input_command) - 1]);
+                trace_title_ip_command(inst->id, input_command, dimension, client->offset);
+                inst->ip_command_start = ktime_get_ns();
+                iowrite32((u32)input_command, inst->title_p->base_addr);
 			    
                 if(input_command != IP_COMMAND_RESET && input_command != IP_COMMAND_PROCESSING)
 			    {
-				    while(ip_command_over != 1);
+				    while(inst->ip_command_over != 1);
 			    }
                 else if(input_command == IP_COMMAND_PROCESSING)
                 {
-                    while(ip_command_over != 1 && ip_frame_over != 1);
+                    while(inst->ip_command_over != 1 && inst->ip_frame_over != 1);
                 }
 
+                spin_ns = ktime_get_ns() - inst->ip_command_start;
+                this_cpu_add(title_stats.spin_ns, spin_ns);
+                if(input_command == IP_COMMAND_RESET)
+                    trace_title_ip_done(inst->id, input_command, 0, spin_ns);
+
 		        // printk(KERN_INFO "[title_write] Writing finished!");
-		        ip_command_over = 0;
-		        transaction_over = 0;
+		        inst->ip_command_over = 0;
+		        inst->transaction_over = 0;
+
+                mutex_lock(&inst->queue_lock);
+                if(input_command == IP_COMMAND_LOAD_LETTER_DATA)
+                    inst->letter_data_owner = client;
+                else if(input_command == IP_COMMAND_LOAD_LETTER_MATRIX)
+                    inst->letter_matrix_owner = client;
+                else if(input_command == IP_COMMAND_LOAD_TEXT)
+                    inst->text_owner = client;
+                else if(input_command == IP_COMMAND_LOAD_POSSITION)
+                    inst->position_owner = client;
+                else if(input_command == IP_COMMAND_RESET)
+                {
+                    inst->letter_data_owner = NULL;
+                    inst->letter_matrix_owner = NULL;
+                    inst->text_owner = NULL;
+                    inst->position_owner = NULL;
+                }
+                mutex_unlock(&inst->queue_lock);
+                title_job_done(client);
 
             }
-            else if(offset == 1)
+            else if(client->offset == 1)
             {
-                iowrite32((u32)input_command, title_p->base_addr+AXI_OFFSET);
+                ret = title_job_begin(client, &job);
+                if(ret)
+                    return ret;
+                iowrite32((u32)input_command, inst->title_p->base_addr+AXI_OFFSET);
+                title_job_done(client);
             }
 
 
@@ -752,18 +1352,28 @@ ssize_t title_write(struct file *pfile, const char __user *buf, size_t length, l
 
 static int title_mmap(struct file *f, struct vm_area_struct *vma_s)
 {
+	struct title_client *client = f->private_data;
+	struct title_instance *inst = client->inst;
 	int ret = 0;
 	long length = vma_s->vm_end - vma_s->vm_start;
 
 	// printk(KERN_INFO "[title_dma_mmap] DMA TX Buffer is being memory mapped\n");
 
-	if(length > MAX_PKT_LEN)
+	if(length > TITLE_DMA_BUFFER_LEN)
 	{
 		return -EIO;
 		printk(KERN_ERR "[title_dma_mmap] Trying to mmap more space than it's allocated\n");
 	}
 
-	ret = dma_mmap_coherent(my_device_dma, vma_s, tx_vir_buffer, tx_phy_buffer, length);
+	/* title_remove frees the buffer only after clearing present under queue_lock */
+	mutex_lock(&inst->queue_lock);
+	if(!inst->present)
+	{
+		mutex_unlock(&inst->queue_lock);
+		return -ENODEV;
+	}
+	ret = dma_mmap_coherent(inst->dma_dev, vma_s, inst->tx_vir_buffer, inst->tx_phy_buffer, length);
+	mutex_unlock(&inst->queue_lock);
 	if(ret < 0)
 	{
 		printk(KERN_ERR "[title_dma_mmap] Memory map failed\n");
@@ -778,13 +1388,15 @@ static int title_mmap(struct file *f, struct vm_area_struct *vma_s)
 
 static irqreturn_t dma_MM2S_isr(int irq, void* dev_id)
 {
+	struct title_instance *inst = dev_id;
 	unsigned int IrqStatus;  
 	
-	IrqStatus = ioread32(dma_p->base_addr + MM2S_STATUS_REGISTER);
-	iowrite32(IrqStatus | 0x00005000, dma_p->base_addr + MM2S_STATUS_REGISTER);
+	IrqStatus = ioread32(inst->dma_p->base_addr + MM2S_STATUS_REGISTER);
+	iowrite32(IrqStatus | 0x00005000, inst->dma_p->base_addr + MM2S_STATUS_REGISTER);
 	
 	// Tell rest of the code that interrupt has happened 
-	transaction_over = 0;
+	inst->transaction_over = 0;
+	title_stats_dma_done(inst);
 	
 	// printk(KERN_INFO "[dma_MM2S_isr] Finished DMA MM2S transaction!\n");
 
@@ -793,13 +1405,15 @@ static irqreturn_t dma_MM2S_isr(int irq, void* dev_id)
 
 static irqreturn_t dma_S2MM_isr(int irq, void*dev_id)
 {
+	struct title_instance *inst = dev_id;
 	unsigned int IrqStatus;  
-		
-	IrqStatus = ioread32(dma_p->base_addr + S2MM_STATUS_REGISTER);
-	iowrite32(IrqStatus | 0x00005000, dma_p->base_addr + S2MM_STATUS_REGISTER);
+	
+	IrqStatus = ioread32(inst->dma_p->base_addr + S2MM_STATUS_REGISTER);
+	iowrite32(IrqStatus | 0x00005000, inst->dma_p->base_addr + S2MM_STATUS_REGISTER);
 	
 	// Tell rest of the code that interrupt has happened 
-	transaction_over = 0;
+	inst->transaction_over = 0;
+	title_stats_dma_done(inst);
 	
 	// printk(KERN_INFO "[dma_S2MM_isr] Finished DMA S2MM transaction!\n");
 
@@ -808,14 +1422,24 @@ static irqreturn_t dma_S2MM_isr(int irq, void*dev_id)
 
 static irqreturn_t title_command_isr(int irq, void*dev_id)
 {
-	ip_command_over = 1;
+	struct title_instance *inst = dev_id;
+	u64 latency = ktime_get_ns() - inst->ip_command_start;
+
+	/* The IP only signals a finished command once the DMA stream of that command is done */
+	title_stats_dma_done(inst);
+	this_cpu_inc(title_stats.ip_latency[min(fls64(latency), STATS_HIST_BUCKETS - 1)]);
+	trace_title_ip_done(inst->id, inst->input_command, latency, 0);
+
+	inst->ip_command_over = 1;
 	//printk(KERN_INFO "[title_command_isr] IP finished operation %x\n", input_command);
 	return IRQ_HANDLED;
 }
 
 static irqreturn_t title_frame_isr(int irq, void*dev_id)
 {
-	ip_frame_over = 1;
+	struct title_instance *inst = dev_id;
+
+	inst->ip_frame_over = 1;
 	//printk(KERN_INFO "[title_frame_isr] IP finished operation %x\n", input_command);
 	return IRQ_HANDLED;
 }
@@ -963,3 +1587,174 @@ unsigned int dma_simple_read(dma_addr_t TxBufferPtr, unsigned int pkt_len, void
 	iowrite32(pkt_len, base_address + S2MM_BUFF_LENGTH_REGISTER);
 	return 0;
 }
+
+/* -------------------------------------- */
+/* ---------STATISTICS FUNCTIONS--------- */
+/* -------------------------------------- */
+
+static const char *command_names[IP_NUM_COMMANDS] = {
+	"LOAD_LETTER_DATA",
+	"LOAD_LETTER_MATRIX",
+	"LOAD_TEXT",
+	"LOAD_POSSITION",
+	"LOAD_PHOTO",
+	"PROCESSING",
+	"SEND_FROM_BRAM",
+	"RESET",
+};
+
+static void title_stats_dma_start(struct title_instance *inst, int to_device, unsigned int len)
+{
+	if(to_device)
+		this_cpu_add(title_stats.bytes_to_device, len);
+	else
+		this_cpu_add(title_stats.bytes_from_device, len);
+
+	inst->dma_to_device = to_device;
+	inst->dma_len_in_flight = len;
+	trace_title_dma_start(inst->id, to_device, len);
+	inst->dma_start = ktime_get_ns();
+}
+
+static void title_stats_dma_done(struct title_instance *inst)
+{
+	u64 latency;
+
+	if(!inst->dma_start)
+		return;
+
+	latency = ktime_get_ns() - inst->dma_start;
+	inst->dma_start = 0;
+
+	this_cpu_inc(title_stats.dma_latency[min(fls64(latency), STATS_HIST_BUCKETS - 1)]);
+	trace_title_dma_done(inst->id, inst->dma_to_device, inst->dma_len_in_flight, latency);
+}
+
+/* Sums the per-CPU copies, the result is a consistent enough snapshot for monitoring */
+static void title_stats_sum(struct title_stats *sum)
+{
+	int cpu;
+	int i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu)
+	{
+		struct title_stats *s = per_cpu_ptr(&title_stats, cpu);
+
+		for(i = 0; i < IP_NUM_COMMANDS; i++)
+			sum->command_count[i] += s->command_count[i];
+		for(i = 0; i < STATS_HIST_BUCKETS; i++)
+		{
+			sum->dma_latency[i] += s->dma_latency[i];
+			sum->ip_latency[i] += s->ip_latency[i];
+		}
+		sum->bytes_to_device += s->bytes_to_device;
+		sum->bytes_from_device += s->bytes_from_device;
+		sum->spin_ns += s->spin_ns;
+	}
+}
+
+static void title_stats_show_hist(struct seq_file *m, const u64 *hist)
+{
+	int i;
+
+	seq_printf(m, "%14s %14s %12s\n", "from_ns", "to_ns", "count");
+	for(i = 0; i < STATS_HIST_BUCKETS; i++)
+	{
+		if(!hist[i])
+			continue;
+		seq_printf(m, "%14llu %14llu %12llu\n", i ? 1ULL << (i - 1) : 0ULL, 1ULL << i, hist[i]);
+	}
+}
+
+static int commands_show(struct seq_file *m, void *v)
+{
+	struct title_stats sum;
+	int i;
+
+	title_stats_sum(&sum);
+	for(i = 0; i < IP_NUM_COMMANDS; i++)
+		seq_printf(m, "%-20s %llu\n", command_names[i], sum.command_count[i]);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(commands);
+
+static int bytes_show(struct seq_file *m, void *v)
+{
+	struct title_stats sum;
+
+	title_stats_sum(&sum);
+	seq_printf(m, "to_device   %llu\n", sum.bytes_to_device);
+	seq_printf(m, "from_device %llu\n", sum.bytes_from_device);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(bytes);
+
+static int spin_show(struct seq_file *m, void *v)
+{
+	struct title_stats sum;
+
+	title_stats_sum(&sum);
+	seq_printf(m, "%llu\n", sum.spin_ns);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(spin);
+
+static int dma_latency_show(struct seq_file *m, void *v)
+{
+	struct title_stats sum;
+
+	title_stats_sum(&sum);
+	title_stats_show_hist(m, sum.dma_latency);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dma_latency);
+
+static int ip_latency_show(struct seq_file *m, void *v)
+{
+	struct title_stats sum;
+
+	title_stats_sum(&sum);
+	title_stats_show_hist(m, sum.ip_latency);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ip_latency);
+
+/* Writing anything into "reset" clears all counters */
+static ssize_t reset_write(struct file *f, const char __user *buf, size_t length, loff_t *off)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(&title_stats, cpu), 0, sizeof(struct title_stats));
+	return length;
+}
+
+static const struct file_operations reset_fops = {
+	.owner = THIS_MODULE,
+	.write = reset_write,
+};
+
+static void title_stats_init(void)
+{
+	/* Statistics are optional, the driver works the same without debugfs */
+	stats_dir = debugfs_create_dir("title", NULL);
+	if(IS_ERR_OR_NULL(stats_dir))
+	{
+		printk(KERN_WARNING "[title_stats_init] Could not create debugfs directory\n");
+		stats_dir = NULL;
+		return;
+	}
+
+	debugfs_create_file("commands", 0444, stats_dir, NULL, &commands_fops);
+	debugfs_create_file("bytes", 0444, stats_dir, NULL, &bytes_fops);
+	debugfs_create_file("spin_ns", 0444, stats_dir, NULL, &spin_fops);
+	debugfs_create_file("dma_latency", 0444, stats_dir, NULL, &dma_latency_fops);
+	debugfs_create_file("ip_latency", 0444, stats_dir, NULL, &ip_latency_fops);
+	debugfs_create_file("reset", 0200, stats_dir, NULL, &reset_fops);
+}
+
+static void title_stats_exit(void)
+{
+	debugfs_remove_recursive(stats_dir);
+}
@@ -0,0 +1,86 @@
+/* ioctl interface of the title_ip driver, shared with userspace */
+
+#ifndef _TITLE_IOCTL_H
+#define _TITLE_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Commands are written to title-ipN as "command,dimension,offset" with an
+ * optional fourth field, the byte offset in the DMA buffer the command's
+ * transfer starts at (default 0). The buffer is mapped through dmaN and
+ * holds room for two bands plus the smaller uploads, so a client can fill
+ * one part while the IP streams another.
+ *
+ * On cores with the load start register ("partial-loads" in the device
+ * tree), LOAD_TEXT and LOAD_POSSITION take a fifth field, start: dimension
+ * words (the count for LOAD_POSSITION too) go to the memory from word start
+ * on, and after LOAD_TEXT the text ends with them. Other cores fail such a
+ * write with EOPNOTSUPP. Such a load keeps the rest of the memory (of the
+ * text, what lies before start), so it fails with ESTALE unless the client
+ * did the last load of that memory.
+ */
+#define TITLE_DMA_BUFFER_LEN        (1024*1024)
+#define TITLE_DMA_ALIGN             64
+
+#define TITLE_IOC_MAGIC             't'
+
+/*
+ * Jobs (one write() of a command each) from different open files are
+ * served round-robin. A client that needs several commands in a row on
+ * the IP, with nobody else's commands or DMA buffer contents in between
+ * (letter data, text, a band upload and its readback), locks the IP for
+ * the sequence; TITLE_IOC_LOCK blocks until the IP is handed over.
+ * Closing the file unlocks it.
+ */
+#define TITLE_IOC_LOCK              _IO(TITLE_IOC_MAGIC, 1)
+#define TITLE_IOC_UNLOCK            _IO(TITLE_IOC_MAGIC, 2)
+
+/* Jobs a client may run back to back while others wait, 1 (default) to TITLE_MAX_WEIGHT */
+#define TITLE_IOC_SET_WEIGHT        _IOW(TITLE_IOC_MAGIC, 3, int)
+
+#define TITLE_MAX_WEIGHT            16
+
+/*
+ * Which of the IP's memories still hold what this client loaded last:
+ * TITLE_RESIDENT_* bits, cleared by a RESET and by another client's load
+ * of the same memory. A client that knows what it loaded can skip the
+ * reload, or load only what changed, while it holds the lock.
+ */
+#define TITLE_IOC_RESIDENT          _IOR(TITLE_IOC_MAGIC, 4, int)
+
+#define TITLE_RESIDENT_LETTER_DATA      1
+#define TITLE_RESIDENT_LETTER_MATRIX    2
+#define TITLE_RESIDENT_TEXT             4
+#define TITLE_RESIDENT_POSITION         8
+
+/*
+ * Frame geometry per dimension code: the width of its frames, the rows of
+ * a band and the words of its letter matrix, which set the transfer
+ * lengths of LOAD_LETTER_MATRIX, LOAD_PHOTO and SEND_FROM_BRAM. The table
+ * comes from the "geometry" device tree property (three cells per code)
+ * or, without one, is the D0..D4 table of the original core. A client
+ * holding the IP with TITLE_IOC_LOCK may replace it (CAP_SYS_ADMIN) for a
+ * core built for other sizes; a band and a letter matrix of every code
+ * must fit the DMA buffer. That clears TITLE_RESIDENT_LETTER_MATRIX.
+ */
+#define TITLE_MAX_DIMENSIONS        16
+
+struct title_dimension
+{
+	__u32 width;
+	__u32 band_rows;
+	__u32 letter_matrix_words;
+};
+
+struct title_dimensions
+{
+	__u32 count;
+	struct title_dimension dimensions[TITLE_MAX_DIMENSIONS];
+};
+
+#define TITLE_IOC_GET_GEOMETRY      _IOR(TITLE_IOC_MAGIC, 5, struct title_dimensions)
+#define TITLE_IOC_SET_GEOMETRY      _IOW(TITLE_IOC_MAGIC, 6, struct title_dimensions)
+
+#endif /* _TITLE_IOCTL_H */
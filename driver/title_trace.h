@@ -0,0 +1,111 @@
+/* Tracepoints for the title_ip driver (perf / ftrace: events/title/) */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM title
+
+#if !defined(_TITLE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TITLE_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(title_ip_command,
+
+	TP_PROTO(int instance, int command, int dimension, int offset),
+
+	TP_ARGS(instance, command, dimension, offset),
+
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(int, command)
+		__field(int, dimension)
+		__field(int, offset)
+	),
+
+	TP_fast_assign(
+		__entry->instance = instance;
+		__entry->command = command;
+		__entry->dimension = dimension;
+		__entry->offset = offset;
+	),
+
+	TP_printk("ip%d command=0x%04x dimension=%d offset=%d",
+		  __entry->instance, __entry->command, __entry->dimension, __entry->offset)
+);
+
+TRACE_EVENT(title_ip_done,
+
+	TP_PROTO(int instance, int command, u64 latency_ns, u64 spin_ns),
+
+	TP_ARGS(instance, command, latency_ns, spin_ns),
+
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(int, command)
+		__field(u64, latency_ns)
+		__field(u64, spin_ns)
+	),
+
+	TP_fast_assign(
+		__entry->instance = instance;
+		__entry->command = command;
+		__entry->latency_ns = latency_ns;
+		__entry->spin_ns = spin_ns;
+	),
+
+	TP_printk("ip%d command=0x%04x latency_ns=%llu spin_ns=%llu",
+		  __entry->instance, __entry->command, __entry->latency_ns, __entry->spin_ns)
+);
+
+TRACE_EVENT(title_dma_start,
+
+	TP_PROTO(int instance, int to_device, unsigned int len),
+
+	TP_ARGS(instance, to_device, len),
+
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(int, to_device)
+		__field(unsigned int, len)
+	),
+
+	TP_fast_assign(
+		__entry->instance = instance;
+		__entry->to_device = to_device;
+		__entry->len = len;
+	),
+
+	TP_printk("dma%d %s len=%u", __entry->instance, __entry->to_device ? "MM2S" : "S2MM", __entry->len)
+);
+
+TRACE_EVENT(title_dma_done,
+
+	TP_PROTO(int instance, int to_device, unsigned int len, u64 latency_ns),
+
+	TP_ARGS(instance, to_device, len, latency_ns),
+
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(int, to_device)
+		__field(unsigned int, len)
+		__field(u64, latency_ns)
+	),
+
+	TP_fast_assign(
+		__entry->instance = instance;
+		__entry->to_device = to_device;
+		__entry->len = len;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("dma%d %s len=%u latency_ns=%llu",
+		  __entry->instance, __entry->to_device ? "MM2S" : "S2MM", __entry->len, __entry->latency_ns)
+);
+
+#endif /* _TITLE_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE title_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+#include "font.hpp"
+
+using namespace std;
+
+#define GLYPH_FIRST_SERBIAN		95
+#define GLYPH_DEGREE			105
+#define GLYPH_UNKNOWN			106
+
+/* ------------------------ */
+/* ----------Text---------- */
+/* ------------------------ */
+
+static int16_t clamp_word(int value)
+{
+	if(value < -32768) return -32768;
+	if(value > 32767) return 32767;
+	return value;
+}
+
+void title_band_positions(const TitleText &text, int left, int top, int16_t *positions)
+{
+	memset(positions, 0, TITLE_POSITION_WORDS * 2);
+
+	for(size_t run = 0; run < text.runs.size(); run++)
+	{
+		positions[2*run] = clamp_word(text.runs[run].x - left);
+		positions[2*run + 1] = clamp_word(text.runs[run].y - top);
+	}
+}
+
+bool title_append_text(TitleText &text, const TitleText &more)
+{
+	if(text.runs.size() + more.runs.size() > TITLE_MAX_RUNS ||
+	   text.codes.size() + 1 + more.codes.size() > TITLE_MAX_TEXT_WORDS) return false;
+
+	text.codes.push_back(TITLE_RUN_BREAK);
+	text.codes.insert(text.codes.end(), more.codes.begin(), more.codes.end());
+	text.runs.insert(text.runs.end(), more.runs.begin(), more.runs.end());
+
+	if(more.left == more.right) return true;
+	if(text.left == text.right)
+	{
+		text.left = more.left;
+		text.top = more.top;
+		text.right = more.right;
+		text.bottom = more.bottom;
+		return true;
+	}
+	text.left = min(text.left, more.left);
+	text.top = min(text.top, more.top);
+	text.right = max(text.right, more.right);
+	text.bottom = max(text.bottom, more.bottom);
+	return true;
+}
+
+int title_glyph_code(uint32_t code_point)
+{
+	// Č Ć Đ Š Ž č ć đ š ž
+	static const uint32_t serbian[10] = { 0x10C, 0x106, 0x110, 0x160, 0x17D, 0x10D, 0x107, 0x111, 0x161, 0x17E };
+
+	if(code_point >= 32 && code_point < 127) return code_point - 32;
+	if(code_point == 0xB0) return GLYPH_DEGREE;
+
+	for(int i = 0; i < 10; i++)
+	{
+		if(serbian[i] == code_point) return GLYPH_FIRST_SERBIAN + i;
+	}
+	return GLYPH_UNKNOWN;
+}
+
+/* Next code point of UTF-8 text at i, malformed bytes are taken one by one */
+static uint32_t next_code_point(const string &text, size_t &i)
+{
+	unsigned char c = text[i++];
+
+	if(c < 0x80) return c;
+
+	int extra = (c & 0xE0) == 0xC0 ? 1 : (c & 0xF0) == 0xE0 ? 2 : (c & 0xF8) == 0xF0 ? 3 : 0;
+	uint32_t code_point = c & (0x3F >> extra);
+
+	if(extra == 0 || i + extra > text.size()) return 0xFFFD;
+	for(int k = 0; k < extra; k++)
+	{
+		unsigned char next = text[i];
+
+		if((next & 0xC0) != 0x80) return 0xFFFD;
+		code_point = (code_point << 6) | (next & 0x3F);
+		i++;
+	}
+	return code_point;
+}
+
+/* ------------------------ */
+/* ----------Fonts--------- */
+/* ------------------------ */
+
+TitleFont::TitleFont()
+	: dimension(0), rows(0)
+{
+	memset(letter_data, 0, sizeof(letter_data));
+}
+
+/* Reads up to len numbers, returning how many were there */
+static int read_words(const char *path, uint16_t *words, int len)
+{
+	FILE *input = fopen(path, "r");
+	unsigned int temp;
+	int count = 0;
+
+	if(input == NULL)
+	{
+		cout << "[title] Cannot open " << path << endl;
+		return -1;
+	}
+	while(count < len && fscanf(input, "%u", &temp) == 1) words[count++] = temp;
+	fclose(input);
+	return count;
+}
+
+/* The smallest gap from a glyph to the next one in the matrix over its width, 0 if no glyph has a width */
+static int find_glyph_rows(const uint16_t *letter_data, int matrix_words)
+{
+	int rows = 0;
+
+	for(int code = 0; code < TITLE_GLYPHS; code++)
+	{
+		int offset = letter_data[2*code];
+		int width = letter_data[2*code + 1];
+		int next = matrix_words;
+
+		if(width == 0 || offset >= matrix_words) continue;
+		for(int other = 0; other < TITLE_GLYPHS; other++)
+		{
+			if(letter_data[2*other] > offset && letter_data[2*other] < next) next = letter_data[2*other];
+		}
+		if(rows == 0 || (next - offset) / width < rows) rows = (next - offset) / width;
+	}
+	return rows;
+}
+
+bool TitleFont::load(const char *letter_data_path, const char *letter_matrix_path, int dimension, const TitleGeometry &geometry)
+{
+	if(dimension < 0 || dimension >= TITLE_MAX_DIMENSIONS || geometry.letter_matrix_words <= 0) return false;
+
+	this->dimension = dimension;
+	letter_matrix.assign(geometry.letter_matrix_words, 0);
+
+	if(read_words(letter_data_path, letter_data, TITLE_LETTER_DATA_WORDS) != TITLE_LETTER_DATA_WORDS)
+	{
+		cout << "[title] " << letter_data_path << " is too short" << endl;
+		return false;
+	}
+	if(read_words(letter_matrix_path, &letter_matrix[0], letter_matrix.size()) != (int)letter_matrix.size())
+	{
+		cout << "[title] " << letter_matrix_path << " is too short" << endl;
+		return false;
+	}
+
+	rows = find_glyph_rows(letter_data, letter_matrix.size());
+	if(rows <= 0)
+	{
+		cout << "[title] " << letter_data_path << " has no glyph to tell the height from" << endl;
+		return false;
+	}
+	return check();
+}
+
+bool TitleFont::check() const
+{
+	for(int code = 0; code < TITLE_GLYPHS; code++)
+	{
+		if(letter_data[2*code] + glyph_width(code) * glyph_rows() > (int)letter_matrix.size())
+		{
+			cout << "[title] Glyph " << code << " lies outside the letter matrix" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Matrix words the glyphs of synthetic() take at that height */
+static int synthetic_words(int rows)
+{
+	int words = 0;
+
+	for(int code = 0; code < TITLE_GLYPHS; code++) words += (code == 0 ? rows * 3 / 10 : rows * (4 + code % 3) / 10) * rows;
+	return words;
+}
+
+TitleFont TitleFont::synthetic(int dimension, const TitleGeometry &geometry)
+{
+	TitleFont font;
+	// The original fonts grow 3 rows per 320 pixels of frame width, cut down to what the matrix holds
+	int rows = geometry.glyph_rows > 0 ? geometry.glyph_rows : 10 + geometry.width * 3 / 320;
+	int offset = 0;
+
+	while(rows > 1 && synthetic_words(rows) > geometry.letter_matrix_words) rows--;
+
+	font.dimension = dimension;
+	font.rows = rows;
+	font.letter_matrix.assign(geometry.letter_matrix_words, 0);
+
+	for(int code = 0; code < TITLE_GLYPHS; code++)
+	{
+		int width = code == 0 ? rows * 3 / 10 : rows * (4 + code % 3) / 10;
+
+		font.letter_data[2*code] = offset;
+		font.letter_data[2*code + 1] = width;
+
+		// Space stays empty, the others get a margin above and below, a spacing column and mixed coverage
+		for(int y = rows / 8; code != 0 && y < rows - rows / 8; y++)
+		{
+			for(int x = 0; x < width - 1; x++)
+			{
+				int v = (x * 7 + y * 3 + code * 5) % 8;
+
+				font.letter_matrix[offset + y * width + x] = v < 3 ? 0 : v == 7 ? 0xFFFF : v * 0x2000;
+			}
+		}
+		offset += width * rows;
+	}
+	return font;
+}
+
+/* Grows the text's box by a glyph at (x, y) */
+static void grow_box(TitleText &out, bool &empty, int x, int y, int width, int rows)
+{
+	if(empty)
+	{
+		out.left = x;
+		out.top = y;
+		out.right = x + width;
+		out.bottom = y + rows;
+		empty = false;
+		return;
+	}
+	if(x < out.left) out.left = x;
+	if(y < out.top) out.top = y;
+	if(x + width > out.right) out.right = x + width;
+	if(y + rows > out.bottom) out.bottom = y + rows;
+}
+
+bool TitleFont::layout(const string &text, TitlePoint position, TitleText &out) const
+{
+	TitlePoint pen = position;
+	bool empty = true;
+
+	out.codes.clear();
+	out.runs.assign(1, position);
+	out.left = out.right = position.x;
+	out.top = out.bottom = position.y;
+
+	for(size_t i = 0; i < text.size();)
+	{
+		uint32_t code_point = next_code_point(text, i);
+
+		if(code_point == '\n')
+		{
+			pen = TitlePoint(position.x, pen.y + glyph_rows());
+			if(out.runs.size() == TITLE_MAX_RUNS) return false;
+			out.runs.push_back(pen);
+			out.codes.push_back(TITLE_RUN_BREAK);
+			continue;
+		}
+
+		int code = title_glyph_code(code_point);
+		int width = glyph_width(code);
+
+		out.codes.push_back(code);
+		if(width > 0) grow_box(out, empty, pen.x, pen.y, width, glyph_rows());
+		pen.x += width;
+	}
+
+	return out.codes.size() <= TITLE_MAX_TEXT_WORDS;
+}
@@ -0,0 +1,83 @@
+#ifndef FONT_HPP
+#define FONT_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "title_ip.hpp"
+
+/* ------------------------ */
+/* ----------Text---------- */
+/* ------------------------ */
+
+/* A string laid out for the IP, see title_ip.hpp */
+struct TitleText
+{
+	// LOAD_TEXT words, runs separated by TITLE_RUN_BREAK
+	std::vector<uint16_t> codes;
+	// Frame position of every run
+	std::vector<TitlePoint> runs;
+
+	// Box of everything drawn in frame coordinates, right and bottom excluded; empty if left == right
+	int left;
+	int top;
+	int right;
+	int bottom;
+};
+
+/* The position block for the tile whose top left is at frame coordinates (left, top) */
+void title_band_positions(const TitleText &text, int left, int top, int16_t *positions);
+
+/* Appends the runs of more after those of text; false, text unchanged, if both together do not fit the IP's memories */
+bool title_append_text(TitleText &text, const TitleText &more);
+
+/* ------------------------ */
+/* ----------Fonts--------- */
+/* ------------------------ */
+
+/*
+ * The letter data and letter matrix of one dimension code. Glyph codes
+ * 0..94 are the printable ASCII characters, 95..104 the Serbian Latin
+ * letters Č Ć Đ Š Ž č ć đ š ž, 105 the degree sign and 106 the box drawn
+ * for anything else.
+ */
+class TitleFont
+{
+public:
+	TitleFont();
+
+	/*
+	 * Reads both tables as whitespace separated numbers, the matrix as long
+	 * as the geometry's, checking every glyph lies inside it. The glyph
+	 * height comes from the glyphs, which lie one after another.
+	 */
+	bool load(const char *letter_data_path, const char *letter_matrix_path, int dimension, const TitleGeometry &geometry);
+
+	/* A font with made up glyphs of realistic widths and coverage, for benchmarks and tests */
+	static TitleFont synthetic(int dimension, const TitleGeometry &geometry);
+
+	int dimension;
+	uint16_t letter_data[TITLE_LETTER_DATA_WORDS];
+	std::vector<uint16_t> letter_matrix;
+	// Glyph height, the same for every glyph
+	int rows;
+
+	int glyph_rows() const { return rows; }
+	int glyph_width(int code) const { return letter_data[2*code + 1]; }
+
+	/*
+	 * Lays text (UTF-8) out from position, every line of it a run one glyph
+	 * height below the previous one. False if it needs more than
+	 * TITLE_MAX_RUNS runs or TITLE_MAX_TEXT_WORDS words.
+	 */
+	bool layout(const std::string &text, TitlePoint position, TitleText &out) const;
+
+private:
+	bool check() const;
+};
+
+/* Glyph code of a Unicode code point */
+int title_glyph_code(uint32_t code_point);
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "timeline.hpp"
+
+using namespace std;
+
+static bool parse_time_range(const string &line, double &start, double &end)
+{
+	int h0, m0, s0, ms0, h1, m1, s1, ms1;
+
+	// Some writers use a dot instead of the comma before the milliseconds
+	if(sscanf(line.c_str(), "%d:%d:%d%*[,.]%d --> %d:%d:%d%*[,.]%d", &h0, &m0, &s0, &ms0, &h1, &m1, &s1, &ms1) != 8) return false;
+	start = h0 * 3600 + m0 * 60 + s0 + ms0 / 1000.0;
+	end = h1 * 3600 + m1 * 60 + s1 + ms1 / 1000.0;
+	return true;
+}
+
+static bool cue_before(const TitleCue &a, const TitleCue &b)
+{
+	return a.start < b.start;
+}
+
+bool title_load_srt(const char *path, vector<TitleCue> &cues)
+{
+	ifstream file(path);
+	string line;
+	int line_number = 0;
+	// 0 before a counter line, 1 before the time line, 2 in the text
+	int state = 0;
+	TitleCue cue;
+
+	if(!file)
+	{
+		cout << "[title] Cannot open " << path << endl;
+		return false;
+	}
+
+	cues.clear();
+	while(getline(file, line))
+	{
+		line_number++;
+		if(line_number == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0) line.erase(0, 3);
+		if(!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+
+		if(line.empty())
+		{
+			if(state == 2) cues.push_back(cue);
+			if(state == 1)
+			{
+				cout << "[title] " << path << ":" << line_number << ": cue without times" << endl;
+				return false;
+			}
+			state = 0;
+			continue;
+		}
+
+		switch(state)
+		{
+		case 0:
+			// The counter line is optional
+			if(line.find("-->") == string::npos)
+			{
+				state = 1;
+				break;
+			}
+			/* fall through */
+		case 1:
+			if(!parse_time_range(line, cue.start, cue.end) || cue.end < cue.start)
+			{
+				cout << "[title] " << path << ":" << line_number << ": bad time line " << line << endl;
+				return false;
+			}
+			cue.text.clear();
+			state = 2;
+			break;
+		default:
+			if(!cue.text.empty()) cue.text += '\n';
+			cue.text += line;
+		}
+	}
+	if(state == 2) cues.push_back(cue);
+
+	stable_sort(cues.begin(), cues.end(), cue_before);
+	return true;
+}
+
+const TitleCue *title_cue_at(const vector<TitleCue> &cues, double t, size_t &next)
+{
+	while(next < cues.size() && cues[next].end <= t) next++;
+	if(next < cues.size() && cues[next].start <= t) return &cues[next];
+	return NULL;
+}
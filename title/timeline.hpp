@@ -0,0 +1,36 @@
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* ------------------------ */
+/* --------Timeline-------- */
+/* ------------------------ */
+
+/* One subtitle, shown from start up to but not including end, in seconds */
+struct TitleCue
+{
+	double start;
+	double end;
+	// UTF-8, lines separated by \n
+	std::string text;
+};
+
+/*
+ * Reads a SubRip (.srt) file into cues sorted by start: blocks of a
+ * counter line, a "HH:MM:SS,mmm --> HH:MM:SS,mmm" line and the text lines,
+ * separated by empty lines. Formatting tags are kept as they are.
+ */
+bool title_load_srt(const char *path, std::vector<TitleCue> &cues);
+
+/*
+ * The cue shown at time t, NULL between cues. next is where the search
+ * starts and is moved forward, so a caller going through time in order
+ * starts it at 0 and keeps passing it in. Overlapping cues show the one
+ * starting first.
+ */
+const TitleCue *title_cue_at(const std::vector<TitleCue> &cues, double t, size_t &next);
+
+#endif
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "title_device.hpp"
+
+#ifndef GIT_REV
+#define GIT_REV "unknown"
+#endif
+
+using namespace std;
+using namespace chrono;
+
+/*
+ * Frames per second of render() at several resolutions, each cut into
+ * tiles by the device's plan(). Prints one JSON object like app/bench. With -C
+ * every resolution is also run on the CPU renderer, the baseline the
+ * device is compared with, and the device's frame is checked against it.
+ */
+
+struct BenchConfig
+{
+	int frames;
+	int warmup;
+	bool simulated;
+	int cpu_threads;
+	int compare_threads;
+	bool all_tiles;
+	int items;
+	TitleFormat format;
+	const char *ip_path;
+	const char *dma_path;
+	const char *font_dir;
+	const char *text;
+	const char *output_path;
+	vector<TitlePoint> resolutions;
+};
+
+struct Result
+{
+	int width;
+	int height;
+	TitlePlan plan;
+	double wall;
+	TitleStats stats;
+	// With -C
+	double cpu_wall;
+	bool matches_cpu;
+};
+
+static void usage(const char *name)
+{
+	cout << "Usage: " << name << " [-n frames] [-w warmup] [-r WxH,...] [-s | -c threads | -d ip_path,dma_path] [-C threads] [-a] [-L items] [-f format] [-F font_dir] [-t text] [-o report.json]" << endl;
+	cout << "  -n  measured frames per resolution (default 100)" << endl;
+	cout << "  -w  warmup frames per resolution, not measured (default 5)" << endl;
+	cout << "  -r  resolutions (default 640x480,960x540,1280x720,1600x900,1920x1080,1000x700,3840x2160)" << endl;
+	cout << "  -s  use the simulated IP instead of /dev/title-ip0 and /dev/dma0" << endl;
+	cout << "  -c  use the CPU renderer on that many threads" << endl;
+	cout << "  -d  title IP and DMA device nodes" << endl;
+	cout << "  -C  also run the CPU renderer on that many threads and compare the frames" << endl;
+	cout << "  -a  send every tile through the IP, also those without text" << endl;
+	cout << "  -L  burn the text in as that many items, one above the other (default 1)" << endl;
+	cout << "  -f  pixel format of the frames, rgb48 (default), rgb24 or nv12" << endl;
+	cout << "  -F  directory with letter_data_dN.txt and letter_matrix_dN.txt (default synthetic fonts)" << endl;
+	cout << "  -t  text to burn in, \\n in it starts a new line" << endl;
+	cout << "  -o  write the JSON report to a file instead of stdout" << endl;
+}
+
+static bool parse_resolutions(const char *list, vector<TitlePoint> &resolutions)
+{
+	const char *p = list;
+	int width, height, used;
+
+	resolutions.clear();
+	while(sscanf(p, "%dx%d%n", &width, &height, &used) == 2 && width > 0 && height > 0)
+	{
+		resolutions.push_back(TitlePoint(width, height));
+		p += used;
+		if(*p != ',') return *p == '\0';
+		p++;
+	}
+	return false;
+}
+
+/* Replaces the two characters \n of a command line argument by a new line */
+static string unescape(const char *text)
+{
+	string result;
+
+	for(const char *p = text; *p; p++)
+	{
+		if(p[0] == '\\' && p[1] == 'n')
+		{
+			result += '\n';
+			p++;
+		}
+		else result += *p;
+	}
+	return result;
+}
+
+static void fill_pattern(vector<uint8_t> &pixels)
+{
+	for(size_t i = 0; i < pixels.size(); i++) pixels[i] = (i * 2654435761u) >> 24;
+}
+
+/* Seconds for config.frames frames after the warmup, 0 if rendering failed; start gets the stats after the warmup */
+static double time_frames(TitleDevice &device, const BenchConfig &config, const TitleImage &frame, const vector<TitleItem> &items, TitleStats &start)
+{
+	for(int i = 0; i < config.warmup; i++)
+	{
+		if(!device.render(frame, items)) return 0;
+	}
+
+	start = device.stats;
+	auto t0 = steady_clock::now();
+
+	for(int i = 0; i < config.frames; i++)
+	{
+		if(!device.render(frame, items)) return 0;
+	}
+	return duration<double>(steady_clock::now() - t0).count();
+}
+
+static bool run_resolution(TitleDevice &device, TitleDevice *cpu, const BenchConfig &config, int width, int height, Result &result)
+{
+	vector<uint8_t> pixels(title_image_bytes(config.format, width, height));
+	TitleImage frame = title_image(config.format, width, height, &pixels[0]);
+	vector<TitleItem> items;
+
+	// The last item where a single one goes, the others spread out above it
+	for(int i = 0; i < config.items; i++)
+	{
+		items.push_back(TitleItem(unescape(config.text), TitlePoint(width / 10, (long)height * 4 * (i + 1) / (5 * config.items))));
+	}
+
+	result.width = width;
+	result.height = height;
+	result.plan = device.plan(width, height);
+	result.cpu_wall = 0;
+	result.matches_cpu = false;
+
+	/* One frame through each, from the same pixels */
+	if(cpu)
+	{
+		vector<uint8_t> expected(pixels.size());
+		TitleImage reference = title_image(config.format, width, height, &expected[0]);
+
+		fill_pattern(pixels);
+		fill_pattern(expected);
+		if(!device.render(frame, items) || !cpu->render(reference, items)) return false;
+		result.matches_cpu = pixels == expected;
+
+		TitleStats cpu_start;
+
+		result.cpu_wall = time_frames(*cpu, config, reference, items, cpu_start);
+		if(result.cpu_wall == 0) return false;
+	}
+
+	fill_pattern(pixels);
+
+	TitleStats start;
+
+	result.wall = time_frames(device, config, frame, items, start);
+	if(result.wall == 0) return false;
+	result.stats = device.stats;
+	result.stats.bytes_to_device -= start.bytes_to_device;
+	result.stats.bytes_from_device -= start.bytes_from_device;
+	result.stats.commands -= start.commands;
+	result.stats.syscalls -= start.syscalls;
+	result.stats.tiles -= start.tiles;
+	result.stats.tiles_skipped -= start.tiles_skipped;
+	result.stats.letter_bytes_skipped -= start.letter_bytes_skipped;
+	result.stats.text_bytes_skipped -= start.text_bytes_skipped;
+	result.stats.extra_passes -= start.extra_passes;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	BenchConfig config = { 100, 5, false, 0, 0, false, 1, TITLE_FORMAT_RGB48, "/dev/title-ip0", "/dev/dma0", NULL, "Title IP benchmark\\nČačak 21°", NULL, vector<TitlePoint>() };
+	vector<Result> results;
+	string device_paths;
+	int opt;
+
+	parse_resolutions("640x480,960x540,1280x720,1600x900,1920x1080,1000x700,3840x2160", config.resolutions);
+
+	while((opt = getopt(argc, argv, "n:w:r:sc:d:C:aL:f:F:t:o:")) != -1)
+	{
+		switch(opt)
+		{
+		case 'n': config.frames = atoi(optarg); break;
+		case 'w': config.warmup = atoi(optarg); break;
+		case 'r':
+			if(!parse_resolutions(optarg, config.resolutions))
+			{
+				cout << "[title] Bad resolution list " << optarg << endl;
+				return 1;
+			}
+			break;
+		case 's': config.simulated = true; break;
+		case 'c': config.cpu_threads = atoi(optarg); break;
+		case 'd': device_paths = optarg; break;
+		case 'C': config.compare_threads = atoi(optarg); break;
+		case 'a': config.all_tiles = true; break;
+		case 'L': config.items = atoi(optarg); break;
+		case 'f':
+			if(!title_parse_format(optarg, config.format))
+			{
+				cout << "[title] Unknown pixel format " << optarg << endl;
+				return 1;
+			}
+			break;
+		case 'F': config.font_dir = optarg; break;
+		case 't': config.text = optarg; break;
+		case 'o': config.output_path = optarg; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(config.frames <= 0 || config.cpu_threads < 0 || config.compare_threads < 0 || config.items < 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	string ip_path = config.ip_path, dma_path = config.dma_path;
+	size_t comma = device_paths.find(',');
+
+	if(comma != string::npos)
+	{
+		ip_path = device_paths.substr(0, comma);
+		dma_path = device_paths.substr(comma + 1);
+	}
+
+	TitleDevice *device;
+	CpuTitleDevice *cpu = config.compare_threads > 0 ? new CpuTitleDevice(config.compare_threads) : NULL;
+
+	if(config.simulated) device = new SimTitleDevice;
+	else if(config.cpu_threads > 0) device = new CpuTitleDevice(config.cpu_threads);
+	else device = new TitleDevice(ip_path, dma_path);
+
+	// The reference cuts frames like the device, whatever table its driver has
+	if(!device->is_open() || (cpu && !cpu->set_geometry(device->geometry())) || !device->load_fonts(config.font_dir) || (cpu && !cpu->load_fonts(config.font_dir)))
+	{
+		delete device;
+		delete cpu;
+		return 1;
+	}
+	device->skip_clean_tiles = !config.all_tiles;
+	if(cpu) cpu->skip_clean_tiles = !config.all_tiles;
+
+	for(size_t i = 0; i < config.resolutions.size(); i++)
+	{
+		Result result;
+
+		if(!run_resolution(*device, cpu, config, config.resolutions[i].x, config.resolutions[i].y, result))
+		{
+			cout << "[title] Rendering " << config.resolutions[i].x << "x" << config.resolutions[i].y << " failed" << endl;
+			delete device;
+			delete cpu;
+			return 1;
+		}
+		results.push_back(result);
+	}
+
+	FILE *out = config.output_path ? fopen(config.output_path, "w") : stdout;
+
+	if(out == NULL)
+	{
+		cout << "[title] Cannot open " << config.output_path << endl;
+		delete device;
+		delete cpu;
+		return 1;
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"commit\": \"%s\",\n", GIT_REV);
+	fprintf(out, "  \"backend\": \"%s\",\n", device->name());
+	if(cpu) fprintf(out, "  \"cpu_threads\": %d,\n", config.compare_threads);
+	fprintf(out, "  \"frames\": %d,\n", config.frames);
+	fprintf(out, "  \"warmup\": %d,\n", config.warmup);
+	fprintf(out, "  \"skip_clean_tiles\": %s,\n", config.all_tiles ? "false" : "true");
+	fprintf(out, "  \"items\": %d,\n", config.items);
+	fprintf(out, "  \"format\": \"%s\",\n", title_format_name(config.format));
+	fprintf(out, "  \"resolutions\": [\n");
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const Result &r = results[i];
+		double n = config.frames;
+
+		fprintf(out, "    { \"width\": %d, \"height\": %d, \"dimension\": %d, \"stripes\": %d, \"bands\": %d, ",
+			r.width, r.height, r.plan.dimension, r.plan.stripes, r.plan.bands);
+		fprintf(out, "\"frames_per_sec\": %.2f, \"dma_bytes_per_frame\": %.0f, \"tiles_skipped_per_frame\": %.2f, ",
+			n / r.wall, (r.stats.bytes_to_device + r.stats.bytes_from_device) / n, r.stats.tiles_skipped / n);
+		fprintf(out, "\"letter_bytes_skipped_per_frame\": %.0f, \"text_bytes_skipped_per_frame\": %.0f, \"extra_passes_per_frame\": %.2f, ",
+			r.stats.letter_bytes_skipped / n, r.stats.text_bytes_skipped / n, r.stats.extra_passes / n);
+		if(cpu)
+		{
+			// The simulation does not draw, so only the CPU renderer and the device can match
+			fprintf(out, "\"cpu_frames_per_sec\": %.2f, \"speedup\": %.2f, \"matches_cpu\": %s, ",
+				n / r.cpu_wall, r.cpu_wall / r.wall, r.matches_cpu ? "true" : "false");
+		}
+		fprintf(out, "\"ip_commands_per_frame\": %.2f, \"syscalls_per_frame\": %.2f }%s\n",
+			r.stats.commands / n, r.stats.syscalls / n, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n");
+	fprintf(out, "}\n");
+
+	if(out != stdout) fclose(out);
+	delete device;
+	delete cpu;
+	return 0;
+}
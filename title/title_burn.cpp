@@ -0,0 +1,565 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "title_device.hpp"
+#include "timeline.hpp"
+
+using namespace std;
+using namespace chrono;
+
+/*
+ * Burns the subtitles of an .srt file into a raw video file, frames of
+ * one of the formats of TitleImage back to back without any header. Three
+ * threads hand a ring of frame buffers on: the reader copies frames out of
+ * the memory mapped input, the IP stage renders the cue of every frame's
+ * time into it and the writer sends it to the output, then back to the
+ * reader. Frames per second and how long every stage waited for the one
+ * before it are printed at the end.
+ */
+
+// Buffers are page aligned for O_DIRECT and vmsplice
+#define PAGE_ALIGN		4096
+// Bytes written per O_DIRECT write
+#define DIRECT_CHUNK		(8 << 20)
+
+enum OutputMode
+{
+	OUTPUT_WRITE,
+	OUTPUT_DIRECT,
+	OUTPUT_VMSPLICE
+};
+
+static const char *output_mode_name(OutputMode mode)
+{
+	switch(mode)
+	{
+	case OUTPUT_DIRECT:	return "O_DIRECT";
+	case OUTPUT_VMSPLICE:	return "vmsplice";
+	default:		return "write";
+	}
+}
+
+struct StageStats
+{
+	StageStats() : busy(0), stalled(0), stalls(0) {}
+
+	// Seconds working and waiting for a frame buffer
+	double busy;
+	double stalled;
+	long stalls;
+};
+
+/* ------------------------ */
+/* ---------Queues--------- */
+/* ------------------------ */
+
+/* Ring slots handed from one stage to the next */
+class SlotQueue
+{
+public:
+	SlotQueue() : closed(false) {}
+
+	void push(int slot)
+	{
+		lock_guard<mutex> lock(m);
+		slots.push_back(slot);
+		ready.notify_one();
+	}
+
+	/* Waits for a slot, counting the wait as a stall; false once closed and empty */
+	bool pop(int &slot, StageStats &stats)
+	{
+		unique_lock<mutex> lock(m);
+
+		if(slots.empty() && !closed)
+		{
+			auto t0 = steady_clock::now();
+
+			while(slots.empty() && !closed) ready.wait(lock);
+			stats.stalled += duration<double>(steady_clock::now() - t0).count();
+			stats.stalls++;
+		}
+		if(slots.empty()) return false;
+		slot = slots.front();
+		slots.pop_front();
+		return true;
+	}
+
+	void close()
+	{
+		lock_guard<mutex> lock(m);
+		closed = true;
+		ready.notify_all();
+	}
+
+private:
+	mutex m;
+	condition_variable ready;
+	deque<int> slots;
+	bool closed;
+};
+
+/* ------------------------ */
+/* ---------Burning-------- */
+/* ------------------------ */
+
+struct Burn
+{
+	Burn() : failed(false) {}
+
+	const uint8_t *input;
+	long frames;
+	long frame_bytes;
+	int width;
+	int height;
+	TitleFormat format;
+	double fps;
+	vector<TitleCue> cues;
+	TitlePoint position;
+	TitleDevice *device;
+
+	int output;
+	OutputMode mode;
+
+	vector<uint8_t *> slots;
+	// Frame number in every slot
+	vector<long> slot_frame;
+	SlotQueue free_slots;
+	SlotQueue to_ip;
+	SlotQueue to_writer;
+
+	StageStats reader;
+	StageStats ip;
+	StageStats writer;
+	atomic<bool> failed;
+
+	void fail()
+	{
+		failed = true;
+		free_slots.close();
+		to_ip.close();
+		to_writer.close();
+	}
+};
+
+static void read_frames(Burn &burn)
+{
+	int slot;
+
+	for(long frame = 0; frame < burn.frames && !burn.failed; frame++)
+	{
+		if(!burn.free_slots.pop(slot, burn.reader)) break;
+
+		auto t0 = steady_clock::now();
+
+		// The IP stage draws into the frame, the mapping stays read only
+		memcpy(burn.slots[slot], burn.input + frame * burn.frame_bytes, burn.frame_bytes);
+		burn.slot_frame[slot] = frame;
+		burn.reader.busy += duration<double>(steady_clock::now() - t0).count();
+		burn.to_ip.push(slot);
+	}
+	burn.to_ip.close();
+}
+
+static void burn_frames(Burn &burn)
+{
+	size_t next_cue = 0;
+	int slot;
+
+	while(!burn.failed && burn.to_ip.pop(slot, burn.ip))
+	{
+		auto t0 = steady_clock::now();
+		const TitleCue *cue = title_cue_at(burn.cues, burn.slot_frame[slot] / burn.fps, next_cue);
+		TitleImage image = title_image(burn.format, burn.width, burn.height, burn.slots[slot]);
+
+		if(!burn.device->render(image, cue ? cue->text : string(), burn.position))
+		{
+			cerr << "[title] Rendering frame " << burn.slot_frame[slot] << " failed" << endl;
+			burn.fail();
+			break;
+		}
+		burn.ip.busy += duration<double>(steady_clock::now() - t0).count();
+		burn.to_writer.push(slot);
+	}
+	burn.to_writer.close();
+}
+
+static bool write_all(int fd, const uint8_t *data, long bytes)
+{
+	while(bytes > 0)
+	{
+		ssize_t written = write(fd, data, bytes);
+
+		if(written < 0 && errno == EINTR) continue;
+		if(written <= 0)
+		{
+			cerr << "[title] Writing the output failed: " << strerror(errno) << endl;
+			return false;
+		}
+		data += written;
+		bytes -= written;
+	}
+	return true;
+}
+
+static bool vmsplice_all(int fd, const uint8_t *data, long bytes)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *)data;
+	iov.iov_len = bytes;
+	while(iov.iov_len > 0)
+	{
+		ssize_t spliced = vmsplice(fd, &iov, 1, 0);
+
+		if(spliced < 0 && errno == EINTR) continue;
+		if(spliced <= 0)
+		{
+			cerr << "[title] vmsplice failed: " << strerror(errno) << endl;
+			return false;
+		}
+		iov.iov_base = (uint8_t *)iov.iov_base + spliced;
+		iov.iov_len -= spliced;
+	}
+	return true;
+}
+
+/* The bytes of chunk left over at the end: whole blocks still with O_DIRECT, the tail without it */
+static bool write_direct_tail(int fd, const uint8_t *chunk, long bytes)
+{
+	long blocks = bytes / PAGE_ALIGN * PAGE_ALIGN;
+
+	if(!write_all(fd, chunk, blocks)) return false;
+	if(blocks == bytes) return true;
+	if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT) < 0)
+	{
+		cerr << "[title] Cannot turn O_DIRECT off: " << strerror(errno) << endl;
+		return false;
+	}
+	return write_all(fd, chunk + blocks, bytes - blocks);
+}
+
+static void write_frames(Burn &burn)
+{
+	uint8_t *chunk = NULL;
+	long chunk_bytes = 0;
+	// With vmsplice the pipe holds on to the pages of the last frame until the next one has gone in after it
+	int held = -1;
+	int slot;
+
+	if(burn.mode == OUTPUT_DIRECT && posix_memalign((void **)&chunk, PAGE_ALIGN, DIRECT_CHUNK) != 0)
+	{
+		cerr << "[title] Out of memory" << endl;
+		burn.fail();
+		return;
+	}
+
+	while(!burn.failed && burn.to_writer.pop(slot, burn.writer))
+	{
+		auto t0 = steady_clock::now();
+		const uint8_t *data = burn.slots[slot];
+		bool ok = true;
+
+		switch(burn.mode)
+		{
+		case OUTPUT_VMSPLICE:
+			ok = vmsplice_all(burn.output, data, burn.frame_bytes);
+			if(held >= 0) burn.free_slots.push(held);
+			held = slot;
+			break;
+		case OUTPUT_DIRECT:
+			// Frames go out in whole chunks, so no write depends on the frame size being aligned
+			for(long done = 0; ok && done < burn.frame_bytes; )
+			{
+				long bytes = min(burn.frame_bytes - done, (long)DIRECT_CHUNK - chunk_bytes);
+
+				memcpy(chunk + chunk_bytes, data + done, bytes);
+				chunk_bytes += bytes;
+				done += bytes;
+				if(chunk_bytes == DIRECT_CHUNK)
+				{
+					ok = write_all(burn.output, chunk, chunk_bytes);
+					chunk_bytes = 0;
+				}
+			}
+			burn.free_slots.push(slot);
+			break;
+		default:
+			ok = write_all(burn.output, data, burn.frame_bytes);
+			burn.free_slots.push(slot);
+		}
+		burn.writer.busy += duration<double>(steady_clock::now() - t0).count();
+		if(!ok)
+		{
+			burn.fail();
+			break;
+		}
+	}
+
+	if(!burn.failed && chunk_bytes > 0 && !write_direct_tail(burn.output, chunk, chunk_bytes)) burn.fail();
+	if(held >= 0) burn.free_slots.push(held);
+	free(chunk);
+}
+
+/* ------------------------ */
+/* -----Command line------- */
+/* ------------------------ */
+
+static void usage(const char *name)
+{
+	cout << "Usage: " << name << " -i input -o output -v WxH -T subtitles.srt [-f format] [-r fps] [-n frames] [-p x,y] [-s | -c threads | -d ip_path,dma_path] [-F font_dir] [-q slots] [-D]" << endl;
+	cout << "  -i  raw video file, frames back to back" << endl;
+	cout << "  -o  file or pipe to write the frames to, - for stdout (messages then go to stderr)" << endl;
+	cout << "  -v  frame size" << endl;
+	cout << "  -T  SubRip subtitles, times from the first frame" << endl;
+	cout << "  -f  pixel format of the frames, rgb48, rgb24 or nv12 (default)" << endl;
+	cout << "  -r  frames per second (default 25)" << endl;
+	cout << "  -n  frames to burn (default all of the input)" << endl;
+	cout << "  -p  top left of the first line of text (default a tenth of the width, four fifths of the height)" << endl;
+	cout << "  -s  use the simulated IP instead of /dev/title-ip0 and /dev/dma0" << endl;
+	cout << "  -c  use the CPU renderer on that many threads" << endl;
+	cout << "  -d  title IP and DMA device nodes" << endl;
+	cout << "  -F  directory with letter_data_dN.txt and letter_matrix_dN.txt (default synthetic fonts)" << endl;
+	cout << "  -q  frame buffers passed between the stages, at least 3 (default 4)" << endl;
+	cout << "  -D  write a regular file with O_DIRECT, past the page cache" << endl;
+}
+
+/* Opens the output and picks how to write it: vmsplice into pipes, O_DIRECT with -D, write() otherwise */
+static int open_output(const char *path, bool direct, long frame_bytes, OutputMode &mode)
+{
+	int fd;
+	struct stat st;
+
+	mode = OUTPUT_WRITE;
+	if(strcmp(path, "-") == 0) fd = STDOUT_FILENO;
+	else
+	{
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | (direct ? O_DIRECT : 0), 0644);
+		if(fd < 0 && direct && errno == EINVAL)
+		{
+			cerr << "[title] " << path << " does not take O_DIRECT, writing it through the page cache" << endl;
+			direct = false;
+			fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		}
+		if(fd < 0)
+		{
+			cerr << "[title] Cannot open " << path << ": " << strerror(errno) << endl;
+			return -1;
+		}
+	}
+
+	if(fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+	{
+		// A frame has to push the one before it out of the pipe completely, see write_frames()
+		int pipe_bytes = fcntl(fd, F_GETPIPE_SZ);
+
+		if(pipe_bytes > 0 && pipe_bytes <= frame_bytes) mode = OUTPUT_VMSPLICE;
+	}
+	else if(direct && S_ISREG(st.st_mode)) mode = OUTPUT_DIRECT;
+	return fd;
+}
+
+static bool parse_pair(const char *text, const char *format, int &a, int &b)
+{
+	int used;
+
+	return sscanf(text, format, &a, &b, &used) == 2 && text[used] == '\0';
+}
+
+static void print_stage(ostream &log, const char *name, const StageStats &stats)
+{
+	char line[128];
+
+	snprintf(line, sizeof(line), "%-7s busy %.2f s, stalled %.2f s in %ld waits", name, stats.busy, stats.stalled, stats.stalls);
+	log << "[title] " << line << endl;
+}
+
+int main(int argc, char **argv)
+{
+	const char *input_path = NULL;
+	const char *output_path = NULL;
+	const char *srt_path = NULL;
+	const char *font_dir = NULL;
+	string device_paths;
+	int width = 0, height = 0, x = -1, y = -1;
+	TitleFormat format = TITLE_FORMAT_NV12;
+	double fps = 25;
+	long max_frames = -1;
+	bool simulated = false, direct = false;
+	int cpu_threads = 0, ring_slots = 4;
+	int opt;
+
+	while((opt = getopt(argc, argv, "i:o:v:T:f:r:n:p:sc:d:F:q:D")) != -1)
+	{
+		switch(opt)
+		{
+		case 'i': input_path = optarg; break;
+		case 'o': output_path = optarg; break;
+		case 'v':
+			if(!parse_pair(optarg, "%dx%d%n", width, height))
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'T': srt_path = optarg; break;
+		case 'f':
+			if(!title_parse_format(optarg, format))
+			{
+				cerr << "[title] Unknown pixel format " << optarg << endl;
+				return 1;
+			}
+			break;
+		case 'r': fps = atof(optarg); break;
+		case 'n': max_frames = atol(optarg); break;
+		case 'p':
+			if(!parse_pair(optarg, "%d,%d%n", x, y))
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 's': simulated = true; break;
+		case 'c': cpu_threads = atoi(optarg); break;
+		case 'd': device_paths = optarg; break;
+		case 'F': font_dir = optarg; break;
+		case 'q': ring_slots = atoi(optarg); break;
+		case 'D': direct = true; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(input_path == NULL || output_path == NULL || srt_path == NULL || width <= 0 || height <= 0 ||
+	   fps <= 0 || cpu_threads < 0 || ring_slots < 3)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if(format == TITLE_FORMAT_NV12 && (width % 2 || height % 2))
+	{
+		cerr << "[title] NV12 frames need an even width and height" << endl;
+		return 1;
+	}
+
+	ostream &log = strcmp(output_path, "-") == 0 ? cerr : cout;
+	Burn burn;
+
+	burn.width = width;
+	burn.height = height;
+	burn.format = format;
+	burn.fps = fps;
+	burn.frame_bytes = title_image_bytes(format, width, height);
+	burn.position = TitlePoint(x >= 0 ? x : width / 10, y >= 0 ? y : height * 4 / 5);
+	if(!title_load_srt(srt_path, burn.cues)) return 1;
+
+	int input = open(input_path, O_RDONLY);
+	struct stat st;
+
+	if(input < 0 || fstat(input, &st) < 0)
+	{
+		cerr << "[title] Cannot open " << input_path << ": " << strerror(errno) << endl;
+		return 1;
+	}
+	burn.frames = st.st_size / burn.frame_bytes;
+	if(st.st_size % burn.frame_bytes) log << "[title] Ignoring " << st.st_size % burn.frame_bytes << " bytes after the last whole frame" << endl;
+	if(max_frames >= 0 && max_frames < burn.frames) burn.frames = max_frames;
+	if(burn.frames == 0)
+	{
+		cerr << "[title] " << input_path << " holds no whole " << width << "x" << height << " " << title_format_name(format) << " frame" << endl;
+		close(input);
+		return 1;
+	}
+
+	void *mapped = mmap(NULL, burn.frames * burn.frame_bytes, PROT_READ, MAP_SHARED, input, 0);
+
+	close(input);
+	if(mapped == MAP_FAILED)
+	{
+		cerr << "[title] Cannot map " << input_path << ": " << strerror(errno) << endl;
+		return 1;
+	}
+	madvise(mapped, burn.frames * burn.frame_bytes, MADV_SEQUENTIAL);
+	burn.input = (const uint8_t *)mapped;
+
+	string ip_path = "/dev/title-ip0", dma_path = "/dev/dma0";
+	size_t comma = device_paths.find(',');
+
+	if(comma != string::npos)
+	{
+		ip_path = device_paths.substr(0, comma);
+		dma_path = device_paths.substr(comma + 1);
+	}
+	if(simulated) burn.device = new SimTitleDevice;
+	else if(cpu_threads > 0) burn.device = new CpuTitleDevice(cpu_threads);
+	else burn.device = new TitleDevice(ip_path, dma_path);
+
+	burn.output = -1;
+	if(burn.device->is_open() && burn.device->load_fonts(font_dir)) burn.output = open_output(output_path, direct, burn.frame_bytes, burn.mode);
+	if(burn.output < 0)
+	{
+		delete burn.device;
+		munmap(mapped, burn.frames * burn.frame_bytes);
+		return 1;
+	}
+
+	for(int i = 0; i < ring_slots; i++)
+	{
+		void *slot;
+
+		if(posix_memalign(&slot, PAGE_ALIGN, burn.frame_bytes) != 0)
+		{
+			cerr << "[title] Out of memory" << endl;
+			return 1;
+		}
+		burn.slots.push_back((uint8_t *)slot);
+		burn.slot_frame.push_back(0);
+		burn.free_slots.push(i);
+	}
+
+	auto t0 = steady_clock::now();
+	thread reader(read_frames, ref(burn));
+	thread writer(write_frames, ref(burn));
+
+	burn_frames(burn);
+	reader.join();
+	writer.join();
+
+	double wall = duration<double>(steady_clock::now() - t0).count();
+	bool ok = !burn.failed;
+
+	if(ok)
+	{
+		char line[160];
+
+		snprintf(line, sizeof(line), "%ld frames of %dx%d %s in %.2f s, %.2f frames/sec, backend %s, output by %s",
+			burn.frames, width, height, title_format_name(format), wall, burn.frames / wall,
+			burn.device->name(), output_mode_name(burn.mode));
+		log << "[title] " << line << endl;
+		print_stage(log, "reader", burn.reader);
+		print_stage(log, "ip", burn.ip);
+		print_stage(log, "writer", burn.writer);
+	}
+
+	if(burn.output != STDOUT_FILENO) close(burn.output);
+	for(size_t i = 0; i < burn.slots.size(); i++) free(burn.slots[i]);
+	munmap(mapped, burn.frames * burn.frame_bytes);
+	delete burn.device;
+	return ok ? 0 : 1;
+}
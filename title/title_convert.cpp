@@ -0,0 +1,145 @@
+#include <algorithm>
+
+#include "title_convert.hpp"
+
+using namespace std;
+
+/*
+ * Every loop reads and writes at fixed strides with no branches but the
+ * clamps, which the compiler vectorizes like the blends of title_cpu.cpp;
+ * the three word pixels take byte shuffles (SSSE3, NEON), see Makefile.
+ */
+
+// Pixels per pass through the per-pixel arrays, even
+#define CONVERT_CHUNK		256
+
+// BT.709 limited range to RGB48, Q6 with the 8 to 16-bit factor 257 folded in
+#define YUV_Y			19152
+#define YUV_RV			29487
+#define YUV_GU			3508
+#define YUV_GV			8765
+#define YUV_BU			34745
+
+// RGB48 to BT.709 limited range, Q20 (luma) and Q21 (chroma)
+#define RGB_YR			745
+#define RGB_YG			2506
+#define RGB_YB			253
+#define RGB_UR			821
+#define RGB_UG			2763
+#define RGB_UB			3584
+#define RGB_VR			3584
+#define RGB_VG			3256
+#define RGB_VB			328
+
+static inline uint16_t clamp16(int32_t value)
+{
+	return value < 0 ? 0 : value > 0xFFFF ? 0xFFFF : value;
+}
+
+static inline uint8_t clamp8(int32_t value)
+{
+	return value < 0 ? 0 : value > 0xFF ? 0xFF : value;
+}
+
+void title_rgb24_to_rgb48(const uint8_t *__restrict in, uint16_t *__restrict out, int pixels)
+{
+	for(int i = 0; i < 3 * pixels; i++) out[i] = in[i] * 257;
+}
+
+void title_rgb48_to_rgb24(const uint16_t *__restrict in, uint8_t *__restrict out, int pixels)
+{
+	// (v + 128) / 257, which 65281 / 2^24 gives exactly for 16-bit v
+	for(int i = 0; i < 3 * pixels; i++) out[i] = ((uint32_t)(in[i] + 128) * 65281) >> 24;
+}
+
+/* Chroma terms of every pixel of a row, each pair repeating its own */
+static void chroma_terms(const uint8_t *__restrict chroma, int32_t *__restrict r, int32_t *__restrict g, int32_t *__restrict b, int pairs)
+{
+	for(int pair = 0; pair < pairs; pair++)
+	{
+		int32_t u = chroma[2*pair] - 128;
+		int32_t v = chroma[2*pair + 1] - 128;
+
+		r[2*pair] = r[2*pair + 1] = YUV_RV * v + 32;
+		g[2*pair] = g[2*pair + 1] = 32 - YUV_GU * u - YUV_GV * v;
+		b[2*pair] = b[2*pair + 1] = YUV_BU * u + 32;
+	}
+}
+
+static void luma_to_rgb48(const uint8_t *__restrict luma, const int32_t *__restrict r, const int32_t *__restrict g, const int32_t *__restrict b,
+			  uint16_t *__restrict out, int pixels)
+{
+	for(int i = 0; i < pixels; i++)
+	{
+		int32_t y = YUV_Y * (luma[i] - 16);
+
+		out[3*i] = clamp16((y + r[i]) >> 6);
+		out[3*i + 1] = clamp16((y + g[i]) >> 6);
+		out[3*i + 2] = clamp16((y + b[i]) >> 6);
+	}
+}
+
+/* Rows go in chunks through per-pixel arrays, so every loop reads and writes at fixed strides */
+void title_nv12_to_rgb48(const uint8_t *luma, const uint8_t *chroma, uint16_t *out, int pixels)
+{
+	int32_t r[CONVERT_CHUNK], g[CONVERT_CHUNK], b[CONVERT_CHUNK];
+
+	for(int first = 0; first < pixels; first += CONVERT_CHUNK)
+	{
+		int count = min(CONVERT_CHUNK, pixels - first);
+
+		chroma_terms(chroma + first, r, g, b, count / 2);
+		luma_to_rgb48(luma + first, r, g, b, out + 3*first, count);
+	}
+}
+
+static void rgb48_to_luma(const uint16_t *__restrict in, uint8_t *__restrict luma, int pixels)
+{
+	for(int i = 0; i < pixels; i++)
+	{
+		luma[i] = clamp8(((16 << 20) + RGB_YR * in[3*i] + RGB_YG * in[3*i + 1] + RGB_YB * in[3*i + 2] + (1 << 19)) >> 20);
+	}
+}
+
+/* Channels of the two rows added up, one array per channel */
+static void add_rows(const uint16_t *__restrict top, const uint16_t *__restrict bottom, int32_t *__restrict r, int32_t *__restrict g, int32_t *__restrict b, int pixels)
+{
+	for(int i = 0; i < pixels; i++)
+	{
+		r[i] = top[3*i] + bottom[3*i];
+		g[i] = top[3*i + 1] + bottom[3*i + 1];
+		b[i] = top[3*i + 2] + bottom[3*i + 2];
+	}
+}
+
+static void sums_to_chroma(const int32_t *__restrict r, const int32_t *__restrict g, const int32_t *__restrict b, uint8_t *__restrict chroma, int pairs)
+{
+	for(int pair = 0; pair < pairs; pair++)
+	{
+		int32_t red = (r[2*pair] + r[2*pair + 1] + 2) >> 2;
+		int32_t green = (g[2*pair] + g[2*pair + 1] + 2) >> 2;
+		int32_t blue = (b[2*pair] + b[2*pair + 1] + 2) >> 2;
+
+		chroma[2*pair] = clamp8(((128 << 21) - RGB_UR * red - RGB_UG * green + RGB_UB * blue + (1 << 20)) >> 21);
+		chroma[2*pair + 1] = clamp8(((128 << 21) + RGB_VR * red - RGB_VG * green - RGB_VB * blue + (1 << 20)) >> 21);
+	}
+}
+
+void title_rgb48_to_nv12(const uint16_t *top, const uint16_t *bottom, uint8_t *luma_top, uint8_t *luma_bottom, uint8_t *chroma, int pixels)
+{
+	int32_t r[CONVERT_CHUNK], g[CONVERT_CHUNK], b[CONVERT_CHUNK];
+
+	rgb48_to_luma(top, luma_top, pixels);
+	if(bottom) rgb48_to_luma(bottom, luma_bottom, pixels);
+
+	// A single row counts twice
+	if(!bottom) bottom = top;
+
+	for(int first = 0; first < pixels; first += CONVERT_CHUNK)
+	{
+		int count = min(CONVERT_CHUNK, pixels - first);
+
+		add_rows(top + 3*first, bottom + 3*first, r, g, b, count);
+		sums_to_chroma(r, g, b, chroma + first, count / 2);
+	}
+}
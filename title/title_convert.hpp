@@ -0,0 +1,25 @@
+#ifndef TITLE_CONVERT_HPP
+#define TITLE_CONVERT_HPP
+
+#include <stdint.h>
+
+/*
+ * Row converters between the 8-bit formats of video sources and the IP's
+ * RGB48 (see TitleImage). An 8-bit value v is the 16-bit value v * 257, so
+ * RGB24 goes to RGB48 and back unchanged; the way back rounds to nearest.
+ *
+ * NV12 is BT.709 limited range (Y 16..235, Cb and Cr 16..240), one CbCr
+ * pair for every two by two pixels. Going back, the chroma of a pixel pair
+ * is the rounded mean of the pixels given, a row pair or a single row.
+ * NV12 rows have an even number of pixels.
+ */
+
+void title_rgb24_to_rgb48(const uint8_t *in, uint16_t *out, int pixels);
+void title_rgb48_to_rgb24(const uint16_t *in, uint8_t *out, int pixels);
+
+/* One row, chroma the row of the plane that belongs to it */
+void title_nv12_to_rgb48(const uint8_t *luma, const uint8_t *chroma, uint16_t *out, int pixels);
+/* The rows top and bottom (NULL for a single row) into their luma rows and the shared chroma row */
+void title_rgb48_to_nv12(const uint16_t *top, const uint16_t *bottom, uint8_t *luma_top, uint8_t *luma_bottom, uint8_t *chroma, int pixels);
+
+#endif
@@ -0,0 +1,72 @@
+#include "title_cpu.hpp"
+
+void title_expand_matrix(const uint16_t *letter_matrix, int words, uint16_t *expanded)
+{
+	for(int i = 0; i < words; i++)
+	{
+		for(int channel = 0; channel < TITLE_CHANNELS; channel++) expanded[TITLE_CHANNELS*i + channel] = letter_matrix[i];
+	}
+}
+
+/*
+ * With the coverage repeated per channel, a glyph row is one pass over
+ * contiguous words, which the compiler turns into packed 16-bit
+ * high-half multiplies.
+ */
+static inline void blend(uint16_t *__restrict pixels, const uint16_t *__restrict coverage, int words)
+{
+	for(int i = 0; i < words; i++)
+	{
+		pixels[i] += ((uint32_t)(0xFFFF - pixels[i]) * coverage[i]) >> 16;
+	}
+}
+
+static void draw_glyph(const uint16_t *glyph, int glyph_width, int glyph_rows, int x, int y,
+		       uint16_t *band, int width, int first_row, int last_row)
+{
+	int row_words = width * TITLE_CHANNELS;
+	int glyph_words = glyph_width * TITLE_CHANNELS;
+	int x0 = x < 0 ? -x : 0;
+	int x1 = x + glyph_width > width ? width - x : glyph_width;
+	int y0 = y < first_row ? first_row - y : 0;
+	int y1 = y + glyph_rows > last_row ? last_row - y : glyph_rows;
+
+	for(int row = y0; row < y1; row++)
+	{
+		blend(band + (long)(y + row) * row_words + (x + x0) * TITLE_CHANNELS,
+		      glyph + row * glyph_words + x0 * TITLE_CHANNELS, (x1 - x0) * TITLE_CHANNELS);
+	}
+}
+
+void title_draw_band(const uint16_t *letter_data, const uint16_t *expanded_matrix, int matrix_words, int glyph_rows,
+		     const uint16_t *text, int text_len, const int16_t *positions,
+		     uint16_t *band, int width, int first_row, int last_row)
+{
+	int run = 0;
+	int x = positions[0], y = positions[1];
+
+	for(int i = 0; i < text_len; i++)
+	{
+		int code = text[i];
+
+		if(code == TITLE_RUN_BREAK)
+		{
+			if(++run == TITLE_MAX_RUNS) return;
+			x = positions[2*run];
+			y = positions[2*run + 1];
+			continue;
+		}
+		if(code >= TITLE_GLYPHS) continue;
+
+		int offset = letter_data[2*code];
+		int glyph_width = letter_data[2*code + 1];
+
+		if(offset + glyph_width * glyph_rows <= matrix_words && x < width && x + glyph_width > 0 &&
+		   y < last_row && y + glyph_rows > first_row)
+		{
+			draw_glyph(expanded_matrix + TITLE_CHANNELS * offset, glyph_width, glyph_rows, x, y,
+				   band, width, first_row, last_row);
+		}
+		x += glyph_width;
+	}
+}
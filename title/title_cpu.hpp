@@ -0,0 +1,35 @@
+#ifndef TITLE_CPU_HPP
+#define TITLE_CPU_HPP
+
+#include <stdint.h>
+
+#include "title_ip.hpp"
+
+/*
+ * Host implementation of PROCESSING, what the IP does to the band in its
+ * BRAM with the letter data, letter matrix, text and position block it
+ * holds (see title_ip.hpp):
+ *
+ *  - the text is read word after word, TITLE_RUN_BREAK moves on to the
+ *    next run; runs past TITLE_MAX_RUNS are not drawn
+ *  - the pen starts at the run's (x, y) and every glyph is drawn with its
+ *    top left there, then the pen moves right by the glyph's width
+ *  - codes of TITLE_GLYPHS and above neither draw nor move the pen, glyphs
+ *    reaching past the letter matrix move it without drawing
+ *  - every covered channel becomes in + ((0xFFFF - in) * coverage >> 16),
+ *    later glyphs over earlier ones, clipped to the band
+ */
+
+/* The letter matrix with every word repeated for the three channels, the form title_draw_band() reads */
+void title_expand_matrix(const uint16_t *letter_matrix, int words, uint16_t *expanded);
+
+/*
+ * Draws the text into rows first_row..last_row-1 of a band width pixels
+ * wide; bands split by rows can be drawn by several threads at once.
+ * matrix_words is the size of the letter matrix before expansion.
+ */
+void title_draw_band(const uint16_t *letter_data, const uint16_t *expanded_matrix, int matrix_words, int glyph_rows,
+		     const uint16_t *text, int text_len, const int16_t *positions,
+		     uint16_t *band, int width, int first_row, int last_row);
+
+#endif
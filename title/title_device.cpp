@@ -0,0 +1,974 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "title_device.hpp"
+#include "title_cpu.hpp"
+#include "title_convert.hpp"
+
+using namespace std;
+
+/* ------------------------ */
+/* ------Band staging------ */
+/* ------------------------ */
+
+/* A thread running one band copy at a time next to the commands of render() */
+class BandStager
+{
+public:
+	BandStager()
+		: pending(false), quit(false), worker(&BandStager::run, this) {}
+
+	~BandStager()
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			quit = true;
+		}
+		wake.notify_all();
+		worker.join();
+	}
+
+	void submit(const function<void()> &copy)
+	{
+		lock_guard<mutex> guard(lock);
+		task = copy;
+		pending = true;
+		wake.notify_all();
+	}
+
+	void wait()
+	{
+		unique_lock<mutex> guard(lock);
+		done.wait(guard, [this] { return !pending; });
+	}
+
+private:
+	void run()
+	{
+		unique_lock<mutex> guard(lock);
+
+		for(;;)
+		{
+			wake.wait(guard, [this] { return pending || quit; });
+			if(!pending) return;
+
+			guard.unlock();
+			task();
+			guard.lock();
+
+			pending = false;
+			done.notify_all();
+		}
+	}
+
+	mutex lock;
+	condition_variable wake;
+	condition_variable done;
+	function<void()> task;
+	bool pending;
+	bool quit;
+	thread worker;
+};
+
+/* Row y of the image from pixel left on, pixels long, into the slot as RGB48 */
+static void stage_row(const TitleImage &image, int y, int left, int pixels, uint16_t *out)
+{
+	switch(image.format)
+	{
+	case TITLE_FORMAT_RGB48:
+		memcpy(out, image.row(0, y) + left * TITLE_CHANNELS * 2, pixels * TITLE_CHANNELS * 2);
+		break;
+
+	case TITLE_FORMAT_RGB24:
+		title_rgb24_to_rgb48(image.row(0, y) + left * TITLE_CHANNELS, out, pixels);
+		break;
+
+	case TITLE_FORMAT_NV12:
+		title_nv12_to_rgb48(image.row(0, y) + left, image.row(1, y / 2) + left, out, pixels);
+		break;
+	}
+}
+
+void title_stage_band(const TitleImage &image, const TitleGeometry &geometry, int left, int top, uint16_t *slot)
+{
+	int row_words = geometry.width * TITLE_CHANNELS;
+	int rows = min(geometry.band_rows, image.height - top);
+	int pixels = min(geometry.width, image.width - left);
+	int words = pixels * TITLE_CHANNELS;
+
+	for(int y = 0; y < rows; y++)
+	{
+		stage_row(image, top + y, left, pixels, slot + y * row_words);
+		if(words < row_words) memset(slot + y * row_words + words, 0, (row_words - words) * 2);
+	}
+	if(rows < geometry.band_rows) memset(slot + rows * row_words, 0, (geometry.band_rows - rows) * row_words * 2);
+}
+
+// Pixels per pass of copy_nv12_pair(), even
+#define COPY_CHUNK		256
+
+/* One flag per pixel, set where the IP's value differs from the staged one */
+static void changed_pixels(const uint16_t *__restrict out, const uint16_t *__restrict staged, uint8_t *__restrict changed, int pixels)
+{
+	for(int i = 0; i < pixels; i++)
+	{
+		changed[i] = (out[3*i] != staged[3*i]) | (out[3*i + 1] != staged[3*i + 1]) | (out[3*i + 2] != staged[3*i + 2]);
+	}
+}
+
+/*
+ * One NV12 row pair from the IP's rows top and bottom. Only the luma of
+ * changed pixels and the chroma of two by two blocks with a changed pixel
+ * are written; the rest stays as it is in the frame. A row of the pair
+ * that lies outside the band comes with its luma NULL and itself as
+ * staged, so it only feeds the chroma.
+ */
+static void copy_nv12_pair(const uint16_t *top, const uint16_t *bottom, const uint16_t *staged_top, const uint16_t *staged_bottom,
+			   uint8_t *luma_top, uint8_t *luma_bottom, uint8_t *chroma, int pixels)
+{
+	uint8_t new_top[COPY_CHUNK], new_bottom[COPY_CHUNK], new_chroma[COPY_CHUNK];
+	uint8_t changed_top[COPY_CHUNK], changed_bottom[COPY_CHUNK];
+
+	for(int first = 0; first < pixels; first += COPY_CHUNK)
+	{
+		int count = min(COPY_CHUNK, pixels - first);
+		int offset = TITLE_CHANNELS * first;
+
+		changed_pixels(top + offset, staged_top + offset, changed_top, count);
+		changed_pixels(bottom + offset, staged_bottom + offset, changed_bottom, count);
+		title_rgb48_to_nv12(top + offset, bottom + offset, new_top, new_bottom, new_chroma, count);
+
+		if(luma_top)
+		{
+			for(int i = 0; i < count; i++)
+			{
+				luma_top[first + i] = changed_top[i] ? new_top[i] : luma_top[first + i];
+			}
+		}
+		if(luma_bottom)
+		{
+			for(int i = 0; i < count; i++)
+			{
+				luma_bottom[first + i] = changed_bottom[i] ? new_bottom[i] : luma_bottom[first + i];
+			}
+		}
+		for(int i = 0; i < count; i += 2)
+		{
+			bool changed = changed_top[i] | changed_top[i + 1] | changed_bottom[i] | changed_bottom[i + 1];
+
+			chroma[first + i] = changed ? new_chroma[i] : chroma[first + i];
+			chroma[first + i + 1] = changed ? new_chroma[i + 1] : chroma[first + i + 1];
+		}
+	}
+}
+
+/*
+ * NV12 does not survive the trip to RGB48 and back unchanged (the clamps,
+ * the chroma mean of four pixels), so only what the IP drew is written
+ * back. A band can start or end in the middle of a row pair; the row of
+ * the pair outside the band is taken from the frame for the chroma.
+ */
+void title_copy_band(const TitleImage &image, const TitleGeometry &geometry, int left, int top, const uint16_t *slot, const uint16_t *staged)
+{
+	int row_words = geometry.width * TITLE_CHANNELS;
+	int rows = min(geometry.band_rows, image.height - top);
+	int pixels = min(geometry.width, image.width - left);
+	int words = pixels * TITLE_CHANNELS;
+	const uint16_t *was;
+	vector<uint16_t> outside;
+
+	for(int y = 0; y < rows; y++)
+	{
+		const uint16_t *in = slot + y * row_words;
+		int frame_y = top + y;
+
+		switch(image.format)
+		{
+		case TITLE_FORMAT_RGB48:
+			memcpy(image.row(0, frame_y) + left * TITLE_CHANNELS * 2, in, words * 2);
+			break;
+
+		case TITLE_FORMAT_RGB24:
+			title_rgb48_to_rgb24(in, image.row(0, frame_y) + left * TITLE_CHANNELS, pixels);
+			break;
+
+		case TITLE_FORMAT_NV12:
+			was = staged + y * row_words;
+			if(frame_y % 2 == 0 && y + 1 < rows)
+			{
+				if(memcmp(in, was, words * 2) != 0 || memcmp(in + row_words, was + row_words, words * 2) != 0)
+				{
+					copy_nv12_pair(in, in + row_words, was, was + row_words, image.row(0, frame_y) + left, image.row(0, frame_y + 1) + left,
+						       image.row(1, frame_y / 2) + left, pixels);
+				}
+				y++;
+			}
+			else if(memcmp(in, was, words * 2) != 0)
+			{
+				int outside_y = frame_y ^ 1;
+
+				outside.resize(words);
+				stage_row(image, outside_y, left, pixels, &outside[0]);
+				if(frame_y % 2 == 0)
+				{
+					copy_nv12_pair(in, &outside[0], was, &outside[0], image.row(0, frame_y) + left, NULL, image.row(1, frame_y / 2) + left, pixels);
+				}
+				else
+				{
+					copy_nv12_pair(&outside[0], in, &outside[0], was, NULL, image.row(0, frame_y) + left, image.row(1, frame_y / 2) + left, pixels);
+				}
+			}
+			break;
+		}
+	}
+}
+
+/* ------------------------ */
+/* ------Title devices----- */
+/* ------------------------ */
+
+/* A band has to fit a slot and a letter matrix the area after TITLE_LETTER_MATRIX_OFFSET */
+static bool geometry_fits(const TitleGeometry &geometry)
+{
+	return geometry.width > 0 && geometry.band_rows > 0 && geometry.letter_matrix_words > 0 &&
+	       (long)geometry.width * geometry.band_rows * TITLE_CHANNELS * 2 <= TITLE_SLOT_LEN &&
+	       geometry.letter_matrix_words <= (TITLE_DMA_BUFFER_LEN - TITLE_LETTER_MATRIX_OFFSET) / 2;
+}
+
+/* The driver's table, false unless every code fits the buffer layout */
+static bool geometry_table(const struct title_dimensions &dimensions, vector<TitleGeometry> &table)
+{
+	if(dimensions.count == 0 || dimensions.count > TITLE_MAX_DIMENSIONS) return false;
+
+	table.clear();
+	for(unsigned int dimension = 0; dimension < dimensions.count; dimension++)
+	{
+		const title_dimension &d = dimensions.dimensions[dimension];
+		TitleGeometry geometry = { (int)d.width, (int)d.band_rows, (int)d.letter_matrix_words, 0 };
+
+		if(!geometry_fits(geometry)) return false;
+
+		// A code the original core has keeps its glyph height until a font says otherwise
+		if(dimension < TITLE_DIMENSIONS && geometry.width == title_geometry[dimension].width &&
+		   geometry.band_rows == title_geometry[dimension].band_rows) geometry.glyph_rows = title_geometry[dimension].glyph_rows;
+		table.push_back(geometry);
+	}
+	return true;
+}
+
+TitleDevice::TitleDevice(const string &ip_path, const string &dma_path)
+	: skip_clean_tiles(true), tiles_per_lock(4), buffer(NULL), ip_path(ip_path), dma_path(dma_path), ip_fd(-1), dma_fd(-1), stager(NULL), resident_letter_data(-1), resident_letter_matrix(-1),
+	  text_resident(false), positions_resident(false), partial_loads(true), pass_count(0)
+{
+	memset(&stats, 0, sizeof(stats));
+	memset(fonts, 0, sizeof(fonts));
+	dimensions.assign(title_geometry, title_geometry + TITLE_DIMENSIONS);
+
+	ip_fd = open(ip_path.c_str(), O_RDWR);
+	dma_fd = open(dma_path.c_str(), O_RDWR);
+	stats.syscalls += 2;
+	if(ip_fd < 0 || dma_fd < 0)
+	{
+		cout << "[title] Cannot open " << (ip_fd < 0 ? ip_path : dma_path) << ": " << strerror(errno) << endl;
+		return;
+	}
+
+	// Drivers without the ioctl have the original core's table, which is title_geometry
+	struct title_dimensions driver_dimensions;
+
+	stats.syscalls++;
+	if(ioctl(ip_fd, TITLE_IOC_GET_GEOMETRY, &driver_dimensions) == 0 && !geometry_table(driver_dimensions, dimensions))
+	{
+		cout << "[title] " << ip_path << " has frame sizes that do not fit the DMA buffer layout" << endl;
+		return;
+	}
+
+	void *p = mmap(0, TITLE_DMA_BUFFER_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, dma_fd, 0);
+	stats.syscalls++;
+	if(p == MAP_FAILED)
+	{
+		cout << "[title] MAP FAILED" << endl;
+		return;
+	}
+	buffer = (uint8_t *)p;
+}
+
+TitleDevice::TitleDevice(uint8_t *buffer)
+	: skip_clean_tiles(true), tiles_per_lock(4), buffer(buffer), ip_fd(-1), dma_fd(-1), stager(NULL), resident_letter_data(-1), resident_letter_matrix(-1),
+	  text_resident(false), positions_resident(false), partial_loads(true), pass_count(0)
+{
+	memset(&stats, 0, sizeof(stats));
+	memset(fonts, 0, sizeof(fonts));
+	dimensions.assign(title_geometry, title_geometry + TITLE_DIMENSIONS);
+}
+
+TitleDevice::~TitleDevice()
+{
+	delete stager;
+	for(int dimension = 0; dimension < TITLE_MAX_DIMENSIONS; dimension++) delete fonts[dimension];
+
+	if(dma_fd >= 0)
+	{
+		if(buffer) munmap(buffer, TITLE_DMA_BUFFER_LEN);
+		close(dma_fd);
+	}
+	if(ip_fd >= 0) close(ip_fd);
+}
+
+bool TitleDevice::lock()
+{
+	stats.syscalls++;
+	if(ioctl(ip_fd, TITLE_IOC_LOCK) < 0)
+	{
+		cout << "[title] Cannot lock " << ip_path << ": " << strerror(errno) << endl;
+		return false;
+	}
+	return true;
+}
+
+bool TitleDevice::unlock()
+{
+	stats.syscalls++;
+	return ioctl(ip_fd, TITLE_IOC_UNLOCK) == 0;
+}
+
+bool TitleDevice::set_weight(int weight)
+{
+	stats.syscalls++;
+	return ioctl(ip_fd, TITLE_IOC_SET_WEIGHT, &weight) == 0;
+}
+
+int TitleDevice::resident()
+{
+	int resident = 0;
+
+	stats.syscalls++;
+	if(ioctl(ip_fd, TITLE_IOC_RESIDENT, &resident) < 0) return 0;
+	return resident;
+}
+
+bool TitleDevice::issue(int command, int dimension, unsigned int buffer_offset, int start)
+{
+	char text[32];
+	int len;
+
+	if(start < 0)
+		len = snprintf(text, sizeof(text), "%d,%d,0,%u", command, dimension, buffer_offset);
+	else
+		len = snprintf(text, sizeof(text), "%d,%d,0,%u,%d", command, dimension, buffer_offset, start);
+
+	stats.syscalls++;
+	if(write(ip_fd, text, len) != len)
+	{
+		// A partial load turned down is taken again in full
+		if(start < 0 || (errno != EOPNOTSUPP && errno != ESTALE))
+			cout << "[title] " << title_command_name(command) << " failed: " << strerror(errno) << endl;
+		return false;
+	}
+	return true;
+}
+
+TitlePlan TitleDevice::plan(int width, int height) const
+{
+	return title_plan(&dimensions[0], dimensions.size(), width, height);
+}
+
+bool TitleDevice::command(int command, int dimension, unsigned int buffer_offset, int start)
+{
+	int bytes = start < 0 ? title_transfer_bytes(&dimensions[0], dimensions.size(), command, dimension) : dimension * 2;
+
+	if(!issue(command, dimension, buffer_offset, start)) return false;
+
+	stats.commands++;
+	if(command == IP_COMMAND_SEND_FROM_BRAM)
+		stats.bytes_from_device += bytes;
+	else
+		stats.bytes_to_device += bytes;
+	return true;
+}
+
+bool TitleDevice::reset()
+{
+	resident_letter_data = -1;
+	resident_letter_matrix = -1;
+	text_resident = false;
+	positions_resident = false;
+	return command(IP_COMMAND_RESET, 0, 0);
+}
+
+bool TitleDevice::load_letter_data(const uint16_t *letter_data)
+{
+	resident_letter_data = -1;
+	memcpy(buffer + TITLE_LETTER_DATA_OFFSET, letter_data, TITLE_LETTER_DATA_WORDS * 2);
+	return command(IP_COMMAND_LOAD_LETTER_DATA, 0, TITLE_LETTER_DATA_OFFSET);
+}
+
+bool TitleDevice::load_letter_matrix(int dimension, const uint16_t *letter_matrix)
+{
+	int bytes = title_transfer_bytes(&dimensions[0], dimensions.size(), IP_COMMAND_LOAD_LETTER_MATRIX, dimension);
+
+	if(!bytes) return false;
+
+	resident_letter_matrix = -1;
+	memcpy(buffer + TITLE_LETTER_MATRIX_OFFSET, letter_matrix, bytes);
+	return command(IP_COMMAND_LOAD_LETTER_MATRIX, dimension, TITLE_LETTER_MATRIX_OFFSET);
+}
+
+bool TitleDevice::load_text(const uint16_t *codes, int len)
+{
+	if(len <= 0 || len > TITLE_MAX_TEXT_WORDS) return false;
+
+	text_resident = false;
+	memcpy(buffer + TITLE_TEXT_OFFSET, codes, len * 2);
+	if(!command(IP_COMMAND_LOAD_TEXT, len, TITLE_TEXT_OFFSET)) return false;
+
+	resident_text.assign(codes, codes + len);
+	text_resident = true;
+	return true;
+}
+
+bool TitleDevice::load_position(const int16_t *positions)
+{
+	positions_resident = false;
+	memcpy(buffer + TITLE_POSITION_OFFSET, positions, TITLE_POSITION_WORDS * 2);
+	if(!command(IP_COMMAND_LOAD_POSSITION, 0, TITLE_POSITION_OFFSET)) return false;
+
+	memcpy(resident_positions, positions, TITLE_POSITION_WORDS * 2);
+	positions_resident = true;
+	return true;
+}
+
+bool TitleDevice::load_text_range(int start, const uint16_t *codes, int len)
+{
+	if(start < 0 || len <= 0 || start + len > TITLE_MAX_TEXT_WORDS) return false;
+
+	// The words before start stay, the mirror is right again only if they were
+	bool keep = text_resident && start <= (int)resident_text.size();
+
+	text_resident = false;
+	memcpy(buffer + TITLE_TEXT_OFFSET, codes, len * 2);
+	if(!command(IP_COMMAND_LOAD_TEXT, len, TITLE_TEXT_OFFSET, start))
+	{
+		if(errno == EOPNOTSUPP) partial_loads = false;
+		return false;
+	}
+
+	resident_text.resize(start + len);
+	copy(codes, codes + len, resident_text.begin() + start);
+	text_resident = keep;
+	return true;
+}
+
+bool TitleDevice::load_position_range(int start, const int16_t *positions, int len)
+{
+	if(start < 0 || len <= 0 || start + len > TITLE_POSITION_WORDS) return false;
+
+	bool keep = positions_resident;
+
+	positions_resident = false;
+	memcpy(buffer + TITLE_POSITION_OFFSET, positions, len * 2);
+	if(!command(IP_COMMAND_LOAD_POSSITION, len, TITLE_POSITION_OFFSET, start))
+	{
+		if(errno == EOPNOTSUPP) partial_loads = false;
+		return false;
+	}
+
+	memcpy(resident_positions + start, positions, len * 2);
+	positions_resident = keep;
+	return true;
+}
+
+bool TitleDevice::load_photo(int dimension, int slot)
+{
+	return command(IP_COMMAND_LOAD_PHOTO, dimension, TITLE_SLOT_OFFSET(slot));
+}
+
+bool TitleDevice::processing()
+{
+	return command(IP_COMMAND_PROCESSING, 0, 0);
+}
+
+bool TitleDevice::send_from_bram(int dimension, int slot)
+{
+	return command(IP_COMMAND_SEND_FROM_BRAM, dimension, TITLE_SLOT_OFFSET(slot));
+}
+
+bool TitleDevice::set_font(const TitleFont &font)
+{
+	if(font.dimension < 0 || font.dimension >= (int)dimensions.size() ||
+	   (int)font.letter_matrix.size() != dimensions[font.dimension].letter_matrix_words)
+	{
+		cout << "[title] The font for dimension " << font.dimension << " does not fit " << (ip_path.empty() ? name() : ip_path) << endl;
+		return false;
+	}
+
+	delete fonts[font.dimension];
+	fonts[font.dimension] = new TitleFont(font);
+	dimensions[font.dimension].glyph_rows = font.glyph_rows();
+
+	if(resident_letter_data == font.dimension) resident_letter_data = -1;
+	if(resident_letter_matrix == font.dimension) resident_letter_matrix = -1;
+	return true;
+}
+
+bool TitleDevice::load_fonts(const char *font_dir)
+{
+	for(int dimension = 0; dimension < (int)dimensions.size(); dimension++)
+	{
+		if(font_dir == NULL)
+		{
+			if(!set_font(TitleFont::synthetic(dimension, dimensions[dimension]))) return false;
+			continue;
+		}
+
+		char data_path[512], matrix_path[512];
+		TitleFont font;
+
+		snprintf(data_path, sizeof(data_path), "%s/letter_data_d%d.txt", font_dir, dimension);
+		snprintf(matrix_path, sizeof(matrix_path), "%s/letter_matrix_d%d.txt", font_dir, dimension);
+		if(!font.load(data_path, matrix_path, dimension, dimensions[dimension]) || !set_font(font)) return false;
+	}
+	return true;
+}
+
+/*
+ * What this object loaded last only says what the IP holds if no RESET
+ * and no other client came in between, the driver knows that.
+ */
+void TitleDevice::sync_resident()
+{
+	if(resident_letter_data < 0 && resident_letter_matrix < 0 && !text_resident && !positions_resident) return;
+
+	int resident = this->resident();
+
+	if(!(resident & TITLE_RESIDENT_LETTER_DATA)) resident_letter_data = -1;
+	if(!(resident & TITLE_RESIDENT_LETTER_MATRIX)) resident_letter_matrix = -1;
+	if(!(resident & TITLE_RESIDENT_TEXT)) text_resident = false;
+	if(!(resident & TITLE_RESIDENT_POSITION)) positions_resident = false;
+}
+
+bool TitleDevice::load_font(const TitleFont &font)
+{
+	int dimension = font.dimension;
+
+	if(resident_letter_data == dimension)
+	{
+		stats.letter_loads_skipped++;
+		stats.letter_bytes_skipped += title_transfer_bytes(IP_COMMAND_LOAD_LETTER_DATA, dimension);
+	}
+	else
+	{
+		if(!load_letter_data(font.letter_data)) return false;
+		resident_letter_data = dimension;
+	}
+
+	if(resident_letter_matrix == dimension)
+	{
+		stats.letter_loads_skipped++;
+		stats.letter_bytes_skipped += title_transfer_bytes(IP_COMMAND_LOAD_LETTER_MATRIX, dimension);
+	}
+	else
+	{
+		if(!load_letter_matrix(dimension, &font.letter_matrix[0])) return false;
+		resident_letter_matrix = dimension;
+	}
+	return true;
+}
+
+bool TitleDevice::update_text(const uint16_t *codes, int len)
+{
+	int old_len = resident_text.size();
+	int start = 0;
+
+	if(!text_resident || !partial_loads) return load_text(codes, len);
+
+	while(start < len && start < old_len && codes[start] == resident_text[start]) start++;
+	if(start == len && len == old_len)
+	{
+		stats.text_bytes_skipped += len * 2;
+		return true;
+	}
+	// The text ends with the last word loaded, a text cut short needs one
+	if(start == len) start--;
+	if(start > 0 && load_text_range(start, codes + start, len - start))
+	{
+		stats.text_bytes_skipped += start * 2;
+		return true;
+	}
+	return load_text(codes, len);
+}
+
+bool TitleDevice::update_position(const int16_t *positions)
+{
+	int first = 0, last = TITLE_POSITION_WORDS - 1;
+
+	if(!positions_resident || !partial_loads) return load_position(positions);
+
+	while(first < TITLE_POSITION_WORDS && positions[first] == resident_positions[first]) first++;
+	if(first == TITLE_POSITION_WORDS)
+	{
+		stats.text_bytes_skipped += TITLE_POSITION_WORDS * 2;
+		return true;
+	}
+	while(positions[last] == resident_positions[last]) last--;
+
+	if(load_position_range(first, positions + first, last - first + 1))
+	{
+		stats.text_bytes_skipped += (TITLE_POSITION_WORDS - (last - first + 1)) * 2;
+		return true;
+	}
+	return load_position(positions);
+}
+
+bool TitleDevice::render(const TitleImage &image, const string &text, TitlePoint position)
+{
+	return render(image, vector<TitleItem>(1, TitleItem(text, position)));
+}
+
+bool TitleDevice::render(const TitleImage &image, const vector<TitleItem> &items)
+{
+	TitlePlan plan = this->plan(image.width, image.height);
+	const TitleFont *font = fonts[plan.dimension];
+	TitleText layout;
+
+	if(image.width <= 0 || image.height <= 0) return false;
+	if(image.format == TITLE_FORMAT_NV12 && (image.width % 2 || image.height % 2))
+	{
+		cout << "[title] NV12 frames need an even width and height" << endl;
+		return false;
+	}
+	if(font == NULL)
+	{
+		cout << "[title] No font for dimension " << plan.dimension << endl;
+		return false;
+	}
+
+	/* Items in order, each joining the upload of the one before if both fit */
+	pass_count = 0;
+	for(size_t i = 0; i < items.size(); i++)
+	{
+		if(!font->layout(items[i].text, items[i].position, layout))
+		{
+			cout << "[title] Text does not fit the IP's text and position memories" << endl;
+			return false;
+		}
+		if(layout.left == layout.right) continue;
+		if(pass_count > 0 && title_append_text(passes[pass_count - 1], layout)) continue;
+		if(pass_count == (int)passes.size()) passes.push_back(TitleText());
+		passes[pass_count++] = layout;
+	}
+
+	stats.frames++;
+	find_dirty_tiles(plan);
+	if(dirty_tiles.empty()) return true;
+
+	/*
+	 * The IP is held for tiles_per_lock tiles at a time, so another client
+	 * gets it between turns. Whatever it loaded meanwhile is found by
+	 * sync_resident() and the bands of a turn are staged and copied back
+	 * inside it, the buffer is the IP's and not this client's.
+	 */
+	int count = dirty_tiles.size();
+	int turn = tiles_per_lock > 0 ? tiles_per_lock : count;
+	bool ok = true;
+
+	for(int first = 0; first < count && ok; first += turn)
+	{
+		if(!lock()) return false;
+
+		sync_resident();
+
+		// With one upload the text stays for the whole turn, process_tile() loads it otherwise
+		ok = load_font(*font) &&
+		     (pass_count > 1 || update_text(&passes[0].codes[0], passes[0].codes.size())) &&
+		     render_tiles(image, plan, first, min(first + turn, count));
+
+		unlock();
+	}
+	return ok;
+}
+
+static bool touches(const TitleText &text, const TitleGeometry &geometry, int left, int top)
+{
+	return text.left < left + geometry.width && text.right > left &&
+	       text.top < top + geometry.band_rows && text.bottom > top;
+}
+
+void TitleDevice::find_dirty_tiles(const TitlePlan &plan)
+{
+	const TitleGeometry &geometry = plan.geometry;
+	int left, top;
+
+	dirty_tiles.clear();
+	if(pass_count == 0) return;
+
+	for(int tile = 0; tile < plan.tiles(); tile++)
+	{
+		bool dirty = !skip_clean_tiles;
+
+		plan.tile(tile, left, top);
+		for(int i = 0; i < pass_count && !dirty; i++) dirty = touches(passes[i], geometry, left, top);
+		if(dirty) dirty_tiles.push_back(tile);
+	}
+	stats.tiles_skipped += plan.tiles() - dirty_tiles.size();
+}
+
+/* Draws the text uploads reaching the band in BRAM one after another, loading each unless it is the only one */
+bool TitleDevice::process_tile(int left, int top, int dimension)
+{
+	const TitleGeometry &geometry = dimensions[dimension];
+	int16_t positions[TITLE_POSITION_WORDS];
+	bool first = true;
+
+	for(int i = 0; i < pass_count; i++)
+	{
+		const TitleText &text = passes[i];
+
+		if(pass_count > 1 && !touches(text, geometry, left, top)) continue;
+
+		title_band_positions(text, left, top, positions);
+		if(pass_count > 1 && !update_text(&text.codes[0], text.codes.size())) return false;
+		if(!update_position(positions) || !processing()) return false;
+
+		if(!first) stats.extra_passes++;
+		first = false;
+	}
+	return true;
+}
+
+/*
+ * Dirty tiles [first, last) go through the IP one after another, the Nth
+ * of them from slot N % 2. Meanwhile the stager copies tile N-1, read back
+ * into the other slot in the previous round, out to the frame and tile N+1
+ * into that slot. Everything else of the frame stays where it is.
+ */
+bool TitleDevice::render_tiles(const TitleImage &image, const TitlePlan &plan, int first, int last)
+{
+	int dimension = plan.dimension;
+	int count = last - first;
+	const int *tiles = &dirty_tiles[first];
+	const TitleImage *target = &image;
+	int left, top;
+	bool ok = true;
+
+	if(!stager) stager = new BandStager;
+
+	plan.tile(tiles[0], left, top);
+	stage_band(image, dimension, left, top, 0);
+
+	for(int i = 0; i < count && ok; i++)
+	{
+		int slot = i & 1;
+		int other = slot ^ 1;
+
+		stager->submit([=]()
+		{
+			int left, top;
+
+			if(i > 0)
+			{
+				plan.tile(tiles[i - 1], left, top);
+				copy_band(*target, dimension, left, top, other);
+			}
+			if(i + 1 < count)
+			{
+				plan.tile(tiles[i + 1], left, top);
+				stage_band(*target, dimension, left, top, other);
+			}
+		});
+
+		plan.tile(tiles[i], left, top);
+		ok = load_photo(dimension, slot) &&
+		     process_tile(left, top, dimension) &&
+		     send_from_bram(dimension, slot);
+
+		stager->wait();
+		stats.tiles++;
+	}
+
+	if(ok)
+	{
+		plan.tile(tiles[count - 1], left, top);
+		copy_band(image, dimension, left, top, (count - 1) & 1);
+	}
+	return ok;
+}
+
+/* NV12 bands are staged in memory and kept there, title_copy_band() compares the slot with them */
+void TitleDevice::stage_band(const TitleImage &image, int dimension, int left, int top, int slot)
+{
+	const TitleGeometry &geometry = dimensions[dimension];
+	vector<uint16_t> &staged = staged_bands[slot];
+
+	if(image.format != TITLE_FORMAT_NV12)
+	{
+		title_stage_band(image, geometry, left, top, band_slot(slot));
+		return;
+	}
+
+	staged.resize(geometry.band_rows * geometry.width * TITLE_CHANNELS);
+	title_stage_band(image, geometry, left, top, &staged[0]);
+	memcpy(band_slot(slot), &staged[0], staged.size() * 2);
+}
+
+void TitleDevice::copy_band(const TitleImage &image, int dimension, int left, int top, int slot)
+{
+	title_copy_band(image, dimensions[dimension], left, top, band_slot(slot), image.format == TITLE_FORMAT_NV12 ? &staged_bands[slot][0] : NULL);
+}
+
+/* ------------------------ */
+/* -----Simulated title---- */
+/* ------------------------ */
+
+SimTitleDevice::SimTitleDevice()
+	: TitleDevice(new uint8_t[TITLE_DMA_BUFFER_LEN]()), dimension(0)
+{
+}
+
+SimTitleDevice::~SimTitleDevice()
+{
+	delete[] buffer;
+}
+
+bool SimTitleDevice::set_geometry(const vector<TitleGeometry> &table)
+{
+	if(table.empty() || table.size() > TITLE_MAX_DIMENSIONS) return false;
+	for(size_t dimension = 0; dimension < table.size(); dimension++)
+	{
+		if(!geometry_fits(table[dimension])) return false;
+	}
+
+	dimensions = table;
+	return true;
+}
+
+/* Checks the transfer like the driver does, then does what the IP would */
+bool SimTitleDevice::issue(int command, int dimension, unsigned int buffer_offset, int start)
+{
+	int bytes = start < 0 ? title_transfer_bytes(&dimensions[0], dimensions.size(), command, dimension) : dimension * 2;
+	uint16_t *words = (uint16_t *)(buffer + buffer_offset);
+
+	if(!bytes && command != IP_COMMAND_PROCESSING && command != IP_COMMAND_RESET) return false;
+	if(buffer_offset % TITLE_DMA_ALIGN || buffer_offset > (unsigned int)(TITLE_DMA_BUFFER_LEN - bytes)) return false;
+
+	if(start >= 0)
+	{
+		if(command == IP_COMMAND_LOAD_TEXT && dimension > 0 && start + dimension <= TITLE_MAX_TEXT_WORDS &&
+		   start <= (int)text.size())
+		{
+			text.resize(start + dimension);
+			copy(words, words + dimension, text.begin() + start);
+			return true;
+		}
+		if(command == IP_COMMAND_LOAD_POSSITION && dimension > 0 && start + dimension <= TITLE_POSITION_WORDS &&
+		   positions.size() == TITLE_POSITION_WORDS)
+		{
+			copy(words, words + dimension, positions.begin() + start);
+			return true;
+		}
+		errno = ESTALE;
+		return false;
+	}
+
+	switch(command)
+	{
+	case IP_COMMAND_LOAD_LETTER_DATA:
+		letter_data.assign(words, words + bytes / 2);
+		break;
+
+	case IP_COMMAND_LOAD_LETTER_MATRIX:
+		letter_matrix.assign(words, words + bytes / 2);
+		break;
+
+	case IP_COMMAND_LOAD_TEXT:
+		text.assign(words, words + bytes / 2);
+		break;
+
+	case IP_COMMAND_LOAD_POSSITION:
+		positions.assign(words, words + bytes / 2);
+		break;
+
+	case IP_COMMAND_LOAD_PHOTO:
+		bram.assign(words, words + bytes / 2);
+		this->dimension = dimension;
+		break;
+
+	case IP_COMMAND_PROCESSING:
+		process();
+		break;
+
+	case IP_COMMAND_SEND_FROM_BRAM:
+		if((int)bram.size() * 2 < bytes) return false;
+		memcpy(words, &bram[0], bytes);
+		break;
+
+	case IP_COMMAND_RESET:
+		letter_data.clear();
+		letter_matrix.clear();
+		text.clear();
+		positions.clear();
+		bram.clear();
+		break;
+
+	default:
+		return false;
+	}
+	return true;
+}
+
+/* ------------------------ */
+/* -------CPU title-------- */
+/* ------------------------ */
+
+CpuTitleDevice::CpuTitleDevice(int threads)
+	: threads(threads < 1 ? 1 : threads)
+{
+}
+
+bool CpuTitleDevice::issue(int command, int dimension, unsigned int buffer_offset, int start)
+{
+	if(!SimTitleDevice::issue(command, dimension, buffer_offset, start)) return false;
+
+	if(command == IP_COMMAND_LOAD_LETTER_MATRIX)
+	{
+		expanded_matrix.resize(letter_matrix.size() * TITLE_CHANNELS);
+		title_expand_matrix(&letter_matrix[0], letter_matrix.size(), &expanded_matrix[0]);
+	}
+	if(command == IP_COMMAND_RESET) expanded_matrix.clear();
+	return true;
+}
+
+void CpuTitleDevice::process()
+{
+	const TitleGeometry &geometry = dimensions[dimension];
+
+	if(bram.empty() || text.empty() || expanded_matrix.empty() ||
+	   letter_data.size() != TITLE_LETTER_DATA_WORDS || positions.size() != TITLE_POSITION_WORDS) return;
+
+	/* Rows are split evenly, the calling thread takes the first share */
+	vector<thread> workers;
+	int share = (geometry.band_rows + threads - 1) / threads;
+
+	for(int first = share; first < geometry.band_rows; first += share)
+	{
+		workers.push_back(thread(title_draw_band, &letter_data[0], &expanded_matrix[0], (int)letter_matrix.size(), geometry.glyph_rows,
+					 &text[0], (int)text.size(), (const int16_t *)&positions[0],
+					 &bram[0], geometry.width, first, min(first + share, geometry.band_rows)));
+	}
+	title_draw_band(&letter_data[0], &expanded_matrix[0], letter_matrix.size(), geometry.glyph_rows,
+			&text[0], text.size(), (const int16_t *)&positions[0],
+			&bram[0], geometry.width, 0, min(share, geometry.band_rows));
+
+	for(size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
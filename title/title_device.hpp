@@ -0,0 +1,266 @@
+#ifndef TITLE_DEVICE_HPP
+#define TITLE_DEVICE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "title_ip.hpp"
+#include "font.hpp"
+
+struct TitleStats
+{
+	uint64_t bytes_to_device;
+	uint64_t bytes_from_device;
+	uint64_t commands;
+	uint64_t syscalls;
+	uint64_t frames;
+	uint64_t tiles;
+	// Tiles left out because no text touches them
+	uint64_t tiles_skipped;
+	// Letter data and letter matrix uploads left out because the IP still held them
+	uint64_t letter_loads_skipped;
+	uint64_t letter_bytes_skipped;
+	// Text and position bytes left out because the IP held the same words already
+	uint64_t text_bytes_skipped;
+	// PROCESSING runs on a band after its first, for items that did not fit one text upload
+	uint64_t extra_passes;
+};
+
+/* One text of a frame, drawn over the items before it */
+struct TitleItem
+{
+	TitleItem(const std::string &text = std::string(), TitlePoint position = TitlePoint()) : text(text), position(position) {}
+
+	std::string text;
+	TitlePoint position;
+};
+
+class BandStager;
+
+/* ------------------------ */
+/* ------Title devices----- */
+/* ------------------------ */
+
+/*
+ * One title IP (title-ipN) with its DMA buffer (dmaN). Both stay open and
+ * the buffer stays mapped for the life of the object. The typed command
+ * calls copy their data into the buffer area of that command and issue it;
+ * render() does a whole frame.
+ *
+ * Not thread safe, every thread or process sharing an IP opens its own
+ * TitleDevice and the driver schedules their commands.
+ */
+class TitleDevice
+{
+public:
+	TitleDevice(const std::string &ip_path = "/dev/title-ip0", const std::string &dma_path = "/dev/dma0");
+	virtual ~TitleDevice();
+
+	bool is_open() const { return buffer != NULL; }
+	virtual const char *name() const { return "device"; }
+
+	/*
+	 * Frame geometry per dimension code: the driver's table
+	 * (TITLE_IOC_GET_GEOMETRY) if it has one, title_geometry otherwise. A
+	 * core built for other frame sizes needs no rebuilt library. The glyph
+	 * heights are those of the fonts given to set_font().
+	 */
+	const std::vector<TitleGeometry> &geometry() const { return dimensions; }
+	/* title_plan() over geometry() */
+	TitlePlan plan(int width, int height) const;
+
+	/* Keep the IP to this client between commands (TITLE_IOC_LOCK), until unlock() */
+	virtual bool lock();
+	virtual bool unlock();
+	/* Commands this client may run back to back while others wait */
+	virtual bool set_weight(int weight);
+	/* TITLE_RESIDENT_* bits of the letter memories still holding this client's last load */
+	virtual int resident();
+
+	bool reset();
+	bool load_letter_data(const uint16_t *letter_data);
+	bool load_letter_matrix(int dimension, const uint16_t *letter_matrix);
+	bool load_text(const uint16_t *codes, int len);
+	bool load_position(const int16_t *positions);
+	/* Partial loads from word start on (see title_ioctl.h); the text ends after codes */
+	bool load_text_range(int start, const uint16_t *codes, int len);
+	bool load_position_range(int start, const int16_t *positions, int len);
+	/* The band is taken from / read back into a slot of the buffer, see band_slot() */
+	bool load_photo(int dimension, int slot);
+	bool processing();
+	bool send_from_bram(int dimension, int slot);
+
+	/* One of the two band slots of the mapped buffer */
+	uint16_t *band_slot(int slot) { return (uint16_t *)(buffer + TITLE_SLOT_OFFSET(slot)); }
+
+	/* Font used by render() for frames of the font's dimension, false if geometry() has no such code */
+	bool set_font(const TitleFont &font);
+	/* Fonts of all dimension codes of geometry() from letter_data_dN.txt and letter_matrix_dN.txt in font_dir, synthetic ones if NULL */
+	bool load_fonts(const char *font_dir);
+
+	/*
+	 * The calls below remember what they load and leave out what the IP
+	 * holds already. Lock the IP and call sync_resident() first, it forgets
+	 * whatever a RESET or another client has replaced since.
+	 */
+	void sync_resident();
+	/* Loads the font's letter data and letter matrix unless the IP holds them */
+	bool load_font(const TitleFont &font);
+	/*
+	 * Load only the words from the first to the last one that differ from
+	 * the memory, if the core takes partial loads, everything otherwise.
+	 */
+	bool update_text(const uint16_t *codes, int len);
+	bool update_position(const int16_t *positions);
+
+	/*
+	 * Burns text into the frame at position (the top left of the first
+	 * glyph). Frames of any size go through the IP in the tiles of plan(),
+	 * with the font of the plan's dimension code. The IP is
+	 * locked for tiles_per_lock tiles at a time; while it works on tile N,
+	 * another thread copies tile N-1 out of the other slot and tile N+1 in,
+	 * converting 8-bit formats row by row on the way.
+	 */
+	bool render(const TitleImage &image, const std::string &text, TitlePoint position);
+	/*
+	 * Several items at once (a title, a clock, a ticker), in one pass over
+	 * every band: as many items as fit share one text and position upload,
+	 * the runs of one after those of the other. Items past that go in
+	 * further uploads, each followed by another PROCESSING on the band still
+	 * in BRAM, so no band is loaded or read back twice.
+	 */
+	bool render(const TitleImage &image, const std::vector<TitleItem> &items);
+
+	/*
+	 * Only tiles that meet the text's box go through the IP, the others are
+	 * left in the frame as they are (on by default). The IP draws nothing
+	 * outside the glyphs and only the pixels it changed are copied back,
+	 * so the result is the same.
+	 */
+	bool skip_clean_tiles;
+	/*
+	 * Dirty tiles render() runs per TITLE_IOC_LOCK (4 by default, 0 for the
+	 * whole frame). Other clients sharing the IP take their turn in between,
+	 * each turn costs a lock, a TITLE_IOC_RESIDENT and the band staged
+	 * before the IP starts.
+	 */
+	int tiles_per_lock;
+
+	TitleStats stats;
+
+protected:
+	/* For simulations, the buffer stays theirs */
+	TitleDevice(uint8_t *buffer);
+
+	/* Issues one command whose transfer starts at buffer_offset and waits for it; start is -1 but for partial loads */
+	virtual bool issue(int command, int dimension, unsigned int buffer_offset, int start);
+
+	uint8_t *buffer;
+	// See geometry()
+	std::vector<TitleGeometry> dimensions;
+
+private:
+	bool command(int command, int dimension, unsigned int buffer_offset, int start = -1);
+	bool render_tiles(const TitleImage &image, const TitlePlan &plan, int first, int last);
+	bool process_tile(int left, int top, int dimension);
+	void find_dirty_tiles(const TitlePlan &plan);
+	void stage_band(const TitleImage &image, int dimension, int left, int top, int slot);
+	void copy_band(const TitleImage &image, int dimension, int left, int top, int slot);
+
+	std::string ip_path;
+	std::string dma_path;
+	int ip_fd;
+	int dma_fd;
+
+	TitleFont *fonts[TITLE_MAX_DIMENSIONS];
+	BandStager *stager;
+	// Dimension of the font load_font() last put in each letter memory, -1 if unknown
+	int resident_letter_data;
+	int resident_letter_matrix;
+	// What the text and position memories hold, valid while the flags are set
+	std::vector<uint16_t> resident_text;
+	int16_t resident_positions[TITLE_POSITION_WORDS];
+	bool text_resident;
+	bool positions_resident;
+	// Cleared once the driver turns a partial load down with EOPNOTSUPP
+	bool partial_loads;
+	// Tiles of the current frame going through the IP and the text uploads drawn on them, kept to reuse their memory
+	std::vector<int> dirty_tiles;
+	std::vector<TitleText> passes;
+	int pass_count;
+	// What stage_band() put in each slot, for NV12 frames only
+	std::vector<uint16_t> staged_bands[2];
+
+	TitleDevice(const TitleDevice &);
+	TitleDevice &operator=(const TitleDevice &);
+};
+
+/*
+ * Host-only stand-in for the IP. It keeps the IP's memories and follows
+ * the command protocol on a buffer in memory, but PROCESSING leaves the
+ * band as it is, so it measures everything except the IP's drawing.
+ */
+class SimTitleDevice : public TitleDevice
+{
+public:
+	SimTitleDevice();
+	~SimTitleDevice();
+
+	const char *name() const { return "sim"; }
+
+	bool lock() { return true; }
+	bool unlock() { return true; }
+	bool set_weight(int) { return true; }
+	/* Takes another device's table, to draw the same tiles as it; load the fonts after. False if it does not fit the buffer layout */
+	bool set_geometry(const std::vector<TitleGeometry> &table);
+	// Nobody else loads the memories
+	int resident() { return TITLE_RESIDENT_LETTER_DATA | TITLE_RESIDENT_LETTER_MATRIX | TITLE_RESIDENT_TEXT | TITLE_RESIDENT_POSITION; }
+
+protected:
+	bool issue(int command, int dimension, unsigned int buffer_offset, int start);
+
+	/* PROCESSING on the band in bram */
+	virtual void process() {}
+
+	std::vector<uint16_t> letter_data;
+	std::vector<uint16_t> letter_matrix;
+	std::vector<uint16_t> text;
+	std::vector<uint16_t> positions;
+	std::vector<uint16_t> bram;
+	// Dimension code of the band in bram
+	int dimension;
+};
+
+/*
+ * The simulation with PROCESSING done by title_draw_band(), the band's
+ * rows split over threads: what the IP returns, without the IP. A fallback
+ * where there is none and the reference the device is checked against.
+ */
+class CpuTitleDevice : public SimTitleDevice
+{
+public:
+	CpuTitleDevice(int threads = 1);
+
+	const char *name() const { return "cpu"; }
+
+protected:
+	bool issue(int command, int dimension, unsigned int buffer_offset, int start);
+	void process();
+
+private:
+	int threads;
+	// letter_matrix as title_draw_band() reads it, redone on every LOAD_LETTER_MATRIX
+	std::vector<uint16_t> expanded_matrix;
+};
+
+/* Copies the tile of that geometry with its top left at (left, top) into a slot as RGB48, whatever lies past the frame is zero */
+void title_stage_band(const TitleImage &image, const TitleGeometry &geometry, int left, int top, uint16_t *slot);
+/*
+ * Copies the part of the tile that lies inside the frame back, in the
+ * frame's format. For NV12 staged is the band title_stage_band() gave and
+ * only pixels that differ from it are written; other formats take NULL.
+ */
+void title_copy_band(const TitleImage &image, const TitleGeometry &geometry, int left, int top, const uint16_t *slot, const uint16_t *staged);
+
+#endif
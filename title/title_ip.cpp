@@ -0,0 +1,152 @@
+#include <string.h>
+
+#include "title_ip.hpp"
+
+/* Glyph heights are those of the fonts the IP came with, TitleFont::synthetic() cuts its glyphs to them */
+const TitleGeometry title_geometry[TITLE_DIMENSIONS] =
+{
+	{  640, 101, 16602, 16 },
+	{  960,  67, 22716, 19 },
+	{ 1280,  50, 29792, 22 },
+	{ 1600,  40, 37569, 25 },
+	{ 1920,  33, 46423, 28 },
+};
+
+static_assert(TITLE_POSITION_OFFSET + 2*TITLE_POSITION_WORDS <= TITLE_TEXT_OFFSET, "position area overlaps the text");
+static_assert(TITLE_LETTER_DATA_OFFSET + 2*TITLE_LETTER_DATA_WORDS <= TITLE_LETTER_MATRIX_OFFSET, "letter data overlaps the letter matrix");
+static_assert(TITLE_LETTER_MATRIX_OFFSET + 2*46423 <= TITLE_DMA_BUFFER_LEN, "letter matrix does not fit the DMA buffer");
+static_assert(TITLE_SLOT_LEN % TITLE_DMA_ALIGN == 0 && TITLE_CONTROL_OFFSET % TITLE_DMA_ALIGN == 0, "DMA areas must be aligned");
+
+int title_dimension_for_width(int width)
+{
+	for(int dimension = 0; dimension < TITLE_DIMENSIONS; dimension++)
+	{
+		if(title_geometry[dimension].width == width) return dimension;
+	}
+	return -1;
+}
+
+long TitlePlan::dma_bytes() const
+{
+	return 2L * tiles() * title_band_bytes(geometry);
+}
+
+void TitlePlan::tile(int index, int &left, int &top) const
+{
+	left = (index % stripes) * geometry.width;
+	top = (index / stripes) * geometry.band_rows;
+}
+
+TitlePlan title_plan(const TitleGeometry *table, int count, int width, int height)
+{
+	TitlePlan best;
+
+	for(int dimension = 0; dimension < count; dimension++)
+	{
+		const TitleGeometry &geometry = table[dimension];
+		TitlePlan plan;
+
+		plan.dimension = dimension;
+		plan.geometry = geometry;
+		plan.stripes = (width + geometry.width - 1) / geometry.width;
+		plan.bands = (height + geometry.band_rows - 1) / geometry.band_rows;
+
+		if(dimension == 0 || plan.dma_bytes() < best.dma_bytes() ||
+		   (plan.dma_bytes() == best.dma_bytes() && plan.tiles() < best.tiles())) best = plan;
+	}
+	return best;
+}
+
+TitlePlan title_plan(int width, int height)
+{
+	return title_plan(title_geometry, TITLE_DIMENSIONS, width, height);
+}
+
+int title_band_bytes(const TitleGeometry &geometry)
+{
+	return geometry.band_rows * geometry.width * TITLE_CHANNELS * 2;
+}
+
+int title_band_bytes(int dimension)
+{
+	return title_band_bytes(title_geometry[dimension]);
+}
+
+int title_transfer_bytes(const TitleGeometry *table, int count, int command, int dimension)
+{
+	if(command == IP_COMMAND_LOAD_TEXT) return dimension > 0 && dimension <= TITLE_MAX_TEXT_WORDS ? dimension * 2 : 0;
+	if(command == IP_COMMAND_LOAD_LETTER_DATA) return TITLE_LETTER_DATA_WORDS * 2;
+	if(command == IP_COMMAND_LOAD_POSSITION) return TITLE_POSITION_WORDS * 2;
+
+	if(dimension < 0 || dimension >= count) return 0;
+
+	switch(command)
+	{
+	case IP_COMMAND_LOAD_LETTER_MATRIX:	return table[dimension].letter_matrix_words * 2;
+	case IP_COMMAND_LOAD_PHOTO:
+	case IP_COMMAND_SEND_FROM_BRAM:		return title_band_bytes(table[dimension]);
+	default:				return 0;
+	}
+}
+
+int title_transfer_bytes(int command, int dimension)
+{
+	return title_transfer_bytes(title_geometry, TITLE_DIMENSIONS, command, dimension);
+}
+
+const char *title_command_name(int command)
+{
+	switch(command)
+	{
+	case IP_COMMAND_LOAD_LETTER_DATA:	return "LOAD_LETTER_DATA";
+	case IP_COMMAND_LOAD_LETTER_MATRIX:	return "LOAD_LETTER_MATRIX";
+	case IP_COMMAND_LOAD_TEXT:		return "LOAD_TEXT";
+	case IP_COMMAND_LOAD_POSSITION:		return "LOAD_POSSITION";
+	case IP_COMMAND_LOAD_PHOTO:		return "LOAD_PHOTO";
+	case IP_COMMAND_PROCESSING:		return "PROCESSING";
+	case IP_COMMAND_SEND_FROM_BRAM:		return "SEND_FROM_BRAM";
+	case IP_COMMAND_RESET:			return "RESET";
+	default:				return "UNKNOWN";
+	}
+}
+
+long title_image_bytes(TitleFormat format, int width, int height)
+{
+	long pixels = (long)width * height;
+
+	switch(format)
+	{
+	case TITLE_FORMAT_RGB24:	return pixels * TITLE_CHANNELS;
+	case TITLE_FORMAT_NV12:		return pixels + pixels / 2;
+	default:			return pixels * TITLE_CHANNELS * 2;
+	}
+}
+
+TitleImage title_image(TitleFormat format, int width, int height, uint8_t *data)
+{
+	switch(format)
+	{
+	case TITLE_FORMAT_RGB24:	return TitleImage(format, width, height, data, width * TITLE_CHANNELS);
+	case TITLE_FORMAT_NV12:		return TitleImage(format, width, height, data, width, data + (long)width * height, width);
+	default:			return TitleImage(format, width, height, data, width * TITLE_CHANNELS * 2);
+	}
+}
+
+const char *title_format_name(TitleFormat format)
+{
+	switch(format)
+	{
+	case TITLE_FORMAT_RGB24:	return "rgb24";
+	case TITLE_FORMAT_NV12:		return "nv12";
+	default:			return "rgb48";
+	}
+}
+
+bool title_parse_format(const char *name, TitleFormat &format)
+{
+	if(strcmp(name, "rgb48") == 0) format = TITLE_FORMAT_RGB48;
+	else if(strcmp(name, "rgb24") == 0) format = TITLE_FORMAT_RGB24;
+	else if(strcmp(name, "nv12") == 0) format = TITLE_FORMAT_NV12;
+	else return false;
+	return true;
+}
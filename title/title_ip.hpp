@@ -0,0 +1,210 @@
+#ifndef TITLE_IP_HPP
+#define TITLE_IP_HPP
+
+#include <stdint.h>
+
+#include "../driver/title_ioctl.h"
+
+#define IP_COMMAND_LOAD_LETTER_DATA		0x0001
+#define IP_COMMAND_LOAD_LETTER_MATRIX		0x0002
+#define IP_COMMAND_LOAD_TEXT			0x0004
+#define IP_COMMAND_LOAD_POSSITION		0x0008
+#define IP_COMMAND_LOAD_PHOTO			0x0010
+#define IP_COMMAND_PROCESSING			0x0020
+#define IP_COMMAND_SEND_FROM_BRAM		0x0040
+#define IP_COMMAND_RESET			0x0080
+
+/* ------------------------ */
+/* ----What the IP draws--- */
+/* ------------------------ */
+
+/*
+ * The IP burns text into one band of a frame at a time. A band is
+ * band_rows rows of the frame, every pixel three 16-bit channels (R, G, B)
+ * next to each other, rows one after another.
+ *
+ * The font is a set of TITLE_GLYPHS glyphs for one dimension code. The
+ * letter data holds two words per glyph, the index of its first word in
+ * the letter matrix and its width in pixels. A glyph is glyph_rows rows of
+ * width words in the letter matrix, every word the glyph's coverage of
+ * that pixel, 0 (transparent) to 0xFFFF.
+ *
+ * The text is a list of glyph codes in runs separated by TITLE_RUN_BREAK.
+ * The position block holds one (x, y) pair of signed words per run,
+ * relative to the top left of the band, so a client moves the positions
+ * up by band_rows for every band. A run is drawn glyph after glyph from
+ * its position to the right, every covered channel becoming
+ * in + ((0xFFFF - in) * coverage >> 16), i.e. white text. Whatever falls
+ * outside the band is clipped. PROCESSING draws into the band in BRAM, so
+ * it can run again with other text and positions before SEND_FROM_BRAM.
+ *
+ * Cores with the load start register also take LOAD_TEXT and
+ * LOAD_POSSITION for a range of words from a start word on, leaving the
+ * rest of the memory alone; the text then ends after the range.
+ */
+
+#define TITLE_DIMENSIONS			5
+#define TITLE_CHANNELS				3
+
+#define TITLE_GLYPHS				107
+#define TITLE_LETTER_DATA_WORDS			(2*TITLE_GLYPHS)
+#define TITLE_POSITION_WORDS			106
+#define TITLE_MAX_RUNS				(TITLE_POSITION_WORDS/2)
+#define TITLE_MAX_TEXT_WORDS			1024
+
+#define TITLE_RUN_BREAK				0xFFFF
+
+struct TitleGeometry
+{
+	int width;
+	int band_rows;
+	int letter_matrix_words;
+	// Set by the font of the dimension code, the driver does not know it
+	int glyph_rows;
+};
+
+/*
+ * The original core's table, indexed by dimension code D0..D4. A device
+ * takes the driver's (TITLE_IOC_GET_GEOMETRY) instead where it has one,
+ * see TitleDevice::geometry().
+ */
+extern const TitleGeometry title_geometry[TITLE_DIMENSIONS];
+
+/* Dimension code of frames width pixels wide, -1 if there is none */
+int title_dimension_for_width(int width);
+
+/*
+ * How a frame of any size goes through the IP: cut into column stripes as
+ * wide as the dimension code's frames, every stripe into bands. Tiles
+ * reaching past the frame are padded with zeros on the way in and cropped
+ * on the way out.
+ */
+struct TitlePlan
+{
+	int dimension;
+	// Of the dimension code, from the table the plan was made with
+	TitleGeometry geometry;
+	int stripes;
+	int bands;
+
+	int tiles() const { return stripes * bands; }
+	/* Bytes the DMA moves per frame, both directions */
+	long dma_bytes() const;
+	/* Frame coordinates of the top left of a tile, tiles go band by band, stripe by stripe */
+	void tile(int index, int &left, int &top) const;
+};
+
+/* The plan moving the fewest bytes for a width x height frame, fewest tiles among equals; title_geometry without a table */
+TitlePlan title_plan(const TitleGeometry *table, int count, int width, int height);
+TitlePlan title_plan(int width, int height);
+
+/* Bytes one band takes in the DMA buffer */
+int title_band_bytes(const TitleGeometry &geometry);
+int title_band_bytes(int dimension);
+
+/*
+ * Bytes the DMA moves for a command, 0 for PROCESSING and RESET and for a
+ * dimension code past the table's count; LOAD_TEXT takes the word count
+ * as dimension. title_geometry without a table.
+ */
+int title_transfer_bytes(const TitleGeometry *table, int count, int command, int dimension);
+int title_transfer_bytes(int command, int dimension);
+
+const char *title_command_name(int command);
+
+/* ------------------------ */
+/* -------DMA buffer------- */
+/* ------------------------ */
+
+/*
+ * Layout of the TITLE_DMA_BUFFER_LEN bytes mapped through dmaN: two band
+ * slots, so one band can be staged or copied out while the IP streams the
+ * other, followed by the areas for the smaller uploads.
+ */
+#define TITLE_SLOT_LEN				389120
+#define TITLE_SLOT_OFFSET(slot)			((slot) * TITLE_SLOT_LEN)
+#define TITLE_CONTROL_OFFSET			(2*TITLE_SLOT_LEN)
+#define TITLE_POSITION_OFFSET			(TITLE_CONTROL_OFFSET)
+#define TITLE_TEXT_OFFSET			(TITLE_CONTROL_OFFSET + 256)
+#define TITLE_LETTER_DATA_OFFSET		(TITLE_TEXT_OFFSET + 2*TITLE_MAX_TEXT_WORDS)
+#define TITLE_LETTER_MATRIX_OFFSET		(TITLE_CONTROL_OFFSET + 4096)
+
+/* ------------------------ */
+/* ---------Frames--------- */
+/* ------------------------ */
+
+/* A frame in the IP's pixel layout; stride is the number of words from one row to the next */
+struct TitleFrame
+{
+	TitleFrame(int width = 0, int height = 0, uint16_t *pixels = 0)
+		: width(width), height(height), stride(width * TITLE_CHANNELS), pixels(pixels) {}
+
+	int width;
+	int height;
+	int stride;
+	uint16_t *pixels;
+
+	uint16_t *row(int y) const { return pixels + (long)y * stride; }
+};
+
+enum TitleFormat
+{
+	TITLE_FORMAT_RGB48,
+	TITLE_FORMAT_RGB24,
+	TITLE_FORMAT_NV12
+};
+
+/*
+ * A frame in one of the formats render() converts from and back to on the
+ * way through the DMA buffer (see title_convert.hpp). RGB48 and RGB24 are
+ * in plane 0; NV12 has its luma in plane 0 and the interleaved CbCr rows,
+ * one for every two rows, in plane 1, width and height even. Strides are
+ * in bytes.
+ */
+struct TitleImage
+{
+	TitleImage(TitleFormat format = TITLE_FORMAT_RGB48, int width = 0, int height = 0,
+		   uint8_t *plane0 = 0, int stride0 = 0, uint8_t *plane1 = 0, int stride1 = 0)
+		: format(format), width(width), height(height)
+	{
+		planes[0] = plane0;
+		planes[1] = plane1;
+		strides[0] = stride0;
+		strides[1] = stride1;
+	}
+	TitleImage(const TitleFrame &frame)
+		: format(TITLE_FORMAT_RGB48), width(frame.width), height(frame.height)
+	{
+		planes[0] = (uint8_t *)frame.pixels;
+		planes[1] = 0;
+		strides[0] = frame.stride * 2;
+		strides[1] = 0;
+	}
+
+	TitleFormat format;
+	int width;
+	int height;
+	uint8_t *planes[2];
+	int strides[2];
+
+	uint8_t *row(int plane, int y) const { return planes[plane] + (long)y * strides[plane]; }
+};
+
+/* Bytes of a packed width x height frame of the format, planes one after another */
+long title_image_bytes(TitleFormat format, int width, int height);
+/* The packed frame at data */
+TitleImage title_image(TitleFormat format, int width, int height, uint8_t *data);
+
+const char *title_format_name(TitleFormat format);
+/* rgb48, rgb24 or nv12; false for anything else */
+bool title_parse_format(const char *name, TitleFormat &format);
+
+struct TitlePoint
+{
+	TitlePoint(int x = 0, int y = 0) : x(x), y(y) {}
+
+	int x;
+	int y;
+};
+
+#endif